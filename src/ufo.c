@@ -24,6 +24,123 @@ Controls: Joystick or cursor keys + Ctrl for fire.
           windows size. Use 8 to toggle full-screen on/off.
           Esc to quit from game. Esc in start-screen to quit all.
           Character keys for entering high score name. Return to complete.
+          F3 shows/hides the frame profiler (time per phase of the frame).
+          F4 writes the trace file (with --trace FILE).
+          F5 prints the frame time statistics (also printed at exit).
+          F6 prints the allocations per call site (-DTRACK_ALLOCS builds).
+          F7 prints the hardware counters per phase (with --perf).
+          F8 saves the game to ufo.snapshot, F9 goes back to it (not while
+          recording or replaying).
+
+Options:  --seed N   start with random seed N; same seed and same input gives
+                     the same game (seed is printed at start-up).
+          --threads N  run the collision tests on N threads (1..16, default 1);
+                     the game is the same with any number of threads.
+          --batch N  play N games without window, sound or player and write
+                     score, survived frames and cause of death per game to a
+                     CSV file (--csv FILE, default stdout). Game k uses
+                     seed N + k, the games are divided over --threads.
+                     The player is a bot (--policy bot) or a fixed list of
+                     moves (--policy script). --difficulty, --asteroids,
+                     --ufo-randomness, --asteroid-randomness and
+                     --max-frames (default 18000) change the game.
+          --fuzz N   look for the slowest frame of the game (without window
+                     and sound) in N rounds: every round each of the
+                     --threads changes the seed or a run of keys of one of
+                     the 4 slowest cases so far and plays it. The slowest
+                     cases are written to PREFIX.1.case .. PREFIX.4.case
+                     (--fuzz-out PREFIX, default fuzz). --difficulty,
+                     --asteroids, --ufo-randomness, --asteroid-randomness
+                     and --max-frames are used as with --batch.
+          --fuzz-replay FILE  play a case of --fuzz 15 times and print the
+                     time of its slowest frame and of the whole game.
+          --record FILE  write the seed, difficulty, factor, random streams
+                     and the input of every frame of the game (keys,
+                     joystick, fire button, high score name, Escape) to FILE
+                     (the next games to FILE.2, FILE.3, ...). Only frames in
+                     which the input changes take space.
+          --replay FILE  play the game of FILE again without title screen,
+                     with the input of FILE, and report whether it ends in
+                     the same state (exit status 1 when not). --fast: no
+                     delay between frames (with --null: no window).
+          --factor N  start with window size factor N (1..9).
+          --null     no window and no sound (SDL dummy video and audio).
+          --bench=N  play N frames without delays with seed --seed (default
+                     1), difficulty --difficulty and scripted moves with fire,
+                     then write frames per second, mean time per phase (us)
+                     and peak RSS as JSON to stdout or --json FILE (the log
+                     goes to stderr then, so ufo --bench=600 | python -m
+                     json.tool works). Same build, seed and options give
+                     the same game, so runs can be compared across commits.
+                     Not in a -DNO_PROFILER build (no phase times).
+          --profile  time every phase of the frame from the start (F3 shows
+                     min, avg, p99 and max in microseconds of the last 256
+                     frames). Compile with -DNO_PROFILER to remove it.
+          --profile-csv FILE  same, and write the time per phase of every
+                     frame (nanoseconds) to FILE.
+          --trace FILE  record a timeline of the frame phases, image and
+                     sound loading, play_sound(), window resizes and the
+                     jobs of the threads. Written to FILE (trace event JSON
+                     for chrome://tracing or ui.perfetto.dev) at exit or
+                     with F4. Keeps the last 65536 events per thread.
+          --latency N  measure the time from each key or joystick event till
+                     the flip of the frame that used it; print a histogram
+                     after N events (0: at exit). Times start when the event
+                     is taken from the queue, for injected events at the push.
+          --inject-input  a thread presses 1 (start game) and then arrow
+                     keys at random moments, so --latency runs without a
+                     player (and without display with SDL_VIDEODRIVER=dummy).
+          --metrics PATH|PORT  serve frame rate, frame time percentiles,
+                     objects, mixer channels, score and uptime in Prometheus
+                     text format on Unix socket PATH or on 127.0.0.1:PORT,
+                     e.g. curl --unix-socket PATH http://localhost/metrics
+          --perf     (Linux) count cycles, instructions, LLC misses and branch
+                     misses of the main thread per phase of the frame, print
+                     them per frame with the IPC at exit (needs permission
+                     for perf events, see /proc/sys/kernel/perf_event_paranoid).
+          --alloc-check  (only with -DTRACK_ALLOCS) exit with an error when a
+                     frame after the first 60 leaves surfaces or memory
+                     allocated, and print where they were allocated.
+          --bench-collision  time the collision tests for large numbers of
+                     objects (no window) and exit.
+          --bench-kernels  time handle_asteroids, check_asteroid_positions,
+                     check_colliding_asteroids, check_bullet_hit,
+                     check_ship_collision, draw_asteroids and draw_stars
+                     alone with 15, 35, 1000 and 10000 asteroids (as far as
+                     ASTEROID_SLOTS allows) and the draws at factor 1, 5 and
+                     9. Uses the SDL dummy drivers, so no display is needed.
+          --bench-threads  time the parallel collision tests on 1..16 threads
+                     (no window) and exit. Compile with -DASTEROID_SLOTS=2000
+                     (or more) to test with more asteroids.
+          --bench-sweep N  play the --bench session for N frames at factor
+                     1..9 and full screen and print a table of the mean
+                     time per phase (us), the present time (FLIP) and the
+                     bytes written per frame by the present and (compile
+                     with -DCOUNT_BLITS) by blits and fills. Use --null on
+                     a box without display.
+          --bench-startup  run setup() and exit before the title screen,
+                     write the time, files opened (compile with
+                     -DCOUNT_FILES, else -1), read and write system calls
+                     (rw_syscalls), major page faults and blocks read of
+                     every step as JSON to stdout (the log goes to stderr
+                     then) or --json FILE. With --cold the page cache is
+                     emptied first (/proc/sys/vm/drop_caches as root, else
+                     only the data files are dropped from it, Linux).
+          --golden-record FILE  play --golden-frames N (default 300) frames
+                     like --bench (seed --seed, default 1, --difficulty,
+                     --factor, no window) and write a hash of the game state
+                     and a hash of the screen of every frame to FILE, and the
+                     screens themselves to FILE.frames.
+          --golden FILE  play the session of FILE again and compare. Reports
+                     the first frame where the state differs and the first
+                     frame where the screen differs (state the same: only
+                     the drawing changed), writes FILE.N.bmp (new screen) and
+                     FILE.N.diff.bmp (differences in magenta) for the first
+                     screen that differs and exits with 1 when anything
+                     differs.
+          --test-snapshots  restore snapshots with one bad field each (out of
+                     range or a name without end) and exit with 1 unless
+                     all are refused and the game is left unchanged.
 
 Compile and link in Linux:
 $ gcc -o ufo ufo.c -I/usr/include/SDL -lSDLmain -lSDL -lSDL_mixer -lSDL_ttf -lm
@@ -38,8 +155,10 @@ gcc -o ufo.exe ufo.c -Lc:\MinGW\include\SDL  -lmingw32 -lSDLmain -lSDL -lSDL_mix
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <time.h>
 
 #ifdef _WIN32
+#include <windows.h>
 #include <SDL/SDL.h>
 #include <SDL/SDL_mixer.h>
 #include <SDL/SDL_ttf.h>
@@ -51,6 +170,56 @@ gcc -o ufo.exe ufo.c -Lc:\MinGW\include\SDL  -lmingw32 -lSDLmain -lSDL -lSDL_mix
 #include <SDL_ttf.h>
 #endif
 
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* allocation tracker: compile with -DTRACK_ALLOCS to count every surface and
+   malloc() per line of this file (F6 or exit prints them, --alloc-check
+   stops with an error when frames leak after the first TRACK_WARMUP) */
+#ifdef TRACK_ALLOCS
+SDL_Surface * track_surface(SDL_Surface * s, const char * what, int line);
+void track_free_surface(SDL_Surface * s);
+void * track_malloc(size_t n, int line);
+void track_free(void * p);
+int track_site(const char * what, int line);
+int track_slot(void * p);
+void track_add(void * p, const char * what, int line, Uint32 bytes);
+void track_remove(void * p);
+void track_frame();
+void track_report();
+
+#undef SDL_LoadBMP
+#define SDL_LoadBMP(file) \
+  track_surface(SDL_LoadBMP_RW(SDL_RWFromFile(file, "rb"), 1), "SDL_LoadBMP", __LINE__)
+#define SDL_DisplayFormat(s) track_surface((SDL_DisplayFormat)(s), "SDL_DisplayFormat", __LINE__)
+#define SDL_CreateRGBSurface(...) \
+  track_surface((SDL_CreateRGBSurface)(__VA_ARGS__), "SDL_CreateRGBSurface", __LINE__)
+#define TTF_RenderText_Solid(f, t, c) \
+  track_surface((TTF_RenderText_Solid)(f, t, c), "TTF_RenderText_Solid", __LINE__)
+#define SDL_FreeSurface(s) track_free_surface(s)
+#define malloc(n) track_malloc(n, __LINE__)
+#define free(p) track_free(p)
+#define TRACK_FRAME() track_frame()
+#else
+#define TRACK_FRAME()
+#endif
+
 /* constants */
 #define DATA_PREFIX "../data/"
 #define MAX_STAR_SIZE 4
@@ -61,6 +230,7 @@ gcc -o ufo.exe ufo.c -Lc:\MinGW\include\SDL  -lmingw32 -lSDLmain -lSDL -lSDL_mix
 #define SHIP_H 4                  // ship height in pixels (factor 1)
 #define SHIELD_BITS 15
 #define SHIELD_BIT_TIMER 40
+#define SHIELD_ALL  0x7fff        // mask with all 15 shield bits
 #define SHIP_EXPLOSIONS 115       // nr of animations in exploding ship sequence
 #define MAX_BULLETS 3
 
@@ -73,26 +243,217 @@ gcc -o ufo.exe ufo.c -Lc:\MinGW\include\SDL  -lmingw32 -lSDLmain -lSDL -lSDL_mix
 
 #define NUM_SOUNDS 11
 
+/* size of the asteroids array (max of MAX_ASTEROIDS), can be raised at
+   compile time for stress tests: -DASTEROID_SLOTS=2000 */
+#ifndef ASTEROID_SLOTS
+#define ASTEROID_SLOTS 35
+#endif
+
+/* game state is per thread, so the batch runner can play a game on every
+   thread at the same time */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* job system (work stealing), --threads N. Worker 0 is the main thread */
+#define MAX_THREADS 16
+#define JOBS_PER_THREAD 8         // jobs per worker per run_parallel()
+
+/* all game objects live in Videopac coordinates (200x160), stored as 16.16
+   fixed point so sub-pixel speeds are kept. factor is only applied when drawing.
+   Game logic uses integer math only (no float), so a game runs bit-identical
+   on every platform and compiler (32 and 64 bits) */
+#define FIX_SHIFT 16
+#define FIX_ONE (1 << FIX_SHIFT)
+#define FIX(n) ((n) * FIX_ONE)                         // Videopac pixels to fixed point
+#define FIX_TO_SCREEN(v) (((v) * factor) >> FIX_SHIFT)  // fixed point to screen pixels
+
+/* collision masks (1 bit per pixel), made from the factor 1 images at start-up */
+#define MASK_ASTEROID_X    0
+#define MASK_ASTEROID_PLUS 1
+#define MASK_ASTEROID_BALL 2
+#define MASK_SHIP          3
+#define MASK_UFO           4
+#define MASK_LASER_LEFT    5      // \ laser
+#define MASK_LASER_RIGHT   6      // / laser
+#define MASK_BULLET        7      // 1 pixel
+#define MASK_SHIELD        8      // ship with active shield
+#define NUM_MASKS          9
+#define MASK_ROWS         16      // max height of a mask (width max 64)
+
+/* collision world (broadphase): box of every object, sorted on x once per frame.
+   Object types (lowest type first in a pair) */
+#define COL_BULLET   0
+#define COL_LASER    1
+#define COL_SHIP     2
+#define COL_ASTEROID 3
+#define COL_UFO      4
+/* fixed slot per object, so the sort order of last frame can be reused */
+#define COL_SLOT_LASER    MAX_BULLETS
+#define COL_SLOT_SHIP     (COL_SLOT_LASER + 3)       // laser[3]
+#define COL_SLOT_ASTEROID (COL_SLOT_SHIP + 1)
+#define COL_SLOT_UFO      (COL_SLOT_ASTEROID + ASTEROID_SLOTS)
+#define MAX_COL_BOXES     (COL_SLOT_UFO + 3)         // ufo[3]
+#define MAX_COL_PAIRS     (MAX_COL_BOXES * 32)       // per kind (>= all pairs at 35 asteroids)
+/* candidate pairs found by the broadphase, per kind of pair */
+#define PAIR_BULLET_ASTEROID   0
+#define PAIR_BULLET_UFO        1
+#define PAIR_LASER_ASTEROID    2
+#define PAIR_LASER_SHIP        3
+#define PAIR_SHIP_ASTEROID     4
+#define PAIR_SHIP_UFO          5
+#define PAIR_ASTEROID_ASTEROID 6
+#define PAIR_ASTEROID_UFO      7
+#define NUM_PAIR_TYPES         8
+
+/* gameplay events: collision checks only push events, resolve_events()
+   applies them after all checks of the frame are done */
+#if ASTEROID_SLOTS > 35
+#define MAX_EVENTS 65536          // ring buffer size (power of 2)
+#else
+#define MAX_EVENTS 1024
+#endif
+#define EV_HIT_ASTEROID        1  // a: asteroid (hit by bullet or shield)
+#define EV_HIT_UFO             2  // a: ufo, b: 1 if hit by ship (shield)
+#define EV_SHIELD_OFF          3
+#define EV_SHIP_DIES           4  // a: cause (DEATH_...)
+#define EV_LASER_HIT_ASTEROID  5  // a: laser, b: asteroid, x,y: mini explosion
+#define EV_LASER_HIT_SHIP      6  // a: laser
+#define EV_ASTEROIDS_BUMP      7  // a bumps into b
+#define EV_ASTEROID_HITS_UFO   8  // a: asteroid, b: ufo
+#define DEATH_ASTEROID 1
+#define DEATH_UFO      2
+#define DEATH_LASER    3
+
+/* player input (keys held down this frame) */
+#define INPUT_LEFT   1
+#define INPUT_RIGHT  2
+#define INPUT_UP     4
+#define INPUT_DOWN   8
+#define INPUT_FIRE  16
+
+/* input byte of a record (--record FILE): INPUT_... held down plus */
+#define REC_BUTTON  32            // joystick fire button pressed
+#define REC_QUIT    64            // Escape: back to the title screen
+#define REC_CHAR   128            // a character of the high score name follows
+#define REC_HEADER 124            // bytes before the first record
+
+/* snapshots of the game state: save_snapshot() / restore_snapshot() in a
+   buffer of SNAPSHOT_SIZE, the file is the same buffer (same build only) */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SIZE (sizeof(snapshot_type) + ASTEROID_SLOTS * sizeof(asteroid_type))
+#define SNAPSHOT_FILE "ufo.snapshot"
+
+/* input policy of the batch runner (--policy) */
+#define POLICY_BOT    0           // random moves, fires at near asteroids
+#define POLICY_SCRIPT 1           // fixed input_script[] repeated
+
+/* random number streams (xoshiro128**), each subsystem has its own stream so
+   e.g. drawing the title screen never changes where the next asteroid spawns */
+#define RNG_SPAWN     0           // asteroid and ufo spawning
+#define RNG_AI        1           // ufo decisions
+#define RNG_COLLISION 2           // outcome of colliding asteroids
+#define RNG_COSMETIC  3           // title screen wobble etc.
+#define RNG_INPUT     4           // bot player of the batch runner
+#define NUM_RNG_STREAMS 5
+
+/* phases of the frame profiler (--profile, F3), in order of the game loop.
+   Compile with -DNO_PROFILER to remove it completely, else a disabled
+   profiler costs one test per phase */
+#define PROF_FLIP        0          // SDL_Flip()
+#define PROF_INPUT       1          // events, keys and restart
+#define PROF_CLEAR       2          // blank the screen
+#define PROF_STARS       3
+#define PROF_SHIP        4          // ship, ship explosion and shield
+#define PROF_BULLETS     5
+#define PROF_LASERS      6
+#define PROF_ASTEROIDS   7          // move, spawn and draw
+#define PROF_UFO         8
+#define PROF_COLLISION   9          // collision world, checks and near asteroids
+#define PROF_RESOLVE    10          // apply the collision events
+#define PROF_EXPLOSIONS 11          // mini explosions
+#define PROF_SCORE      12          // score line (TTF)
+#define PROF_OVERLAY    13          // the profiler overlay itself
+#define PROF_DELAY      14          // waiting for the next frame
+#define NUM_PROF_PHASES 15
+#define PROF_FRAMES    256          // statistics over the last 256 frames
+#define NUM_PERF_COUNTERS 4         // hardware counters per phase (--perf, Linux)
+
+/* frame time histograms: microseconds in log-linear buckets, 16 buckets per
+   power of 2 (so at most 1/16 off, like an HDR histogram) up to 16.7 s */
+#define HIST_SUB_BITS  4
+#define HIST_MAX_BITS 24
+#define HIST_BUCKETS   ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+#define FRAME_DEADLINE 33000      // us, both loops wait for 33 ms per frame
+
+#define INJECT_DEVICE 255         // keyboard nr ("which") of injected key events
+#define INJECT_TIMES 1024         // push times of injected events (ring)
+#define MAX_PENDING_INPUTS 64     // input events of a frame waiting for its flip
+
+#define METRICS_EVERY  30         // frames between percentile updates (1 s)
+
+#define GOLDEN_FRAMES  300        // default length of a golden session (10 s)
+#define GOLDEN_RECORD  1
+#define GOLDEN_CHECK   2
+
+#define KERNEL_REPS    15         // timed runs per kernel (median is reported)
+#define FLUSH_BYTES (32 << 20)    // written to empty the caches (larger than LLC)
+
+#define TRACK_SITES   128         // call sites of the allocation tracker
+#define TRACK_SLOTS 16384         // live pointers (power of 2)
+#define TRACK_WARMUP   60         // frames before --alloc-check starts
+#define LOOP_TITLE     0
+#define LOOP_GAME      1
+
+/* trace events (--trace FILE): one ring buffer per thread, only written by
+   that thread, the oldest events are overwritten when it is full */
+#define TRACE_EVENTS 65536
+
+#ifndef NO_PROFILER
+#define PROF(phase) if (prof_on) prof_mark(phase)
+#define TRACE_BEGIN(t) Uint64 t = trace_on ? clock_ns() : 0
+#define TRACE_END(t, name, detail) if (trace_on) trace_event(name, detail, t, clock_ns())
+#else
+#define PROF(phase)
+#define TRACE_BEGIN(t)
+#define TRACE_END(t, name, detail)
+#endif
+
+/* blits and fills count the bytes they write (--bench-sweep), compile
+   with -DCOUNT_BLITS */
+#ifdef COUNT_BLITS
+#undef SDL_BlitSurface
+#define SDL_BlitSurface(s, sr, d, dr) count_blit(s, sr, d, dr)
+#define SDL_FillRect(d, r, c) count_fill(d, r, c)
+#endif
+
+/* startup benchmark (--bench-startup): time and counters per step of setup(),
+   with -DCOUNT_FILES the data files are opened through count_open() and
+   count_font() */
+#define STARTUP(step) if (startup_on) startup_mark(step)
+#ifdef COUNT_FILES
+#define SDL_RWFromFile(file, mode) count_open(file, mode)
+#define TTF_OpenFont(file, size) count_font(file, size)
+#endif
+#define STARTUP_STEPS 16
+
 /* globals used for difficulty levels */
-int difficulty = 1;               // 1=normal, 2=hard, 3=insane
-int MAX_UFOS = 1;                 // normal difficulty
-int MAX_LASERS = 1;               // normal difficulty, 1 ufo 1 laser
-int MAX_ASTEROIDS = 15;           // both normal and magnetic on screen
+THREAD_LOCAL int difficulty = 1;  // 1=normal, 2=hard, 3=insane
+THREAD_LOCAL int MAX_UFOS = 1;                 // normal difficulty
+THREAD_LOCAL int MAX_LASERS = 1;               // normal difficulty, 1 ufo 1 laser
+THREAD_LOCAL int MAX_ASTEROIDS = 15;           // both normal and magnetic on screen
                                   // normal difficulty
-int UFO_RANDOMNESS = 250;         // how often an ufo will spawn (lower is more frequent)
+THREAD_LOCAL int UFO_RANDOMNESS = 250;         // how often an ufo will spawn (lower is more frequent)
+THREAD_LOCAL int ASTEROID_RANDOMNESS = 20;     // how often an asteroid will spawn (1 out of 20 frames)
 
 
-/* typedef for shield (15 pixels) 
-   status: 0=off (black), 1=off and recharching (grey), 2=on (blue) 
-   timer:  ticks from off to on (recharching time) */
-typedef struct shield_bit_type {
-  int status, timer_bit, img_grey, img_blue, img_white, gun;
-} shield_bit_type;
-
-/* typedef for bullets/explosion bits (3 x 1 pixel) */
+/* typedef for bullets/explosion bits (3 x 1 pixel) 
+   x, y, xm, ym in fixed point Videopac pixels
+   px, py is position at start of frame (for swept collision) */
 typedef struct bullet_type {
-  int alive, timer, x, y; 
-  float xm, ym;
+  int alive, timer, x, y, xm, ym, px, py;
 } bullet_type;
 
 /* typedef voor astroids/explosions (6 x 5 pixel) */
@@ -104,12 +465,12 @@ typedef struct asteroid_type {
                          // 1 ... ASTEROID_SHAPE_TIMER/2 for first shape
                          // ASTEROID_SHAPE_TIMER/2 + 1 .. ASTEROID_SHAPE_TIMER for second
       magnetic_timer;    // for displaying alternate + en x in megnetic asteroid (0..5)
-  float x, y, xm, ym;    // coordinates x,y ; speed is included in xm,ym
+  int x, y, xm, ym;      // coordinates x,y ; speed is included in xm,ym (fixed point)
 } asteroid_type;
 
 /* typedef for mini explosion */
 typedef struct mini_explosion_type {
-  int alive, timer, x, y;
+  int alive, timer, x, y;   // x, y in fixed point
 } mini_explosion_type;
 
 /* typedef for animation ship explosions */
@@ -123,13 +484,158 @@ typedef struct ufo_type {
                          //        5=yellow, 6=grey/white, 7=red
       shape_timer,       // timer in frames for duration of explosion
       status;            // 0 = not active, 1 = active, 3 is exploding
-  float x, y, xm, ym;    // coordinates x,y ; speed is included in xm,ym
+  int x, y, xm, ym;      // coordinates x,y ; speed is included in xm,ym (fixed point)
 } ufo_type;
 
 /* typedef for laser for ufo (7w x 8h pixels) */
 typedef struct laser_type {
-  int alive, fired_by_ufo, x, y, xm, ym;        // fired_by_ufo : ufo id 
-} laser_type;
+  int alive, fired_by_ufo, x, y, xm, ym, px, py; // fired_by_ufo : ufo id 
+} laser_type;                                    // x, y, xm, ym, px, py in fixed point
+
+/* typedef for collision mask
+   x, y: top-left of mask relative to object position (pixels)
+   row: bit n is pixel n from the left, set = solid */
+typedef struct mask_type {
+  int x, y, w, h;
+  Uint64 row[MASK_ROWS];
+} mask_type;
+
+/* typedef for box in collision world (fixed point, right/bottom excluded) */
+typedef struct col_box_type {
+  int active, type, nr;      // nr: index in bullets, laser, asteroids or ufo
+  int x, y, xr, yb;
+} col_box_type;
+
+/* typedef for job: fn handles index range begin..end-1. Game state is per
+   thread, so data points to the state of the thread that started the job */
+typedef struct job_type {
+  void (*fn)(void * data, int begin, int end);
+  void * data;
+  int begin, end;
+} job_type;
+
+/* typedef for worker: own jobs are taken from the tail, other workers
+   steal from the head */
+typedef struct worker_type {
+  int nr;
+  SDL_Thread * thread;
+  SDL_mutex * lock;
+  job_type jobs[JOBS_PER_THREAD * MAX_THREADS];
+  int head, tail;
+} worker_type;
+
+/* typedef for trace event (time span), names are not copied */
+typedef struct trace_event_type {
+  const char * name;
+  const char * detail;             // file or sound name (or NULL)
+  Uint64 begin, end;               // clock_ns()
+} trace_event_type;
+
+typedef struct trace_buffer_type {
+  trace_event_type * events;       // TRACE_EVENTS
+  Uint32 count;                    // events written (ring position is count % TRACE_EVENTS)
+} trace_buffer_type;
+
+/* typedef for histogram of times in us (see HIST_ constants) */
+typedef struct histogram_type {
+  Uint32 counts[HIST_BUCKETS];
+  Uint32 n, min, max;
+  Uint64 sum;
+} histogram_type;
+
+/* typedef for the frame times of the title or game loop */
+typedef struct frame_stats_type {
+  histogram_type work;             // start of frame till the delay
+  histogram_type sleep;            // the delay
+  histogram_type period;           // start of frame till start of next frame
+  Uint32 misses;                   // frames with work >= FRAME_DEADLINE (no delay)
+  Uint32 streak, longest_streak;   // missed deadlines in a row
+  Uint64 start, work_end;          // clock_ns() of this frame (start 0: first frame)
+} frame_stats_type;
+
+/* typedef for the numbers of the metrics server (--metrics), times in us */
+typedef struct metrics_type {
+  Uint32 frames, misses;           // game frames, missed deadlines
+  Uint32 fps_x100;                 // frames per second over the last METRICS_EVERY
+  Uint32 work_p50, work_p99, work_p999, period_p50, period_p99, period_p999;
+  int asteroids, ufos, lasers, bullets, explosions;
+  int channels;                    // mixer channels playing
+  int score, high_score, difficulty;
+} metrics_type;
+
+/* typedef for a snapshot: everything the game plays with, followed by
+   num_asteroids asteroids */
+typedef struct snapshot_type {
+  char magic[4];                   // "UFOS"
+  Uint32 version;                  // SNAPSHOT_VERSION
+  Uint32 size;                     // sizeof(snapshot_type): same build
+  Uint32 num_asteroids;            // MAX_ASTEROIDS
+  int difficulty, max_ufos, max_lasers, ufo_randomness, asteroid_randomness;
+  int ship_x, ship_y, speed, gun_bit, ship_window_step, ship_explosion_nr;
+  int ship_dying, ship_destroyed, bullet_frame, recharge_active, recharge_sound_delay;
+  int high_score_broken, high_score_registration, high_score_character_pos;
+  int score, high_score, flash_high_score_timer;
+  int frame, ufo_start_delay, death_cause, bullets_alive;
+  int joy_left, joy_right, joy_up, joy_down, bot_keys, bot_timer;
+  char high_score_name[8];
+  Uint32 rng_state[NUM_RNG_STREAMS][4];
+  Uint16 shield_up, shield_charging;
+  Uint8 shield_timer[SHIELD_BITS];
+  bullet_type bullets[MAX_BULLETS];
+  mini_explosion_type mini_explosions[MAX_MINI_EXPLOSIONS];
+  ufo_type ufo[3];
+  laser_type laser[3];
+} snapshot_type;
+
+/* typedef for a step of the startup benchmark: time and counters */
+typedef struct startup_step_type {
+  const char * name;
+  Uint64 ns;
+  long files;                      // opened through SDL_RWFromFile() and TTF_OpenFont()
+  long rw_syscalls;                // read and write system calls (Linux), not all calls
+  long major_faults;               // page faults that read from disk
+  long blocks_in;                  // 512 byte blocks read from disk
+} startup_step_type;
+
+/* typedef for a kernel of the microbenchmark (--bench-kernels) */
+typedef struct kernel_type {
+  const char * name;
+  void (*run)();
+  int world;                       // 1: collision world is built before timing
+  int draw;                        // 1: draws, timed at every factor
+} kernel_type;
+
+/* typedef for allocation tracker: call site and live pointer */
+typedef struct alloc_site_type {
+  const char * what;               // function
+  int line;
+  Uint32 allocs, live, base_live;  // base_live: live at end of warm-up
+  Uint64 bytes, live_bytes;
+} alloc_site_type;
+
+typedef struct alloc_slot_type {
+  void * p;                        // NULL: free slot
+  int site;
+  Uint32 bytes;
+} alloc_slot_type;
+
+/* typedef for gameplay event (see EV_ constants) */
+typedef struct event_type {
+  int type, a, b, x, y;
+} event_type;
+
+/* typedef for candidate pair: a and b are object nrs, a of the first type
+   in the pair name (e.g. bullet for PAIR_BULLET_ASTEROID) */
+typedef struct col_pair_type {
+  int a, b;
+} col_pair_type;
+
+/* typedef for the parallel asteroid tests (state of the calling thread) */
+typedef struct asteroid_job_type {
+  asteroid_type * asteroids;
+  col_pair_type * pairs;           // asteroid pairs of the broadphase
+  char * pair_hit;                 // result per pair
+} asteroid_job_type;
 
 
 /* global variables, initialized in setup() */
@@ -143,39 +649,301 @@ int monitor_height;              // monitor height resolution (fixed)
 
 int use_joystick;
 int num_joysticks;
-int joy_left, joy_right, joy_up, joy_down;
-
-int ship_x ;                // ship x-coordinate
-int ship_y;                 // ship y-coordinate
-int speed;                  // ship ship in pixels per frame
-int gun_bit;                // starting gun_bit (range 0..14)
-int ship_window_step;       // animation step of ship's window 1..12
-int ship_explosion_nr;      // nr of active ship explosion sequence 0..8
-int ship_dying;             // ship is hit and dying  0=no, 1=yes
-int ship_destroyed;         // ship destroyed  0=no, 1=yes
-int bullet_frame;           // frame no at wich last bullet was fired
-int recharge_active;        // 0=not, 1= recharging
-int recharge_sound_delay;   // to delay sound of recharging (respawn shield)
-
-int high_score_broken;      // 0-not, 1 = true
-int high_score_registration; // 0: not possible, 1: active
-int high_score_character_pos;  // 0...6 active to enter
-int score, high_score;
-char high_score_name[7];    // max length is 6 charachters! 
-int flash_high_score_timer; // 0..150 frames reverse
-
-int frame;
-int ufo_start_delay;        // used to delay first ufo on screen
-
-shield_bit_type shield_bits[SHIELD_BITS];
-bullet_type bullets[MAX_BULLETS];
-
-mini_explosion_type mini_explosions[MAX_MINI_EXPLOSIONS];
+THREAD_LOCAL int joy_left, joy_right, joy_up, joy_down;
+
+THREAD_LOCAL int ship_x ;                // ship x-coordinate (fixed point)
+THREAD_LOCAL int ship_y;                 // ship y-coordinate (fixed point)
+THREAD_LOCAL int speed;                  // ship speed in fixed point pixels per frame
+THREAD_LOCAL int gun_bit;                // starting gun_bit (range 0..14)
+THREAD_LOCAL int ship_window_step;       // animation step of ship's window 1..12
+THREAD_LOCAL int ship_explosion_nr;      // nr of active ship explosion sequence 0..8
+THREAD_LOCAL int ship_dying;             // ship is hit and dying  0=no, 1=yes
+THREAD_LOCAL int ship_destroyed;         // ship destroyed  0=no, 1=yes
+THREAD_LOCAL int bullet_frame;           // frame no at wich last bullet was fired
+THREAD_LOCAL int recharge_active;        // 0=not, 1= recharging
+THREAD_LOCAL int recharge_sound_delay;   // to delay sound of recharging (respawn shield)
+
+THREAD_LOCAL int high_score_broken;      // 0-not, 1 = true
+THREAD_LOCAL int high_score_registration; // 0: not possible, 1: active
+THREAD_LOCAL int high_score_character_pos;  // 0...6 active to enter
+THREAD_LOCAL int score, high_score;
+THREAD_LOCAL char high_score_name[7];    // max length is 6 charachters! 
+THREAD_LOCAL int flash_high_score_timer; // 0..150 frames reverse
+
+THREAD_LOCAL int frame;
+THREAD_LOCAL int ufo_start_delay;     // used to delay first ufo on screen
+THREAD_LOCAL int death_cause;         // DEATH_... of the last ship (0 = alive)
+THREAD_LOCAL int headless;            // 1: no sound and messages (batch runner)
+THREAD_LOCAL int in_job;              // 1: thread is running a job of the pool
+THREAD_LOCAL int thread_nr;           // worker nr of this thread (0: main thread)
+Uint32 rng_seed;            // seed of this session (--seed or time based)
+THREAD_LOCAL Uint32 rng_state[NUM_RNG_STREAMS][4];   // state per random stream
+
+/* shield (15 pixels), bit i of the masks is shield bit i
+   off (black) is neither up nor recharching */
+THREAD_LOCAL Uint16 shield_up;                     // bits on (blue)
+THREAD_LOCAL Uint16 shield_charging;               // bits off and recharching (grey)
+THREAD_LOCAL Uint8 shield_timer[SHIELD_BITS];      // ticks from recharching to on
+THREAD_LOCAL int bullets_alive;                    // nr of bullets with alive == 1
+THREAD_LOCAL bullet_type bullets[MAX_BULLETS];
+
+THREAD_LOCAL mini_explosion_type mini_explosions[MAX_MINI_EXPLOSIONS];
 ship_explosion_type ship_explosions[SHIP_EXPLOSIONS];
 
-ufo_type ufo[3];             // MAX depending on difficulty selection
-laser_type laser[3];         // MAX depending on difficulty selection
-asteroid_type asteroids[35]; // MAX depending on difficulty selection
+THREAD_LOCAL ufo_type ufo[3];             // MAX depending on difficulty selection
+THREAD_LOCAL laser_type laser[3];         // MAX depending on difficulty selection
+THREAD_LOCAL asteroid_type asteroids[ASTEROID_SLOTS]; // MAX depending on difficulty selection
+
+/* bullet start point relative to ship (pixels) for each of the 15 gun bits */
+const int gun_start[SHIELD_BITS][2] = {
+  { 3, -4}, { 5, -3}, { 7, -2}, { 9, -1}, {10,  1}, { 9,  3}, { 7,  4}, { 5,  5},
+  { 2,  5}, {-1,  4}, {-3,  3}, {-4,  1}, {-3, -1}, {-1, -2}, { 1, -3}
+};
+
+/* bullet speed (fixed point pixels per frame) for each of the 15 gun bits;
+   integer constants so bullets move the same on every platform and compiler */
+const int gun_speed[SHIELD_BITS][2] = {
+  {      0, -266998},   //  1: 4.074 up
+  { 131072, -228130},   //  2
+  { 188796, -188796},   //  3
+  { 228183, -131072},   //  4
+  { 266998,       0},   //  5: 4.074 right
+  { 228183,  131072},   //  6
+  { 188796,  188796},   //  7
+  {      0,  266998},   //  8: 4.074 down
+  {      0,  266998},   //  9: 4.074 down
+  {-188796,  188796},   // 10
+  {-228183,  131072},   // 11
+  {-266998,       0},   // 12: 4.074 left
+  {-266998, -131072},   // 13
+  {-188796, -188796},   // 14
+  {-131072, -228183}    // 15
+};
+
+/* speed of the 3 explosion bits (slower and less far than normal bullet) */
+const int explosion_bit_speed[MAX_BULLETS][2] = {
+  {      0,  177999},   // 2.716 down
+  { 125864, -125864},   // up right
+  {-125864, -125864}    // up left
+};
+
+/* images used for the collision masks (factor 1 version), in MASK_ order */
+const int mask_images[MASK_BULLET] = {11, 12, 13, 5, 63, 70, 71};
+mask_type masks[NUM_MASKS];
+
+THREAD_LOCAL col_box_type col_boxes[MAX_COL_BOXES];
+THREAD_LOCAL int col_order[MAX_COL_BOXES];      // slots sorted on x (kept for next frame)
+THREAD_LOCAL int col_order_ready = 0;
+THREAD_LOCAL int col_targets;                   // active asteroids and ufos in world
+THREAD_LOCAL col_pair_type col_pairs[NUM_PAIR_TYPES][MAX_COL_PAIRS];
+THREAD_LOCAL int num_col_pairs[NUM_PAIR_TYPES];
+
+THREAD_LOCAL char col_pair_hit[MAX_COL_PAIRS];  // overlap of asteroid pair k (parallel test)
+THREAD_LOCAL col_pair_type near_pairs[MAX_COL_PAIRS];   // asteroid pairs less than 10 apart in x and y
+THREAD_LOCAL int num_near_pairs;
+THREAD_LOCAL char near_pair_hit[MAX_COL_PAIRS];         // pair k is too near (parallel test)
+THREAD_LOCAL col_pair_type near_order[2 * MAX_COL_PAIRS];   // too near, both ways, sorted on a, b
+THREAD_LOCAL col_pair_type near_sorting[2 * MAX_COL_PAIRS];
+THREAD_LOCAL int near_count[ASTEROID_SLOTS + 1];
+
+worker_type workers[MAX_THREADS];
+int num_threads = 1;               // workers incl. main thread (--threads)
+SDL_mutex * pool_lock;
+SDL_cond * pool_wake;              // new jobs (or quit) for the workers
+SDL_cond * pool_done;              // all jobs done
+int pool_jobs;                     // jobs not done yet
+int pool_generation;               // +1 for every run_parallel()
+int pool_quit;
+
+THREAD_LOCAL event_type events[MAX_EVENTS];     // ring buffer for events of this frame
+THREAD_LOCAL int event_head, event_tail;        // read and write position
+THREAD_LOCAL int defer_sounds;                  // 1: play_sound() only queues the sound
+THREAD_LOCAL int num_queued_sounds;
+THREAD_LOCAL int queued_sounds[NUM_SOUNDS + 8][2];   // snd, chan
+
+/* batch runner (--batch N): result per game */
+typedef struct batch_result_type {
+  Uint32 seed;
+  int score, frames, death_cause;
+} batch_result_type;
+
+int batch_games;                   // nr of games (0: normal game with window)
+int batch_policy = POLICY_BOT;
+int batch_difficulty = 1;
+int batch_max_frames = 30 * 60 * 10;   // max 10 minutes per game
+int batch_asteroids;               // 0: as difficulty
+int batch_ufo_randomness;          // 0: as difficulty
+int batch_asteroid_randomness;     // 0: default (20)
+const char * batch_csv;            // NULL: stdout
+batch_result_type * batch_results;
+const char * death_names[4] = {"none", "asteroid", "ufo", "laser"};   // DEATH_...
+
+THREAD_LOCAL int bot_keys;         // direction of the bot player
+THREAD_LOCAL int bot_timer;        // frames till next direction
+
+/* input recording (--record FILE) and replay (--replay FILE) */
+const char * record_file;
+FILE * rec_f;                      // open while a game is recorded
+int rec_games;                     // games recorded (FILE, FILE.2, ...)
+int rec_frame;                     // frame of the last record
+int rec_keys;                      // INPUT_... of the last record
+int rec_button;                    // fire button pressed in this frame
+char rec_chars[16];                // high score name typed in this frame
+int rec_num_chars;
+const char * replay_file;
+Uint8 * replay_data;               // the whole file
+long replay_size, replay_pos;
+int replay_next;                   // frame of the next record
+int replay_keys;
+int replay_fast;                   // 1: no delay between frames (--fast)
+Uint32 replay_frames;              // frames of the recorded game
+Uint64 replay_hash;                // hash_state() at the end of it
+
+/* performance fuzzer (--fuzz N): a seed and the keys of every frame, and
+   the time of every frame (the fastest of the runs) */
+#define FUZZ_KEEP      4           // slowest cases kept (and written)
+#define FUZZ_SPAN    120           // longest run of frames changed at once
+#define FUZZ_RUNS      3           // runs of a case before it is kept
+
+typedef struct fuzz_case_type {
+  Uint32 seed;
+  int frames;                      // frames played (till the ship is hit)
+  Uint8 * keys;                    // INPUT_... per frame (batch_max_frames)
+  Uint32 * ns;                     // time per frame
+  int worst_frame;
+  Uint32 worst_ns;
+} fuzz_case_type;
+
+int fuzz_rounds;                   // 0: no fuzzing
+const char * fuzz_out = "fuzz";    // cases are written to fuzz.1.case ...
+const char * fuzz_replay;          // case to play (--fuzz-replay FILE)
+fuzz_case_type fuzz_kept[FUZZ_KEEP];      // slowest first
+int fuzz_num_kept;
+fuzz_case_type fuzz_tries[MAX_THREADS];   // one new case per thread per round
+
+/* frame profiler: time (ns) of every phase for the last PROF_FRAMES frames */
+int prof_on;                       // 1: time the phases (--profile or F3)
+int prof_overlay;                  // 1: show min/avg/p99/max on screen (F3)
+FILE * prof_csv;                   // time per phase per frame (--profile-csv FILE)
+Uint64 prof_last;                  // time of the previous mark
+Uint32 prof_ns[NUM_PROF_PHASES];   // this frame
+Uint32 prof_hist[NUM_PROF_PHASES][PROF_FRAMES];
+int prof_frames;                   // frames in prof_hist (max PROF_FRAMES)
+int prof_pos;                      // next frame in prof_hist
+Uint64 prof_total[NUM_PROF_PHASES];   // all frames since the first prof_start()
+Uint32 prof_total_frames;
+int touch_on;                      // 1: count_blit() and count_fill() count
+Uint64 touched_bytes;              // written by blits and fills
+const char * prof_names[NUM_PROF_PHASES] = {
+  "FLIP", "INPUT", "CLEAR", "STARS", "SHIP", "BULLETS", "LASERS", "ASTEROIDS",
+  "UFO", "COLLISION", "RESOLVE", "EXPLOSION", "SCORE", "OVERLAY", "DELAY"
+};
+
+/* hardware counters (--perf): one group read at every profiler mark */
+int perf_on;                       // 1: counters are open
+int perf_group = -1;               // fd of the group leader (cycles)
+int perf_slot[NUM_PERF_COUNTERS];  // position in the group read, -1: not supported
+int perf_members;                  // counters in the group
+Uint64 perf_last[NUM_PERF_COUNTERS];
+Uint64 perf_sum[NUM_PROF_PHASES][NUM_PERF_COUNTERS];   // since the start
+Uint32 perf_frames;
+const char * perf_names[NUM_PERF_COUNTERS] = {"cycles", "instructions", "LLC misses", "branch misses"};
+
+/* tracer: timeline for chrome://tracing or Perfetto */
+int trace_on;                      // 1: record trace events (--trace FILE)
+const char * trace_file;
+Uint64 trace_start_ns;             // time 0 of the trace
+trace_buffer_type trace_buffers[MAX_THREADS];
+
+frame_stats_type frame_stats[2];   // LOOP_TITLE, LOOP_GAME
+
+/* benchmark (--bench=N) */
+int bench_frames;                  // 0: play the game
+int bench_kernels;                 // 1: microbenchmark of the kernels (--bench-kernels)
+int sweep_frames;                  // frames per factor (--bench-sweep N)
+
+/* startup benchmark (--bench-startup [--cold]) */
+int startup_on;
+int startup_cold;                  // 1: empty the page cache first
+const char * startup_cold_how = "none";
+Uint32 files_opened;
+int startup_num_steps;
+startup_step_type startup_steps[STARTUP_STEPS];
+startup_step_type startup_last;    // counters at the previous mark
+long startup_own_syscalls;         // made by reading the counters
+THREAD_LOCAL Uint64 events_lost;   // pushed while the event queue was full
+THREAD_LOCAL Uint64 events_reported;   // events_lost at the last warning
+Uint8 kernel_snapshot[SNAPSHOT_SIZE];   // saved and restored by the kernels
+int start_factor;                  // window factor (--factor), 0: by monitor size
+const char * bench_json;           // results file (--json), NULL: stdout
+FILE * results_out;                // stdout for the results, see results_to_stdout()
+
+/* golden frames (--golden-record FILE, --golden FILE) */
+int golden_mode;                   // GOLDEN_RECORD or GOLDEN_CHECK, 0: off
+int snapshot_test;                 // 1: test restore_snapshot() with bad snapshots
+const char * golden_file;
+int golden_frames = GOLDEN_FRAMES;
+
+/* input latency (--latency N): input event till the flip that shows its frame */
+int latency_on;
+int latency_target;                // stop after this many events (0: run till exit)
+histogram_type latency_hist;       // event till present (us)
+histogram_type latency_queue_hist; // injected events: push till dequeue (us)
+Uint64 latency_pending[MAX_PENDING_INPUTS];   // events used by the frame not shown yet
+int num_latency_pending;
+
+/* input injector (--inject-input): a thread pushes key events at random moments */
+int inject_on;
+SDL_Thread * inject_thread;
+volatile int inject_quit;
+Uint64 inject_times[INJECT_TIMES]; // clock_ns() of push, index in keysym.unicode
+int inject_keys;                   // INPUT_ keys held down by the injector
+
+/* metrics server (--metrics PATH|PORT): Prometheus text on a socket. The game
+   loop copies metrics_game into metrics with a sequence lock, the server
+   thread retries when metrics_seq changed (odd: copy in progress) */
+int metrics_on;
+const char * metrics_addr;
+int metrics_fd = -1;               // listening socket
+SDL_Thread * metrics_thread;
+volatile int metrics_quit;
+Uint64 metrics_start_ns;
+Uint64 metrics_last_ns;            // time of the last percentile update (or game start)
+Uint32 metrics_window;             // game frames since metrics_last_ns
+metrics_type metrics_game;         // only used by the game thread
+metrics_type metrics;
+volatile Uint32 metrics_seq;
+
+/* allocation tracker (-DTRACK_ALLOCS) */
+int alloc_check;                   // 1: exit(1) when a frame leaks (--alloc-check)
+alloc_site_type alloc_sites[TRACK_SITES];
+int num_alloc_sites;
+alloc_slot_type alloc_slots[TRACK_SLOTS];   // hash table on pointer
+SDL_mutex * alloc_lock;            // the batch and fuzz threads allocate too
+Uint32 alloc_frames;               // frames seen by track_frame()
+Uint32 alloc_live;                 // live allocations (all sites)
+Uint32 alloc_base_live;            // live after warm-up
+const char * loop_names[2] = {"title", "game"};
+
+/* keys and nr of frames for --policy script (repeated) */
+const int input_script[][2] = {
+  {INPUT_RIGHT | INPUT_FIRE, 30},
+  {INPUT_DOWN, 20},
+  {INPUT_LEFT | INPUT_FIRE, 30},
+  {INPUT_UP, 20},
+  {INPUT_FIRE, 15},
+  {0, 15}
+};
+
+/* kind of pair for 2 object types, -1: no collision between these */
+const int col_pair_types[5][5] = {
+  {-1, -1, -1, PAIR_BULLET_ASTEROID, PAIR_BULLET_UFO},                         // bullet
+  {-1, -1, PAIR_LASER_SHIP, PAIR_LASER_ASTEROID, -1},                          // laser
+  {-1, PAIR_LASER_SHIP, -1, PAIR_SHIP_ASTEROID, PAIR_SHIP_UFO},                // ship
+  {PAIR_BULLET_ASTEROID, PAIR_LASER_ASTEROID, PAIR_SHIP_ASTEROID,
+   PAIR_ASTEROID_ASTEROID, PAIR_ASTEROID_UFO},                                 // asteroid
+  {PAIR_BULLET_UFO, -1, PAIR_SHIP_UFO, PAIR_ASTEROID_UFO, -1}                  // ufo
+};
 
 int vol_effects, vol_music;
 Mix_Chunk * sounds[NUM_SOUNDS];
@@ -287,22 +1055,45 @@ void title_screen();
 void display_select_game(int x, int y);
 void display_instructions(int scroll_x, int scroll_y);
 int game(int mode);
+void init_game();
+void game_frame(int draw);
+void set_difficulty(int d);
 void setup(void);
 void setup_joystick();
 void start_new_game();
 void setup_ship_explosions();
 void load_images();
+void load_masks();
 int get_user_input();
+void handle_ship_input(int keys);
+void fire_button();
+void start_recording();
+void record_frame(int input);
+void stop_recording();
+void start_replay();
+int replay_input(int * keys);
+void end_replay();
+void put_uint32(FILE * f, Uint32 x);
+int save_snapshot(void * buffer, int size);
+int restore_snapshot(const void * buffer, int size);
+int save_snapshot_file(const char * file);
+int load_snapshot_file(const char * file);
+void test_snapshots();
+void kernel_save_snapshot();
+void kernel_restore_snapshot();
+Uint32 get_uint32(const Uint8 * p);
 void cleanup();
-void handle_screen_resize(int mode);
+void handle_screen_resize();
 void draw_stars();
 
 void draw_ship();
 void draw_shield_bits();
 void setup_shield_bits();
 void handle_shield_bits();
+void shield_off();
 
 void add_bullet(int xx, int yy);
+void add_explosion_bits(int x, int y);
 void handle_bullets();
 void draw_bullets();
 void rotate_gun_bit();
@@ -318,7 +1109,95 @@ void draw_asteroids();
 void check_ship_collision();
 void check_bullet_hit();
 void check_colliding_asteroids();
+void collide_asteroids(int i, int j);
+void push_event(int type, int a, int b, int x, int y);
+void resolve_events();
+void hit_asteroid(int i);
+void hit_ufo(int i, int by_ship);
+void laser_hits_ship(int j);
+void bump_asteroids(int i, int j);
+void ship_dies(int cause);
+void add_score(int points);
+void flush_sounds();
+void build_collision_world();
+void set_col_box(int slot, int active, int type, int nr, int x, int y, int xr, int yb);
+int sweep_box(int x0, int y0, int x1, int y1, int w, int h,
+              int bx, int by, int bw, int bh);
+int sweep_axis(int p, int d, int lo, int hi, int * t_in, int * t_out);
+int sweep_pos(int p0, int p1, int toi);
+int sweep_mask(int x0, int y0, int x1, int y1, int m1, int bx, int by, int m2, int toi);
+int mask_hit(int m1, int x1, int y1, int m2, int x2, int y2);
+int asteroid_mask(asteroid_type * a);
+int laser_mask(int i);
+void benchmark_collision();
+Uint64 clock_ns();
+void prof_mark(int phase);
+void prof_start();
+void prof_end_frame();
+void draw_profiler();
+void trace_start();
+void trace_event(const char * name, const char * detail, Uint64 begin, Uint64 end);
+void write_trace();
+void write_json_string(FILE * f, const char * s);
+void perf_open();
+void perf_read(Uint64 * values);
+void perf_mark(int phase);
+void print_perf_stats();
+void hist_add(histogram_type * h, Uint32 us);
+Uint32 hist_percentile(histogram_type * h, int permille);
+void frame_begin(int loop);
+void frame_work_done(int loop);
+void frame_end(int loop);
+void print_frame_stats();
+void results_to_stdout();
+void run_benchmark();
+void scripted_frame();
+void read_golden_header();
+void run_golden();
+Uint64 hash_bytes(Uint64 h, const void * p, int n);
+Uint64 hash_state();
+Uint64 hash_screen(Uint32 * rgb);
+void write_golden_diff(int n, Uint32 * old, Uint32 * rgb);
+void benchmark_kernels();
+void benchmark_sweep();
+void startup_begin();
+#ifdef __linux__
+void drop_files(const char * path);
+#endif
+void startup_mark(const char * step);
+void startup_counters(startup_step_type * c);
+void startup_report();
+double startup_before_main();
+SDL_RWops * count_open(const char * file, const char * mode);
+TTF_Font * count_font(const char * file, int size);
+int count_blit(SDL_Surface * s, SDL_Rect * sr, SDL_Surface * d, SDL_Rect * dr);
+int count_fill(SDL_Surface * d, SDL_Rect * r, Uint32 c);
+void kernel_population(int n);
+Uint64 time_kernel(const kernel_type * k, asteroid_type * saved, int n, int calls);
+int compare_uint64(const void * a, const void * b);
+void start_metrics();
+void stop_metrics();
+void update_metrics();
+int metrics_main(void * data);
+int write_metrics(char * buf, int size);
+void latency_event(SDL_Event * event);
+void latency_presented();
+void print_latency_stats();
+int inject_main(void * data);
+void push_injected_key(int type, SDLKey sym, int nr);
+int compare_uint32(const void * a, const void * b);
 void check_asteroid_positions();
+void find_near_pairs();
+void test_near_pairs(void * data, int begin, int end);
+void sort_near_pairs(col_pair_type * from, col_pair_type * to, int n, int on_a);
+void test_asteroid_pairs(void * data, int begin, int end);
+void start_threads(int n);
+void stop_threads();
+int worker_main(void * data);
+void run_parallel(void (*fn)(void * data, int begin, int end), void * data, int n, int grain);
+void work_jobs(int nr);
+int take_job(int nr, job_type * job);
+void benchmark_threads();
 void draw_mini_explosions();
 void add_mini_explosion(int x, int y);
 
@@ -330,9 +1209,36 @@ void draw_score_line();
 void flash_high_score_name();
 void print_high_score_char(int character);
 void draw_ship_explosions();
+void handle_ship_explosions();
+void handle_ship_window();
+void handle_asteroid_shapes();
+void handle_ufo_explosions();
+void handle_mini_explosions();
+void handle_high_score_flash();
+void stop_ufo_sound();
+
+void run_batch();
+void play_batch_games(void * data, int begin, int end);
+void play_batch_game(int g);
+void start_headless_game(Uint32 seed);
+void clear_objects();
+void run_fuzz();
+void fuzz_alloc(fuzz_case_type * c);
+void fuzz_mutate(fuzz_case_type * c, const fuzz_case_type * parent, Uint32 r);
+void play_fuzz_case(fuzz_case_type * c, int runs);
+void play_fuzz_tries(void * data, int begin, int end);
+void write_fuzz_case(const char * file, fuzz_case_type * c);
+void replay_fuzz_case();
+int bot_input();
+int script_input();
 int getStarColor(int);
 void play_sound(int snd, int chan);
 
+void seed_random(Uint32 seed);
+Uint32 next_random(int stream);
+int random_nr(int stream, int n);
+Uint32 hash_random(Uint32 x, Uint32 y);
+
 
 /* ------------ 
    -   MAIN   - 
@@ -340,18 +1246,241 @@ void play_sound(int snd, int chan);
 
 int main(int argc, char * argv[])
 {
-  int mode, quit;
+  int mode, quit, i, j, seed_set = 0;
+
+#ifdef TRACK_ALLOCS
+  alloc_lock = SDL_CreateMutex();
+#endif
+
+  /* same seed (and same input) gives the same game */
+  rng_seed = (Uint32) time(NULL);
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--seed=", 7) == 0) {
+      rng_seed = (Uint32) strtoul(argv[i] + 7, NULL, 0);
+      seed_set = 1;
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      rng_seed = (Uint32) strtoul(argv[++i], NULL, 0);
+      seed_set = 1;
+    } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      num_threads = atoi(argv[i] + 10);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batch_games = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "bot") == 0) {
+        batch_policy = POLICY_BOT;
+      } else if (strcmp(argv[i], "script") == 0) {
+        batch_policy = POLICY_SCRIPT;
+      } else {
+        fprintf(stderr, "Unknown policy: %s (bot or script)\n", argv[i]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--difficulty") == 0 && i + 1 < argc) {
+      batch_difficulty = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--asteroids") == 0 && i + 1 < argc) {
+      batch_asteroids = atoi(argv[++i]);
+      if (batch_asteroids > ASTEROID_SLOTS) batch_asteroids = ASTEROID_SLOTS;
+    } else if (strcmp(argv[i], "--ufo-randomness") == 0 && i + 1 < argc) {
+      batch_ufo_randomness = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--asteroid-randomness") == 0 && i + 1 < argc) {
+      batch_asteroid_randomness = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--max-frames") == 0 && i + 1 < argc) {
+      batch_max_frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_file = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_file = argv[++i];
+    } else if (strcmp(argv[i], "--fast") == 0) {
+      replay_fast = 1;
+    } else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc) {
+      fuzz_rounds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--fuzz-out") == 0 && i + 1 < argc) {
+      fuzz_out = argv[++i];
+    } else if (strcmp(argv[i], "--fuzz-replay") == 0 && i + 1 < argc) {
+      fuzz_replay = argv[++i];
+    } else if (strcmp(argv[i], "--test-snapshots") == 0) {
+      snapshot_test = 1;
+    } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+      batch_csv = argv[++i];
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      prof_on = 1;
+    } else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+      prof_on = 1;
+      prof_csv = fopen(argv[++i], "w");
+      if (prof_csv == NULL) {
+        fprintf(stderr, "Cannot create %s: %s\n", argv[i], strerror(errno));
+        exit(1);
+      }
+      fprintf(prof_csv, "frame");
+      for (j = 0; j < NUM_PROF_PHASES; j++)
+        fprintf(prof_csv, ",%s", prof_names[j]);
+      fprintf(prof_csv, ",TOTAL\n");
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_file = argv[++i];
+      prof_on = 1;           // the phases come from the profiler marks
+    } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+      latency_on = 1;
+      latency_target = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--inject-input") == 0) {
+      inject_on = 1;
+    } else if (strncmp(argv[i], "--bench=", 8) == 0) {
+#ifndef NO_PROFILER
+      bench_frames = atoi(argv[i] + 8);
+#else
+      fprintf(stderr, "--bench needs a build without -DNO_PROFILER\n");
+      exit(1);
+#endif
+    } else if (strcmp(argv[i], "--factor") == 0 && i + 1 < argc) {
+      start_factor = atoi(argv[++i]);
+      if (start_factor < 1 || start_factor > 9) {
+        fprintf(stderr, "Factor must be 1..9\n");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      bench_json = argv[++i];
+    } else if (strcmp(argv[i], "--null") == 0) {
+      putenv("SDL_VIDEODRIVER=dummy");     // no window
+      putenv("SDL_AUDIODRIVER=dummy");     // no sound device
+    } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+      metrics_addr = argv[++i];
+    } else if (strcmp(argv[i], "--perf") == 0) {
+      perf_open();
+      prof_on = 1;           // read at the profiler marks
+    } else if (strcmp(argv[i], "--alloc-check") == 0) {
+#ifdef TRACK_ALLOCS
+      alloc_check = 1;
+#else
+      fprintf(stderr, "--alloc-check needs a build with -DTRACK_ALLOCS\n");
+      exit(1);
+#endif
+    } else if (strcmp(argv[i], "--bench-collision") == 0) {
+      benchmark_collision();
+      exit(0);
+    } else if (strcmp(argv[i], "--bench-kernels") == 0) {
+      bench_kernels = 1;
+      putenv("SDL_VIDEODRIVER=dummy");     // runs on a headless box
+      putenv("SDL_AUDIODRIVER=dummy");
+    } else if (strcmp(argv[i], "--bench-sweep") == 0 && i + 1 < argc) {
+#ifndef NO_PROFILER
+      sweep_frames = atoi(argv[++i]);
+#else
+      fprintf(stderr, "--bench-sweep needs a build without -DNO_PROFILER\n");
+      exit(1);
+#endif
+    } else if (strcmp(argv[i], "--bench-startup") == 0) {
+      startup_on = 1;
+    } else if (strcmp(argv[i], "--cold") == 0) {
+      startup_cold = 1;
+    } else if (strcmp(argv[i], "--golden-record") == 0 && i + 1 < argc) {
+      golden_mode = GOLDEN_RECORD;
+      golden_file = argv[++i];
+    } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+      golden_mode = GOLDEN_CHECK;
+      golden_file = argv[++i];
+    } else if (strcmp(argv[i], "--golden-frames") == 0 && i + 1 < argc) {
+      golden_frames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--bench-threads") == 0) {
+      benchmark_threads();
+      exit(0);
+    } else {
+      fprintf(stderr, "Usage: %s [--seed N] [--threads N] [--factor N] [--null]\n"
+                      "          [--record FILE] [--replay FILE [--fast]]\n"
+                      "          [--bench=N [--difficulty 1-3] [--json FILE]]\n"
+                      "          [--profile] [--profile-csv FILE] [--trace FILE]\n"
+                      "          [--latency N] [--inject-input] [--metrics PATH|PORT] [--perf] [--alloc-check]\n"
+                      "          [--bench-collision] [--bench-threads] [--bench-kernels] [--bench-sweep N]\n"
+                      "          [--bench-startup [--cold] [--json FILE]]\n"
+                      "          [--golden-record FILE [--golden-frames N]] [--golden FILE]\n"
+                      "          [--batch N [--policy bot|script] [--difficulty 1-3] [--asteroids N]\n"
+                      "           [--ufo-randomness N] [--asteroid-randomness N] [--max-frames N] [--csv FILE]]\n"
+                      "          [--fuzz N [--fuzz-out PREFIX]] [--fuzz-replay FILE] [--test-snapshots]\n",
+                      argv[0]);
+      exit(1);
+    }
+  }
+  if ((bench_frames > 0 || sweep_frames > 0 || fuzz_rounds > 0) && seed_set == 0)
+     rng_seed = 1;                      // benchmarks are always the same
+  if (golden_mode == GOLDEN_RECORD && seed_set == 0) rng_seed = 1;
+  if (golden_mode == GOLDEN_CHECK) read_golden_header();   // seed, difficulty, factor
+  if (startup_on) startup_begin();      // time 0, after emptying the cache
+  if (golden_mode != 0) {
+     putenv("SDL_VIDEODRIVER=dummy");
+     putenv("SDL_AUDIODRIVER=dummy");
+  }
+  if ((batch_games > 0 && batch_csv == NULL) ||
+      ((bench_frames > 0 || startup_on) && bench_json == NULL))
+     results_to_stdout();
   printf("Start\n");
+  seed_random(rng_seed);
+  printf("Seed: %u\n", rng_seed);
+  start_threads(num_threads);
+#ifndef NO_PROFILER
+  if (trace_file != NULL) {
+     trace_start();
+     atexit(write_trace);    // after cleanup(): the workers are stopped then
+  }
+#endif
+
+  if (batch_games > 0) {
+    prof_on = 0;           // the games run on all threads
+    run_batch();
+    stop_threads();
+    exit(0);
+  }
+  if (snapshot_test == 1) test_snapshots();     // exits
+  if (fuzz_rounds > 0 || fuzz_replay != NULL) {
+    prof_on = 0;
+    if (fuzz_replay != NULL) {
+       replay_fuzz_case();
+    } else {
+       run_fuzz();
+    }
+    stop_threads();
+    exit(0);
+  }
 
   /* Stop any music: */
   Mix_HaltMusic();       
 
   setup();
   setup_ship_explosions();
+  STARTUP("explosions");
+  if (startup_on) {
+     startup_report();
+     exit(0);
+  }
 
   /* Call the cleanup function when the program exits */
   atexit(cleanup);
 
+  if (metrics_addr != NULL) start_metrics();
+
+  if (bench_frames > 0) {
+     run_benchmark();
+     exit(0);
+  }
+  if (bench_kernels == 1) {
+     benchmark_kernels();
+     exit(0);
+  }
+  if (sweep_frames > 0) {
+     benchmark_sweep();
+     exit(0);
+  }
+  if (golden_mode != 0) run_golden();     // exits
+
+  if (replay_file != NULL) game(0);      // exits at the end of the replay
+
+  if (inject_on) {
+     inject_thread = SDL_CreateThread(inject_main, NULL);
+     if (inject_thread == NULL) {
+        fprintf(stderr, "Couldn't create thread: %s\n", SDL_GetError());
+        exit(1);
+     }
+  }
+
 
   /* Main loop */
   do
@@ -371,17 +1500,17 @@ int game(int mode)
   int done, quit;
   Uint32 last_time;
    
-  frame = 0;
-  bullet_frame = 0;
   done = 0;
   quit = 0;
-  ship_dying = 0;
-  ship_destroyed = 0;
-  high_score_broken = 0;
-  high_score_registration = 0;
-
-  start_new_game();
-  recharge_sound_delay = 0;  // initially off; no recharge delay
+  if (record_file != NULL) start_recording();
+  if (replay_file != NULL) start_replay();
+  init_game();
+  frame_stats[LOOP_GAME].start = 0;   // no period from the title screen
+  metrics_last_ns = clock_ns();        // no frame rate from the title screen
+  metrics_window = 0;
+#ifndef NO_PROFILER
+  if (prof_on) prof_start();   // not the time in the title screen
+#endif
 
   /* ------------------
      - Main game loop -
@@ -389,9 +1518,12 @@ int game(int mode)
   do
   {
       last_time = SDL_GetTicks();
+      frame_begin(LOOP_GAME);
       frame++;
 
       SDL_Flip(screen);
+      if (latency_on) latency_presented();   // the input of the previous frame is visible now
+      PROF(PROF_FLIP);
 
       /* restart_game after death */
       if (ship_destroyed == 1 && flash_high_score_timer == 0) {
@@ -404,2496 +1536,5908 @@ int game(int mode)
       }  
 
       done = get_user_input();   
+      PROF(PROF_INPUT);
       SDL_FillRect(screen, NULL, 0);  /* Blank the screen */
+      PROF(PROF_CLEAR);
     
-      draw_stars();
-      if (ship_dying == 0) draw_ship();
-      if (ship_dying == 1 && ship_destroyed == 0) draw_ship_explosions();
-      if (ship_dying == 0) handle_shield_bits();
-      if (ship_dying == 0) draw_shield_bits();
-      handle_bullets();
-      draw_bullets();
-      handle_lasers();
-      draw_lasers();
-      handle_asteroids();
-      if (rand() % 20 == 1 ) add_asteroid(); 
-      draw_asteroids();
-
-      handle_ufo();
-      draw_ufo();
-
-      if (ship_dying == 0) check_bullet_hit();    
-      if (ship_dying == 0) check_ship_collision();
-      if (ship_dying ==0 ) check_laser_hit();
-      draw_mini_explosions();
-      if (ship_dying == 0) check_colliding_asteroids();
-      check_asteroid_positions();
-      draw_score_line(); 
+      game_frame(1);
+
+#ifndef NO_PROFILER
+      if (prof_overlay) draw_profiler();
+      PROF(PROF_OVERLAY);
+#endif
 
       /* Pause till next frame: */
-      //printf("Delay: %d - \n", last_time + 33 - SDL_GetTicks());
-      if (SDL_GetTicks() < last_time + 33)
+      frame_work_done(LOOP_GAME);
+      if (SDL_GetTicks() < last_time + 33 && replay_fast == 0)
           SDL_Delay(last_time + 33 - SDL_GetTicks());
+      frame_end(LOOP_GAME);
+      if (metrics_on) update_metrics();
+      TRACK_FRAME();
+#ifndef NO_PROFILER
+      PROF(PROF_DELAY);
+      if (prof_on) prof_end_frame();
+#endif
     }
   while (!done && !quit);
-  
+
+  if (rec_f != NULL) stop_recording();
+  if (replay_file != NULL) end_replay();     // exits
   return(0);
 }
 
 
-void setup(void)
+void results_to_stdout()
 {
-  int i;
-  char title_string[100];
-
-  /* Init SDL Video: */
-  if (SDL_Init(SDL_INIT_VIDEO) < 0)
-    {
-      fprintf(stderr,
-              "\nError: I could not initialize video!\n"
-              "The Simple DirectMedia error that occured was:\n"
-              "%s\n\n", SDL_GetError());
-      exit(1);
-    }
-
-  /* enable console output in Windows */
-  #ifdef _WIN32
-  freopen("CON", "w", stdout); // redirects stdout
-  freopen("CON", "w", stderr); // redirects stderr
-  #endif
+  /* the results (JSON or CSV) go to stdout: from now on printf() writes
+     to stderr, so stdout only holds the results */
+  results_out = stdout;
+#ifndef _WIN32
+  fflush(stdout);
+  results_out = fdopen(dup(1), "w");
+  if (results_out == NULL || dup2(2, 1) == -1) {
+     fprintf(stderr, "Cannot redirect stdout: %s\n", strerror(errno));
+     exit(1);
+  }
+#endif
+}
 
 
-  /* get monitor resolution */
-  d_monitor = SDL_GetVideoInfo();
-  monitor_width  = d_monitor->current_w;
-  monitor_height = d_monitor->current_h;
-  printf("Max monitor resolution w, h: %d, %d \n", monitor_width, monitor_height);
-   
-  /* define factor */
-  if (monitor_height >= 1080) factor = 5;   // 1080p and higer
-  if (monitor_height <= 768)  factor = 3;   // 768p and lower
-  printf("Factor is: %d \n", factor);
-  screen_width  = VIDEOPAC_RES_W * factor;
-  screen_height = VIDEOPAC_RES_H * factor;
+void run_benchmark()
+{
+  /* the game loop without delays and with input_script[] as player */
+  FILE * f = results_out;
+  Uint64 start, ns;
+  long peak_rss = -1;
+  int n, p;
+#ifndef _WIN32
+  struct rusage usage;
+#endif
 
-  /* Open display: */
-      screen = SDL_SetVideoMode(screen_width, screen_height, 0, SDL_HWPALETTE | SDL_ANYFORMAT);
-      if (screen == NULL)
-        {
-          fprintf(stderr,
-                  "\nWarning: I could not set up video for "
-                  "1000x800 mode.\n"
-                  "The Simple DirectMedia error that occured was:\n"
-                  "%s\n\n", SDL_GetError());
-        } 
+  set_difficulty(batch_difficulty);
+  seed_random(rng_seed);
+  init_game();
+  prof_start();
+  start = clock_ns();
 
+  for (n = 0; n < bench_frames; n++) {
+     scripted_frame();
+     prof_end_frame();
+  }
+  ns = clock_ns() - start;
 
-   /* Init True Type Font */
-   if (TTF_Init() < 0) 
-   { 
-      fprintf(stderr, "Impossible to initialize SDL_TTF: %s\n",SDL_GetError() );
-      exit(1);
-   }
-   font_size = 12 * factor;
-   font_large = TTF_OpenFont("O2.ttf", font_size);
-   if (!font_large)
-      fprintf(stderr, "Cannot load font name O2.ttf large: %s\n", SDL_GetError());
+#ifndef _WIN32
+  getrusage(RUSAGE_SELF, &usage);
+  peak_rss = usage.ru_maxrss;
+#ifdef __APPLE__
+  peak_rss = peak_rss / 1024;              // bytes on macOS
+#endif
+#endif
 
-   font_small = TTF_OpenFont("O2.ttf", font_size/2);
-   if (!font_small)
-      fprintf(stderr, "Cannot load font name O2.ttf small: %s\n", SDL_GetError());
+  if (bench_json != NULL) {
+     f = fopen(bench_json, "w");
+     if (f == NULL) {
+        fprintf(stderr, "Cannot create %s: %s\n", bench_json, strerror(errno));
+        exit(1);
+     }
+  }
+  fprintf(f, "{\"frames\": %d, \"seed\": %u, \"difficulty\": %d, \"factor\": %d, \"threads\": %d,\n",
+          bench_frames, rng_seed, difficulty, factor, num_threads);
+  fprintf(f, " \"score\": %d, \"seconds\": %.3f, \"fps\": %.1f, \"peak_rss_kb\": %ld,\n",
+          score, ns / 1e9, bench_frames / (ns / 1e9), peak_rss);
+  fprintf(f, " \"phase_mean_us\": {");
+  for (p = 0; p < NUM_PROF_PHASES; p++) {
+     if (p == PROF_OVERLAY || p == PROF_DELAY) continue;   // not in the benchmark
+     fprintf(f, "%s\"%s\": %.1f", p > 0 ? ", " : "", prof_names[p],
+             prof_total[p] / 1000.0 / prof_total_frames);
+  }
+  fprintf(f, "}}\n");
+  if (f != results_out) fclose(f);
+  else fflush(f);
+}
 
-   high_score = 0; 
-   strcpy(high_score_name, "??????");
 
+void scripted_frame()
+{
+  /* one frame of the game loop without delay, input_script[] is the player */
+  SDL_Event event;
 
-  setup_joystick();
+  frame++;
+  SDL_Flip(screen);
+  PROF(PROF_FLIP);
+  if (ship_destroyed == 1 && flash_high_score_timer == 0) start_new_game();
+  while (SDL_PollEvent(&event))
+     if (event.type == SDL_QUIT) exit(0);
+  handle_ship_input(script_input());
+  PROF(PROF_INPUT);
+  SDL_FillRect(screen, NULL, 0);
+  PROF(PROF_CLEAR);
+  game_frame(1);
+}
 
-  /* Set window manager stuff: */
-  sprintf(title_string, "UFO - factor: %d - difficulty: %d", factor, difficulty);
-  SDL_WM_SetCaption(title_string, "UFO");
 
-  load_images();
+void read_golden_header()
+{
+  /* the session of the golden file is played again: same seed, difficulty
+     and factor */
+  FILE * f;
+
+  f = fopen(golden_file, "r");
+  if (f == NULL) {
+     fprintf(stderr, "Cannot open %s: %s\n", golden_file, strerror(errno));
+     exit(1);
+  }
+  if (fscanf(f, "ufo-golden seed %u difficulty %d factor %d frames %d",
+             &rng_seed, &batch_difficulty, &start_factor, &golden_frames) != 4) {
+     fprintf(stderr, "%s is not a golden file (--golden-record)\n", golden_file);
+     exit(1);
+  }
+  fclose(f);
+}
 
 
-  /* Open sound */
+void run_golden()
+{
+  /* record or compare the state and screen hashes of a scripted session */
+  char pixel_file[1024], line[128];
+  FILE * f, * pix;
+  Uint32 * rgb, * old;
+  Uint64 state, pixels, golden_state, golden_pixels;
+  int n, k, size, runs, state_differs = -1, screen_differs = -1, screens = 0;
+  Uint32 run[2];
+
+  set_difficulty(batch_difficulty);
+  seed_random(rng_seed);
+  init_game();
+  if (start_factor > 0 && factor != start_factor) {
+     fprintf(stderr, "Golden frames need factor %d, the monitor allows %d\n", start_factor, factor);
+     exit(1);
+  }
 
-  if (Mix_OpenAudio(22050, AUDIO_S16, 1, 1024) < 0) {
-         fprintf(stderr,
-          "\nWarning: I could not set up audio for 22050 Hz "
-          "16-bit stereo.\n"
-          "The Simple DirectMedia error that occured was:\n"
-          "%s\n\n", SDL_GetError());
-          exit(1);
+  size = screen_width * screen_height;
+  rgb = malloc(size * sizeof(Uint32));
+  old = malloc(size * sizeof(Uint32));
+  if (rgb == NULL || old == NULL) {
+     fprintf(stderr, "Out of memory\n");
+     exit(1);
+  }
+  snprintf(pixel_file, sizeof(pixel_file), "%s.frames", golden_file);
+  f = fopen(golden_file, golden_mode == GOLDEN_RECORD ? "w" : "r");
+  pix = fopen(pixel_file, golden_mode == GOLDEN_RECORD ? "wb" : "rb");
+  if (f == NULL || pix == NULL) {
+     fprintf(stderr, "Cannot open %s: %s\n", f == NULL ? golden_file : pixel_file, strerror(errno));
+     exit(1);
+  }
+  if (golden_mode == GOLDEN_RECORD) {
+     fprintf(f, "ufo-golden seed %u difficulty %d factor %d frames %d\n",
+             rng_seed, difficulty, factor, golden_frames);
+  } else {
+     if (fgets(line, sizeof(line), f) == NULL) exit(1);      // header, read before
   }
-        
-  vol_effects = 5;
-  vol_music = 5;
-  
-  Mix_Volume(-1, vol_effects * (MIX_MAX_VOLUME / 5));
-  Mix_VolumeMusic(vol_music * (MIX_MAX_VOLUME / 5));
 
-  Mix_AllocateChannels(32);
+  for (n = 0; n < golden_frames; n++) {
+     scripted_frame();
+     state = hash_state();
+     pixels = hash_screen(rgb);
+
+     if (golden_mode == GOLDEN_RECORD) {
+        fprintf(f, "%d %016llx %016llx\n", n, (unsigned long long) state, (unsigned long long) pixels);
+        /* screen as runs of the same colour (mostly black) */
+        runs = 0;
+        for (k = 0; k < size; k++)
+           if (k == 0 || rgb[k] != rgb[k - 1]) runs++;
+        fwrite(&runs, sizeof(runs), 1, pix);
+        for (k = 0; k < size; k = k + run[0]) {
+           run[1] = rgb[k];
+           for (run[0] = 1; k + (int) run[0] < size && rgb[k + run[0]] == run[1]; run[0]++);
+           fwrite(run, sizeof(run), 1, pix);
+        }
+        continue;
+     }
 
- /* Load sounds */
-      
- for (i = 0; i < NUM_SOUNDS; i++) {
-    sounds[i] = Mix_LoadWAV(sound_names[i]);
-    if (sounds[i] == NULL)
-      {
-        fprintf(stderr,
-          "\nError: I could not load the sound file:\n"
-          "%s\n"
-          "The Simple DirectMedia error that occured was:\n"
-          "%s\n\n", sound_names[i], SDL_GetError());
+     if (fscanf(f, "%*d %llx %llx", (unsigned long long *) &golden_state,
+                (unsigned long long *) &golden_pixels) != 2 ||
+         fread(&runs, sizeof(runs), 1, pix) != 1) {
+        fprintf(stderr, "%s ends at frame %d\n", golden_file, n);
         exit(1);
-      }
-    }  
-}   
+     }
+     for (k = 0; runs > 0; runs--) {
+        if (fread(run, sizeof(run), 1, pix) != 1 || k + run[0] > (Uint32) size) {
+           fprintf(stderr, "%s is damaged at frame %d\n", pixel_file, n);
+           exit(1);
+        }
+        while (run[0]-- > 0) old[k++] = run[1];
+     }
 
+     if (state != golden_state && state_differs < 0) state_differs = n;
+     if (pixels != golden_pixels) {
+        if (screen_differs < 0) {
+           screen_differs = n;
+           write_golden_diff(n, old, rgb);
+        }
+        screens++;
+     }
+  }
+  fclose(f);
+  fclose(pix);
+  free(rgb);
+  free(old);
+
+  if (golden_mode == GOLDEN_RECORD) {
+     printf("Golden: %d frames (seed %u, difficulty %d, factor %d) written to %s and %s\n",
+            golden_frames, rng_seed, difficulty, factor, golden_file, pixel_file);
+     exit(0);
+  }
+  if (state_differs < 0 && screen_differs < 0) {
+     printf("Golden: %d frames, state and screen the same\n", golden_frames);
+     exit(0);
+  }
+  if (state_differs >= 0) {
+     printf("Golden: state differs from frame %d (the game plays differently)\n", state_differs);
+  } else {
+     printf("Golden: state the same in all %d frames\n", golden_frames);
+  }
+  if (screen_differs >= 0) {
+     printf("Golden: screen differs in %d frames, first frame %d (%s.%d.bmp, %s.%d.diff.bmp)%s\n",
+            screens, screen_differs, golden_file, screen_differs, golden_file, screen_differs,
+            state_differs < 0 || state_differs > screen_differs ? ": drawing changed" : "");
+  }
+  exit(1);
+}
 
-void setup_joystick()
+
+Uint64 hash_bytes(Uint64 h, const void * p, int n)
 {
-  use_joystick = 1;
-  num_joysticks = 0;
+  /* FNV-1a, start with h = 14695981039346656037 */
+  const Uint8 * b = p;
 
-  if (SDL_Init(SDL_INIT_JOYSTICK) < 0) {
-      fprintf(stderr,
-        "\nWarning: I could not initialize joystick.\n"
-        "The Simple DirectMedia error that occured was:\n"
-        "%s\n\n", SDL_GetError());
-      
-      use_joystick = 0;
+  while (n-- > 0) {
+     h ^= *b++;
+     h *= 1099511628211ULL;
   }
-  else
-    {
-      /* Look for joysticks */
-      
-      num_joysticks = SDL_NumJoysticks();
-      if (num_joysticks <= 0) {
-         fprintf(stderr, "\nWarning: No joysticks available.\n");
-      use_joystick = 0;
+  return h;
+}
+
+
+Uint64 hash_state()
+{
+  /* everything the game plays with, nothing that is only drawn from it */
+  int v[] = {frame, ship_x, ship_y, speed, gun_bit, ship_window_step, ship_explosion_nr,
+             ship_dying, ship_destroyed, bullet_frame, recharge_active, recharge_sound_delay,
+             high_score_broken, high_score_registration, high_score_character_pos,
+             score, high_score, flash_high_score_timer, ufo_start_delay, death_cause,
+             shield_up, shield_charging, bullets_alive, MAX_ASTEROIDS};
+  Uint64 h = 14695981039346656037ULL;
+
+  h = hash_bytes(h, v, sizeof(v));
+  h = hash_bytes(h, rng_state, sizeof(rng_state));
+  h = hash_bytes(h, shield_timer, sizeof(shield_timer));
+  h = hash_bytes(h, bullets, sizeof(bullets));
+  h = hash_bytes(h, mini_explosions, sizeof(mini_explosions));
+  h = hash_bytes(h, ufo, sizeof(ufo));
+  h = hash_bytes(h, laser, sizeof(laser));
+  h = hash_bytes(h, asteroids, MAX_ASTEROIDS * sizeof(asteroid_type));
+  h = hash_bytes(h, high_score_name, sizeof(high_score_name));
+  return h;
+}
+
+
+Uint64 hash_screen(Uint32 * rgb)
+{
+  /* screen to 0xRRGGBB in rgb[] and its hash (the same for every depth
+     that shows the colours exactly) */
+  Uint8 * p, r, g, b;
+  Uint32 pixel;
+  int x, y, bpp;
+
+  if (SDL_MUSTLOCK(screen)) SDL_LockSurface(screen);
+  bpp = screen->format->BytesPerPixel;
+  for (y = 0; y < screen->h; y++) {
+    for (x = 0; x < screen->w; x++) {
+      p = (Uint8 *) screen->pixels + y * screen->pitch + x * bpp;
+      switch (bpp) {
+        case 1:  pixel = *p; break;
+        case 2:  pixel = *(Uint16 *) p; break;
+        case 3:  pixel = p[0] | (p[1] << 8) | (p[2] << 16); break;
+        default: pixel = *(Uint32 *) p; break;
       }
-      else
-  {
-    /* Open joystick */
-    
-    js = SDL_JoystickOpen(0);
-    if (js == NULL) {
-        fprintf(stderr,
-          "\nWarning: Could not open joystick 1.\n"
-          "The Simple DirectMedia error that occured was:\n"
-          "%s\n\n", SDL_GetError());
-         use_joystick = 0;
-      }
-    else
-      {
-        /* Check for proper stick configuration: */
-        
-        if (SDL_JoystickNumAxes(js) < 2) {
-      fprintf(stderr, "\nWarning: Joystick doesn't have enough axes!\n");
-      use_joystick = 0;
-    }
-        else
-    {
-      if (SDL_JoystickNumButtons(js) < 2) {
-          fprintf(stderr,
-            "\nWarning: Joystick doesn't have enough "
-            "buttons!\n");
-          use_joystick = 0;
-        }
+      SDL_GetRGB(pixel, screen->format, &r, &g, &b);
+      rgb[y * screen->w + x] = (r << 16) | (g << 8) | b;
     }
-    }
-  }
   }
+  if (SDL_MUSTLOCK(screen)) SDL_UnlockSurface(screen);
 
+  return hash_bytes(14695981039346656037ULL, rgb, screen->w * screen->h * sizeof(Uint32));
 }
 
 
-void start_new_game() 
+void write_golden_diff(int n, Uint32 * old, Uint32 * rgb)
 {
-  int i;
+  /* FILE.n.bmp: the new screen, FILE.n.diff.bmp: the same pixels dark,
+     the pixels that differ from the golden screen in magenta */
+  SDL_Surface * image, * diff;
+  char name[1024];
+  int k, size = screen_width * screen_height;
+
+  image = SDL_CreateRGBSurface(SDL_SWSURFACE, screen_width, screen_height, 32,
+                               0xFF0000, 0x00FF00, 0x0000FF, 0);
+  diff = SDL_CreateRGBSurface(SDL_SWSURFACE, screen_width, screen_height, 32,
+                              0xFF0000, 0x00FF00, 0x0000FF, 0);
+  if (image == NULL || diff == NULL) {
+     fprintf(stderr, "Couldn't create surface: %s\n", SDL_GetError());
+     exit(1);
+  }
+  for (k = 0; k < size; k++) {
+     ((Uint32 *) ((Uint8 *) image->pixels + (k / screen_width) * image->pitch))[k % screen_width] = rgb[k];
+     ((Uint32 *) ((Uint8 *) diff->pixels + (k / screen_width) * diff->pitch))[k % screen_width] =
+        rgb[k] == old[k] ? (old[k] >> 2) & 0x3F3F3F : 0xFF00FF;
+  }
+  snprintf(name, sizeof(name), "%s.%d.bmp", golden_file, n);
+  SDL_SaveBMP(image, name);
+  snprintf(name, sizeof(name), "%s.%d.diff.bmp", golden_file, n);
+  SDL_SaveBMP(diff, name);
+  SDL_FreeSurface(image);
+  SDL_FreeSurface(diff);
+}
 
-  ship_destroyed = 0;
-  ship_dying = 0;
-  score = 0;
-  high_score_broken = 0;
 
+void prof_start()
+{
+  /* start timing at this point, the time till the next mark goes to that phase */
+  int p;
+
+  for (p = 0; p < NUM_PROF_PHASES; p++)
+     prof_ns[p] = 0;
+  if (perf_on) perf_read(perf_last);
+  prof_last = clock_ns();
+  prof_on = 1;
+}
 
-  ship_x = screen_width / 2;
-  ship_y = screen_height / 2;
-  speed = 10;
-  joy_left = 0;
-  joy_right = 0;
-  joy_up = 0;
-  joy_down = 0;
-  
-  recharge_active = 1;       // initially on at startup
-  recharge_sound_delay = 1;  // initially off; no recharge delay
 
-  gun_bit = 4;                    // initial gun bit position
-  ship_window_step = 1;
+void prof_mark(int phase)
+{
+  /* time since the previous mark is for phase (may be called more than once) */
+  Uint64 now = clock_ns();
 
-  setup_shield_bits();
+  prof_ns[phase] += (Uint32) (now - prof_last);
+  if (trace_on) trace_event(prof_names[phase], NULL, prof_last, now);
+  if (perf_on) perf_mark(phase);
+  prof_last = now;
+}
 
-  /* init bullets off */
-  for (i = 0; i < MAX_BULLETS; i++)
-      bullets[i].alive = 0;
 
-  /* init asteroids off */
-  for (i = 0; i < MAX_ASTEROIDS; i++)
-      asteroids[i].status = 0;
+void prof_end_frame()
+{
+  /* keep the times of this frame for the statistics and write them to the CSV */
+  int p;
+  Uint32 total = 0;
+
+  if (prof_csv != NULL) fprintf(prof_csv, "%d", frame);
+  for (p = 0; p < NUM_PROF_PHASES; p++) {
+     prof_hist[p][prof_pos] = prof_ns[p];
+     prof_total[p] += prof_ns[p];
+     total += prof_ns[p];
+     if (prof_csv != NULL) fprintf(prof_csv, ",%u", prof_ns[p]);
+     prof_ns[p] = 0;
+  }
+  if (prof_csv != NULL) fprintf(prof_csv, ",%u\n", total);
 
-  /* init mini_explosions off */
-  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
-      mini_explosions[i].alive = 0;
+  prof_pos = (prof_pos + 1) % PROF_FRAMES;
+  if (prof_frames < PROF_FRAMES) prof_frames++;
+  prof_total_frames++;
+  if (perf_on) perf_frames++;
+}
 
-  /* init ufo off */
-  for (i = 0; i < MAX_UFOS; i++)
-      ufo[i].status = 0;
 
-  /* init ufo laser off */
-  for (i = 0; i < MAX_LASERS; i++) {
-      laser[i].alive = 0;
-      laser[i].fired_by_ufo = -1;
-  }    
-  ufo_start_delay = frame;
+int compare_uint32(const void * a, const void * b)
+{
+  Uint32 x = *(const Uint32 *) a, y = *(const Uint32 *) b;
 
-  printf("New game\n");
+  return (x > y) - (x < y);
 }
 
 
-void setup_ship_explosions()
+void draw_profiler()
 {
-  int i, j;
-
-  for (j = 0; j < 4; j++) {  // 4/8: first 4 color cycls, 
-                             // green, blue, cyan, grey, groen, blauw, cyan grey
-                             //    1    2      3    4     5      6      7    8
+  /* min, avg, p99 and max in microseconds per phase (and the whole frame)
+     over the last PROF_FRAMES frames, top left in the small font */
+  SDL_Color fgColor_grey  = {182,182,182};
+  SDL_Color fgColor_yellow = {182,182,0};
+  SDL_Surface * line;
+  SDL_Rect text_position;
+  Uint32 sorted[PROF_FRAMES];
+  Uint64 sum;
+  char text_line[40];
+  int p, k, i;
+
+  if (prof_frames == 0) return;
+
+  text_position.x = 2 * factor;
+  text_position.y = 2 * factor;
+  line = TTF_RenderText_Solid(font_small, "PHASE       MIN   AVG   P99   MAX", fgColor_yellow);
+  SDL_BlitSurface(line, NULL, screen, &text_position);
+  SDL_FreeSurface(line);
+
+  for (p = 0; p <= NUM_PROF_PHASES; p++) {
+     sum = 0;
+     for (k = 0; k < prof_frames; k++) {
+        if (p < NUM_PROF_PHASES) {
+           sorted[k] = prof_hist[p][k] / 1000;
+        } else {                                  // total of the frame
+           sorted[k] = 0;
+           for (i = 0; i < NUM_PROF_PHASES; i++)
+              sorted[k] += prof_hist[i][k] / 1000;
+        }
+        sum += sorted[k];
+     }
+     qsort(sorted, prof_frames, sizeof(Uint32), compare_uint32);
+
+     sprintf(text_line, "%-9s%6u%6u%6u%6u", p < NUM_PROF_PHASES ? prof_names[p] : "TOTAL",
+             sorted[0], (Uint32) (sum / prof_frames),
+             sorted[(prof_frames - 1) * 99 / 100], sorted[prof_frames - 1]);
+     line = TTF_RenderText_Solid(font_small, text_line,
+                                 p < NUM_PROF_PHASES ? fgColor_grey : fgColor_yellow);
+     text_position.x = 2 * factor;
+     text_position.y = (2 + 7 * (p + 1)) * factor;
+     SDL_BlitSurface(line, NULL, screen, &text_position);
+     SDL_FreeSurface(line);
+  }
+}
 
 
-    for (i = 0; i < 9; i++) {  // first 9 animation sets 1 color
-       if (i < 4) { ship_explosions[i+(j*9)].img_nr = (39 + i) + (j * 4);
-       } else {     ship_explosions[i+(j*9)].img_nr = 0; }
+void trace_start()
+{
+  /* buffers for all threads are allocated now, recording costs no memory */
+  int i;
 
-       ship_explosions[i+(j*9)].ship_nr  = 55 + j;         
-       ship_explosions[i+(j*9)].color_nr = j + 1 ;     // green
-     }    
+  for (i = 0; i < num_threads; i++) {
+     trace_buffers[i].events = malloc(TRACE_EVENTS * sizeof(trace_event_type));
+     if (trace_buffers[i].events == NULL) {
+        fprintf(stderr, "Out of memory for the trace\n");
+        exit(1);
+     }
+     trace_buffers[i].count = 0;
   }
+  trace_start_ns = clock_ns();
+  trace_on = 1;
+}
 
 
-  for (j = 0; j < 4; j++) {  // 4/8: last 4 color cycls, 
-                             // green, blue, cyan, grey, groen, blauw, cyan grey 
-                             //    1    2      3    4     5      6      7    8
-
+void trace_event(const char * name, const char * detail, Uint64 begin, Uint64 end)
+{
+  /* add to the buffer of this thread, no locking needed */
+  trace_buffer_type * b = &trace_buffers[thread_nr];
+  trace_event_type * e;
+
+  if (b->events == NULL) return;   // thread started after trace_start()
+  e = &b->events[b->count % TRACE_EVENTS];
+  e->name = name;
+  e->detail = detail;
+  e->begin = begin;
+  e->end = end;
+  b->count++;
+}
 
-    for (i = 0; i < 9; i++) {  // first 9 animation sets 1 color
-       if (i < 4) { ship_explosions[i+(j*9) + 36].img_nr = (39 + i) + (j * 4);
-       } else {     ship_explosions[i+(j*9) + 36].img_nr = 0; }
 
-       ship_explosions[i+(j*9) + 36].ship_nr  = 55 + j;         
-       ship_explosions[i+(j*9) + 36].color_nr = j + 1 ;     // green
-     }    
+void write_trace()
+{
+  /* write the buffers as trace event JSON (complete events, times in us),
+     load in chrome://tracing or ui.perfetto.dev */
+  FILE * f;
+  trace_buffer_type * b;
+  trace_event_type * e;
+  Uint32 k, first;
+  Uint64 begin, dur;
+  int i, n = 0;
+
+  f = fopen(trace_file, "w");
+  if (f == NULL) {
+     fprintf(stderr, "Cannot create %s: %s\n", trace_file, strerror(errno));
+     return;
+  }
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (i = 0; i < MAX_THREADS; i++) {
+     b = &trace_buffers[i];
+     if (b->events == NULL) continue;
+     fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s %d\"}}",
+             n++ > 0 ? ",\n" : "", i, i == 0 ? "main" : "worker", i);
+     first = b->count > TRACE_EVENTS ? b->count - TRACE_EVENTS : 0;
+     for (k = first; k < b->count; k++) {
+        e = &b->events[k % TRACE_EVENTS];
+        begin = e->begin > trace_start_ns ? e->begin - trace_start_ns : 0;
+        dur = e->end - e->begin;
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                   "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu",
+                e->name, i,
+                (unsigned long long) (begin / 1000), (unsigned long long) (begin % 1000),
+                (unsigned long long) (dur / 1000), (unsigned long long) (dur % 1000));
+        if (e->detail != NULL) {
+           fprintf(f, ",\"args\":{\"file\":");
+           write_json_string(f, e->detail);
+           fprintf(f, "}");
+        }
+        fprintf(f, "}");
+     }
   }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  printf("Trace written to %s\n", trace_file);
+}
 
-  /* make duplicate of all above explosions */
 
-  for (i = 0; i < 36; i++) {
-     ship_explosions[72 + i].img_nr   = ship_explosions[i].img_nr;
-     ship_explosions[72 + i].ship_nr  = ship_explosions[i].ship_nr;
-     ship_explosions[72 + i].color_nr = ship_explosions[i].color_nr;
+void write_json_string(FILE * f, const char * s)
+{
+  /* s in quotes, with " and \ escaped (file names on Windows) */
+  fputc('"', f);
+  for (; *s != 0; s++) {
+     if (*s == '"' || *s == '\\') {
+        fputc('\\', f);
+        fputc(*s, f);
+     } else if ((unsigned char) *s < 32) {
+        fprintf(f, "\\u%04x", *s);
+     } else {
+        fputc(*s, f);
+     }
   }
+  fputc('"', f);
+}
 
-  /* last animation, no ship, no explosion, only bullets (grey) */
-  for (i = 108; i < 115; i++) {  
-     ship_explosions[i].img_nr   = 0;
-     ship_explosions[i].ship_nr  = 0;         
-     ship_explosions[i].color_nr = 4;     // grey
-  }    
+
+void perf_open()
+{
+  /* one group: all counters are read with one read() at the same moment.
+     Counters the cpu (or a virtual machine) does not have are left out */
+#ifdef __linux__
+  struct perf_event_attr attr;
+  const Uint64 configs[NUM_PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+  int c, fd;
+
+  perf_members = 0;
+  for (c = 0; c < NUM_PERF_COUNTERS; c++) {
+     memset(&attr, 0, sizeof(attr));
+     attr.size = sizeof(attr);
+     attr.type = PERF_TYPE_HARDWARE;
+     attr.config = configs[c];
+     attr.disabled = (perf_group == -1);     // the leader starts the group
+     attr.exclude_kernel = 1;
+     attr.exclude_hv = 1;
+     attr.read_format = PERF_FORMAT_GROUP;
+     fd = syscall(__NR_perf_event_open, &attr, 0, -1, perf_group, 0);
+     if (fd == -1) {
+        printf("perf: no %s counter: %s\n", perf_names[c], strerror(errno));
+        perf_slot[c] = -1;
+        continue;
+     }
+     if (perf_group == -1) perf_group = fd;
+     perf_slot[c] = perf_members++;
+  }
+  if (perf_group == -1) {
+     printf("perf: no hardware counters, --perf ignored\n");
+     return;
+  }
+  ioctl(perf_group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf_group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  perf_on = 1;
+#else
+  printf("perf: hardware counters only on Linux, --perf ignored\n");
+#endif
 }
 
 
-void load_images(void)
+void perf_read(Uint64 * values)
 {
-  int i;
-  char image_string[200];
-  char temp_string[200];
-  SDL_Surface * image;
+  /* current values, 0 for the counters that are not supported */
+  Uint64 buf[1 + NUM_PERF_COUNTERS];
+  int c;
 
+  memset(buf, 0, sizeof(buf));
+#ifdef __linux__
+  if (read(perf_group, buf, sizeof(buf)) <= 0) buf[0] = 0;
+#endif
+  for (c = 0; c < NUM_PERF_COUNTERS; c++)
+     values[c] = (perf_slot[c] >= 0 && perf_slot[c] < (int) buf[0]) ? buf[1 + perf_slot[c]] : 0;
+}
 
-  for (i = 0; i <  NUM_IMAGES; i++)  
-  {
-    if (i == 5                             // ship image
-         || (i >= 11 && i <= 38)           // asteroids + mini exp.
-         || (i >= 55 && i <= 58)           // ship color
-         || (i >= 39 && i <= 54)           // ship explosions 
-         || (i >= 63 && i <= 71)) {        // ufo, lasers
-      
-      // load factor image                    + ship explosion
-      sprintf(image_string, "%s", image_names[i] );
-      sprintf(temp_string, "%d", factor);
-      strcat(image_string, temp_string);
-      strcat(image_string, ".bmp");
 
-      image = SDL_LoadBMP(image_string);
-    } else {  
-        strcpy(image_string, image_names[i] );
-        image = SDL_LoadBMP(image_string);
-    }
+void perf_mark(int phase)
+{
+  /* counts since the previous mark are for phase */
+  Uint64 now[NUM_PERF_COUNTERS];
+  int c;
+
+  perf_read(now);
+  for (c = 0; c < NUM_PERF_COUNTERS; c++) {
+     perf_sum[phase][c] += now[c] - perf_last[c];
+     perf_last[c] = now[c];
+  }
+}
 
-    if (image == NULL)
-    {
-      fprintf(stderr,
-        "\nError: I couldn't load a graphics file:\n"
-        "%s\n"
-        "The Simple DirectMedia error that occured was:\n"
-        "%s\n\n", image_string, SDL_GetError());
-      exit(1);
-    }
-      
-    /* Convert to display format: */
-    images[i] = SDL_DisplayFormat(image);
-    if (images[i] == NULL)
-    {
-        fprintf(stderr,
-                "\nError: I couldn't convert a file to the display format:\n"
-                "%s\n"
-                "The Simple DirectMedia error that occured was:\n"
-                "%s\n\n", image_names[i], SDL_GetError());
-        exit(1);
-    }
 
-    /* Set transparency: */
-    if (i != 10)       // do not set transparency for white gun bit and bullets
-    {  
-       if (SDL_SetColorKey(images[i], (SDL_SRCCOLORKEY | SDL_RLEACCEL),
-               SDL_MapRGB(images[i] -> format,
-               0xFF, 0xFF, 0xFF)) == -1)
-        {
-           fprintf(stderr,
-             "\nError: I could not set the color key for the file:\n"
-             "%s\n"
-             "The Simple DirectMedia error that occured was:\n"
-             "%s\n\n", image_names[i], SDL_GetError());
-           exit(1);
+void print_perf_stats()
+{
+  /* average per frame for every phase, - for counters that are not supported */
+  char column[20];
+  int p, c;
+
+  if (perf_frames == 0) return;
+  printf("Hardware counters per frame (main thread, %u frames):\n", perf_frames);
+  printf("  %-10s %13s %13s %6s %13s %13s\n", "phase", "cycles", "instructions", "IPC",
+         "LLC misses", "branch misses");
+  for (p = 0; p < NUM_PROF_PHASES; p++) {
+     printf("  %-10s", prof_names[p]);
+     for (c = 0; c < NUM_PERF_COUNTERS; c++) {
+        if (perf_slot[c] < 0) {
+           sprintf(column, "-");
+        } else {
+           sprintf(column, "%llu", (unsigned long long) (perf_sum[p][c] / perf_frames));
         }
-    }
+        printf(" %13s", column);
+        if (c == 1) {                          // IPC after the instructions
+           if (perf_slot[0] >= 0 && perf_slot[1] >= 0 && perf_sum[p][0] > 0) {
+              printf(" %6.2f", (double) perf_sum[p][1] / perf_sum[p][0]);
+           } else {
+              printf(" %6s", "-");
+           }
+        }
+     }
+     printf("\n");
+  }
+}
 
-  }  // end for loop
-}  
 
+void hist_add(histogram_type * h, Uint32 us)
+{
+  /* bucket: values below 16 exact, else the highest bit k and the 4 bits
+     after it */
+  int k, b;
 
-int get_user_input()
+  if (us >= (1u << HIST_MAX_BITS)) us = (1u << HIST_MAX_BITS) - 1;
+  if (us < (1u << HIST_SUB_BITS)) {
+     b = us;
+  } else {
+     k = HIST_SUB_BITS;
+     while ((us >> (k + 1)) != 0) k++;
+     b = ((k - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+         ((us >> (k - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+  }
+  h->counts[b]++;
+  if (h->n == 0 || us < h->min) h->min = us;
+  if (us > h->max) h->max = us;
+  h->n++;
+  h->sum += us;
+}
+
+
+Uint32 hist_percentile(histogram_type * h, int permille)
 {
-  SDL_Event event;
-    Uint8* keystate = SDL_GetKeyState(NULL);
-    int rotate_gun = 0;
-    int window_size_changed = 0;
-    char title_string[100];
-    int i;
+  /* highest value of the bucket with the permille/1000 rank (e.g. 999: p99.9) */
+  Uint64 rank, seen = 0;
+  Uint32 top;
+  int b, k;
+
+  if (h->n == 0) return 0;
+  rank = ((Uint64) h->n * permille + 999) / 1000;
+  if (rank == 0) rank = 1;
+  for (b = 0; b < HIST_BUCKETS; b++) {
+     seen += h->counts[b];
+     if (seen >= rank) break;
+  }
+  if (b < (1 << HIST_SUB_BITS)) {
+     top = b;
+  } else {
+     k = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+     top = (((1 << HIST_SUB_BITS) + (b & ((1 << HIST_SUB_BITS) - 1)) + 1) << (k - HIST_SUB_BITS)) - 1;
+  }
+  return top < h->max ? top : h->max;
+}
 
-    // Handle decrease / enlarge window (keypad + -)
-    if (full_screen == 0) {
-       
-       if ( (keystate[SDLK_KP_MINUS] || keystate[SDLK_LEFTBRACKET] || keystate[57]) && ship_dying != 1) { // decrease windows size
-         if (factor > 1) {
-           window_size_changed = 1;
-           factor --;
-           }
-       }
-       if ( (keystate[SDLK_KP_PLUS] || keystate[SDLK_RIGHTBRACKET] || keystate[48]) && ship_dying != 1) { // increase windows size
-         if (factor < 9) {
-           window_size_changed = 1;
-           factor ++;
-           }
-       }
-     }
-     if ( keystate[56] && ship_dying != 1) { // toggle full_screen: 8 key
-        window_size_changed = 1;
-        if (full_screen == 1) {
-           full_screen = 0;
-        } else { 
-           full_screen = 1;
-        }
-        if (monitor_height >= 1080) factor = 5;   // 1080p and higer
-        if (monitor_height  <= 768)  factor = 3;   // 768p and lower
-        screen_width  =  factor * VIDEOPAC_RES_W;           
-        screen_height =  factor * VIDEOPAC_RES_H;
-     }
 
-     if (window_size_changed == 1) 
-           handle_screen_resize(2);
-     
+void frame_begin(int loop)
+{
+  frame_stats_type * fs = &frame_stats[loop];
+  Uint64 now = clock_ns();
 
-  /* Loop through waiting messages and process them */
-  
-  while (SDL_PollEvent(&event))
-  {
-    switch (event.type)
-    {
-      /* Closing the Window will exit the program */
-      case SDL_QUIT:   // close window
-        exit(0);
-      break;
+  if (fs->start != 0) hist_add(&fs->period, (Uint32) ((now - fs->start) / 1000));
+  fs->start = now;
+}
 
-      case SDL_KEYDOWN:
 
-        if (event.key.keysym.sym == SDLK_ESCAPE ) {
-            printf("--key escape\n");   // return to instructions
-            start_new_game();           // clear all objects
-            return(1);
-        } else {
-          if ( (event.key.keysym.sym >= 97 && event.key.keysym.sym <= 122)
-                 || event.key.keysym.sym == 32 || event.key.keysym.sym == 13) {    // spatie, return
-            if (high_score_registration == 1) {
-              print_high_score_char(event.key.keysym.sym);
-            } 
-          }
-        }
-      break;
+void frame_work_done(int loop)
+{
+  /* work done, the delay comes next (none if the deadline is missed) */
+  frame_stats_type * fs = &frame_stats[loop];
+  Uint32 work;
+
+  fs->work_end = clock_ns();
+  work = (Uint32) ((fs->work_end - fs->start) / 1000);
+  hist_add(&fs->work, work);
+  if (work >= FRAME_DEADLINE) {
+     fs->misses++;
+     fs->streak++;
+     if (fs->streak > fs->longest_streak) fs->longest_streak = fs->streak;
+  } else {
+     fs->streak = 0;
+  }
+}
 
-      case SDL_JOYBUTTONDOWN:
-          if (  (event.jbutton.button == 0 || event.jbutton.button == 1)
-                && ship_dying != 1
-             ) {
-             //printf("Fire button presed\n");
-             if (frame - bullet_frame >= 5) {
-                 add_bullet (ship_x, ship_y);
-                 bullet_frame = frame;
-             }  
-          }
-      break;
 
-      case SDL_JOYAXISMOTION:
-        //If joystick 0 has moved
-        if ( event.jaxis.which == 0 ) {
-            //If the X axis changed
-            if ( event.jaxis.axis == 0 ) {
-                //If the X axis is neutral
-                if ( ( event.jaxis.value > -8000 ) && ( event.jaxis.value < 8000 ) ) {
-                     joy_left = 0;
-                     joy_right = 0;
-                } else {
-                    //Adjust the velocity
-                    if ( event.jaxis.value < 0 ) {
-                        joy_left = 1;
-                        joy_right = 0;
-                    } else {
-                        joy_left = 0;
-                        joy_right = 1;
-                    }
-                }
-            }
-            //If the Y axis changed
-            else if ( event.jaxis.axis == 1 ) {
-                //If the Y axis is neutral
-                if ( ( event.jaxis.value > -8000 ) && ( event.jaxis.value < 8000 ) ) {
-                     joy_up = 0;
-                     joy_down = 0;
-                } else {
-                    //Adjust the velocity
-                    if ( event.jaxis.value < 0 ) {
-                     joy_up = 1;
-                     joy_down = 0;
-                    } else {
-                        joy_up = 0;
-                        joy_down = 1;
-                    }
-                }
-            }
-        }   // if event.jaxis.which == 0      
-      break;      
-
-    }  // end switch
-  }    // end while
+void frame_end(int loop)
+{
+  frame_stats_type * fs = &frame_stats[loop];
 
+  hist_add(&fs->sleep, (Uint32) ((clock_ns() - fs->work_end) / 1000));
+}
 
-   /* Check continuous-response keys , works even for diagonals ! */
-   if (keystate[SDLK_LEFT] || joy_left == 1) {
-       if (ship_dying == 0) ship_x = ship_x - speed; 
-       rotate_gun = 1;
-   }
-   if (keystate[SDLK_RIGHT] || joy_right == 1) { 
-       if (ship_dying == 0) ship_x = ship_x + speed; 
-       rotate_gun = 1;
-   }
-   if (keystate[SDLK_UP] || joy_up == 1) { 
-       if (ship_dying == 0) ship_y = ship_y - speed; 
-       rotate_gun = 1;
-   }    
-   if (keystate[SDLK_DOWN] || joy_down == 1) { 
-       if (ship_dying == 0) ship_y = ship_y + speed; 
-       rotate_gun = 1;
-   }
 
-   if (rotate_gun == 1 && ship_dying != 1) { rotate_gun_bit();}
+void print_frame_stats()
+{
+  /* percentiles in microseconds of both loops */
+  frame_stats_type * fs;
+  histogram_type * h[3];
+  const char * names[3] = {"work", "sleep", "period"};
+  int loop, k;
+
+  for (loop = LOOP_TITLE; loop <= LOOP_GAME; loop++) {
+     fs = &frame_stats[loop];
+     if (fs->work.n == 0) continue;
+     h[0] = &fs->work;
+     h[1] = &fs->sleep;
+     h[2] = &fs->period;
+     printf("Frame times %s loop: %u frames, %u missed %d ms deadlines (longest streak %u)\n",
+            loop_names[loop], fs->work.n, fs->misses, FRAME_DEADLINE / 1000, fs->longest_streak);
+     printf("  us          min     p50     p99   p99.9     max    mean\n");
+     for (k = 0; k < 3; k++) {
+        if (h[k]->n == 0) continue;
+        printf("  %-8s%7u %7u %7u %7u %7u %7u\n", names[k], h[k]->min,
+               hist_percentile(h[k], 500), hist_percentile(h[k], 990),
+               hist_percentile(h[k], 999), h[k]->max, (Uint32) (h[k]->sum / h[k]->n));
+     }
+  }
+}
 
-   if (ship_x < 0) { ship_x = 0; }
-   if (ship_y < 0) { ship_y = 0; }
-   if (ship_x + SHIP_W * factor > screen_width)  
-      { ship_x = screen_width - SHIP_W * factor; }   // depending on screen size and ship width
-   if (ship_y + SHIP_H * factor > screen_height) 
-      { ship_y = screen_height - SHIP_H * factor; }  // depending on screen size and ship height
 
-   /* handle fire key */
-   if ( (keystate[SDLK_LCTRL] || keystate[SDLK_RCTRL])  && ship_dying != 1 ) {
-       // prevent bullets fired to soon after each other
-       if (frame - bullet_frame >= 5) {
-         add_bullet (ship_x, ship_y);
-         bullet_frame = frame;
-       }  
-    }
- return(0);
+void start_metrics()
+{
+  /* listen on a Unix socket, or on localhost when the address is a number */
+#ifndef _WIN32
+  struct sockaddr_un un;
+  struct sockaddr_in in;
+  int port = atoi(metrics_addr), r;
+
+  if (port > 0) {
+     metrics_fd = socket(AF_INET, SOCK_STREAM, 0);
+     r = 1;
+     setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &r, sizeof(r));
+     memset(&in, 0, sizeof(in));
+     in.sin_family = AF_INET;
+     in.sin_port = htons(port);
+     in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+     r = bind(metrics_fd, (struct sockaddr *) &in, sizeof(in));
+  } else {
+     metrics_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+     memset(&un, 0, sizeof(un));
+     un.sun_family = AF_UNIX;
+     strncpy(un.sun_path, metrics_addr, sizeof(un.sun_path) - 1);
+     unlink(metrics_addr);            // left by a previous run
+     r = bind(metrics_fd, (struct sockaddr *) &un, sizeof(un));
+  }
+  if (metrics_fd == -1 || r == -1 || listen(metrics_fd, 4) == -1) {
+     fprintf(stderr, "Cannot serve metrics on %s: %s\n", metrics_addr, strerror(errno));
+     exit(1);
+  }
 
+  signal(SIGPIPE, SIG_IGN);           // a scraper that hangs up is no reason to stop
+  metrics_start_ns = clock_ns();
+  metrics_quit = 0;
+  metrics_thread = SDL_CreateThread(metrics_main, NULL);
+  if (metrics_thread == NULL) {
+     fprintf(stderr, "Couldn't create thread: %s\n", SDL_GetError());
+     exit(1);
+  }
+  metrics_on = 1;
+  printf("Metrics on %s\n", metrics_addr);
+#else
+  printf("No metrics server on Windows, --metrics ignored\n");
+#endif
 }
 
 
-void cleanup()
+void stop_metrics()
 {
-  /* Shut down SDL */
-  printf("Exit game, cleaning up\n");
-  Mix_HaltMusic();
-  Mix_HaltChannel(-1);
-  if (use_joystick == 1) SDL_JoystickClose(js);
-  TTF_CloseFont(font_large);
-  TTF_CloseFont(font_small);
-  SDL_FreeSurface(text);
-  SDL_FreeSurface(screen);
-  SDL_Quit();
+#ifndef _WIN32
+  if (metrics_on == 0) return;
+  metrics_quit = 1;
+  SDL_WaitThread(metrics_thread, NULL);
+  close(metrics_fd);
+  if (atoi(metrics_addr) <= 0) unlink(metrics_addr);
+  metrics_on = 0;
+#endif
 }
 
 
-void handle_screen_resize(int mode)
+void update_metrics()
 {
-  // mode == 1: in instructions screen, mode == 2: during game play
+  /* end of a game frame: count the objects, every METRICS_EVERY frames also
+     the percentiles, then publish. No locks and no allocations */
+  metrics_type * m = &metrics_game;
+  frame_stats_type * fs = &frame_stats[LOOP_GAME];
+  Uint64 now;
   int i;
-  char title_string[100];
 
-  screen_width  =  factor * VIDEOPAC_RES_W;           
-  screen_height =  factor * VIDEOPAC_RES_H;
-  //printf("Window resize in handle resize: full_screen=%d, width=%d, height=%d, factor=%d\n",
-  //        full_screen, screen_width, screen_height, factor);
-  if (full_screen == 0) {
-         screen = SDL_SetVideoMode(screen_width, screen_height, 0, SDL_HWPALETTE | SDL_ANYFORMAT);
-  } else {       
-         screen = SDL_SetVideoMode(screen_width, screen_height, 0, SDL_HWPALETTE | SDL_ANYFORMAT | SDL_FULLSCREEN);
-  }
-  if (screen == NULL) {
-      fprintf(stderr, "\nWarning: I could not set up video for "
-              "larger/smaller mode.\n"
-              "The Simple DirectMedia error that occured was:\n"
-              "%s\n\n", SDL_GetError());
+  m->frames++;
+  m->misses = fs->misses;
+  m->asteroids = 0;
+  for (i = 0; i < MAX_ASTEROIDS; i++)
+     if (asteroids[i].status != 0) m->asteroids++;
+  m->ufos = 0;
+  for (i = 0; i < MAX_UFOS; i++)
+     if (ufo[i].status != 0) m->ufos++;
+  m->lasers = 0;
+  for (i = 0; i < MAX_LASERS; i++)
+     if (laser[i].alive == 1) m->lasers++;
+  m->explosions = 0;
+  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
+     if (mini_explosions[i].alive == 1) m->explosions++;
+  m->bullets = bullets_alive;
+  m->score = score;
+  m->high_score = high_score;
+  m->difficulty = difficulty;
+
+  metrics_window++;
+  if (metrics_window == METRICS_EVERY) {
+     now = clock_ns();
+     m->fps_x100 = (Uint32) ((Uint64) METRICS_EVERY * 100 * 1000000000 / (now - metrics_last_ns));
+     metrics_last_ns = now;
+     metrics_window = 0;
+     m->work_p50 = hist_percentile(&fs->work, 500);
+     m->work_p99 = hist_percentile(&fs->work, 990);
+     m->work_p999 = hist_percentile(&fs->work, 999);
+     m->period_p50 = hist_percentile(&fs->period, 500);
+     m->period_p99 = hist_percentile(&fs->period, 990);
+     m->period_p999 = hist_percentile(&fs->period, 999);
+     m->channels = Mix_Playing(-1);
   }
 
-  /* adjust ship speed depending on screen size (factor) */
-  if (factor <= 2) {
-     speed = 2; } 
-  else if (factor > 2 && factor <= 5) {
-     speed = 7; } 
-  else if (factor > 5 && factor <= 7) {
-     speed = 10; } 
-  else { speed = 14;}   
+  metrics_seq++;                   // odd: being written
+  __sync_synchronize();
+  metrics = *m;
+  __sync_synchronize();
+  metrics_seq++;
+}
 
-  /* clear all asteroids, during game mode */
-  if (mode == 2) {
-    for (i = 0; i < MAX_ASTEROIDS; i++)
-       asteroids[i].status = 0;
-  } 
 
-  /* clear all ufos during game mode */
-  if (mode == 2) {
-    for (i = 0; i < MAX_UFOS; i++)
-       ufo[i].status = 0;
+int write_metrics(char * buf, int size)
+{
+  /* Prometheus text format of a consistent copy of the metrics */
+  metrics_type m;
+  Uint32 seq;
+  double uptime;
+
+  do {
+     seq = metrics_seq;
+     __sync_synchronize();
+     m = metrics;
+     __sync_synchronize();
+  } while ((seq & 1) != 0 || seq != metrics_seq);
+
+  uptime = (clock_ns() - metrics_start_ns) / 1e9;
+  return snprintf(buf, size,
+    "# HELP ufo_uptime_seconds Time since start.\n"
+    "# TYPE ufo_uptime_seconds gauge\n"
+    "ufo_uptime_seconds %.3f\n"
+    "# HELP ufo_frames_total Game frames.\n"
+    "# TYPE ufo_frames_total counter\n"
+    "ufo_frames_total %u\n"
+    "# HELP ufo_deadline_misses_total Game frames that took 33 ms or more.\n"
+    "# TYPE ufo_deadline_misses_total counter\n"
+    "ufo_deadline_misses_total %u\n"
+    "# HELP ufo_frame_rate Game frames per second (last second).\n"
+    "# TYPE ufo_frame_rate gauge\n"
+    "ufo_frame_rate %u.%02u\n"
+    "# HELP ufo_frame_work_seconds Work time of a game frame (without the delay).\n"
+    "# TYPE ufo_frame_work_seconds summary\n"
+    "ufo_frame_work_seconds{quantile=\"0.5\"} %.6f\n"
+    "ufo_frame_work_seconds{quantile=\"0.99\"} %.6f\n"
+    "ufo_frame_work_seconds{quantile=\"0.999\"} %.6f\n"
+    "# HELP ufo_frame_period_seconds Time between the starts of game frames.\n"
+    "# TYPE ufo_frame_period_seconds summary\n"
+    "ufo_frame_period_seconds{quantile=\"0.5\"} %.6f\n"
+    "ufo_frame_period_seconds{quantile=\"0.99\"} %.6f\n"
+    "ufo_frame_period_seconds{quantile=\"0.999\"} %.6f\n"
+    "# HELP ufo_objects Active objects on screen.\n"
+    "# TYPE ufo_objects gauge\n"
+    "ufo_objects{type=\"asteroid\"} %d\n"
+    "ufo_objects{type=\"ufo\"} %d\n"
+    "ufo_objects{type=\"laser\"} %d\n"
+    "ufo_objects{type=\"bullet\"} %d\n"
+    "ufo_objects{type=\"explosion\"} %d\n"
+    "# HELP ufo_mixer_channels_playing Mixer channels playing a sound.\n"
+    "# TYPE ufo_mixer_channels_playing gauge\n"
+    "ufo_mixer_channels_playing %d\n"
+    "# HELP ufo_score Score of the current game.\n"
+    "# TYPE ufo_score gauge\n"
+    "ufo_score %d\n"
+    "# HELP ufo_high_score High score.\n"
+    "# TYPE ufo_high_score gauge\n"
+    "ufo_high_score %d\n"
+    "# HELP ufo_difficulty Difficulty (1 normal, 2 hard, 3 insane).\n"
+    "# TYPE ufo_difficulty gauge\n"
+    "ufo_difficulty %d\n",
+    uptime, m.frames, m.misses, m.fps_x100 / 100, m.fps_x100 % 100,
+    m.work_p50 / 1e6, m.work_p99 / 1e6, m.work_p999 / 1e6,
+    m.period_p50 / 1e6, m.period_p99 / 1e6, m.period_p999 / 1e6,
+    m.asteroids, m.ufos, m.lasers, m.bullets, m.explosions,
+    m.channels, m.score, m.high_score, m.difficulty);
+}
+
+
+int metrics_main(void * data)
+{
+  /* answer every connection with the metrics (any request, HTTP/1.0) */
+#ifndef _WIN32
+  struct pollfd p;
+  char request[1024], body[4096], header[128];
+  int fd, n;
+
+  while (metrics_quit == 0) {
+     p.fd = metrics_fd;
+     p.events = POLLIN;
+     if (poll(&p, 1, 200) <= 0) continue;       // check metrics_quit 5 times a second
+     fd = accept(metrics_fd, NULL, NULL);
+     if (fd == -1) continue;
+
+     p.fd = fd;                                  // read the request (not used)
+     if (poll(&p, 1, 100) > 0) n = read(fd, request, sizeof(request));
+
+     n = write_metrics(body, sizeof(body));
+     sprintf(header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %d\r\n\r\n", n);
+     if (write(fd, header, strlen(header)) > 0) n = write(fd, body, n);
+     close(fd);
   }
+#endif
+  (void) data;
+  return 0;
+}
 
-  /* clear all lasers */
-  for (i = 0; i < MAX_LASERS; i++) {
-     laser[i].alive = 0;
-     laser[i].fired_by_ufo = -1;
+
+void latency_event(SDL_Event * event)
+{
+  /* event taken from the queue, the frame that is built now uses it */
+  Uint64 now = clock_ns(), origin = now;
+
+  switch (event->type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      if (event->key.which == INJECT_DEVICE) {
+         if (event->key.keysym.unicode >= INJECT_TIMES) return;   // start key
+         origin = inject_times[event->key.keysym.unicode];
+         hist_add(&latency_queue_hist, (Uint32) ((now - origin) / 1000));
+      }
+      break;
+    case SDL_JOYAXISMOTION:
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+      break;
+    default:
+      return;
   }
+  if (num_latency_pending < MAX_PENDING_INPUTS)
+     latency_pending[num_latency_pending++] = origin;
+}
 
-  /* init bullets off */
-  for (i = 0; i < MAX_BULLETS; i++)
-      bullets[i].alive = 0;
-  
-  /* init mini_explosions off */
-  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
-      mini_explosions[i].alive = 0;
 
+void latency_presented()
+{
+  /* called after SDL_Flip(): the frame with the pending input is shown */
+  Uint64 now = clock_ns();
+  int k;
 
-  /* reset ship to center of screen when in game mode*/ 
-  if (mode == 2) { 
-    ship_x = screen_width  / 2;
-    ship_y = screen_height / 2;
-  }
+  for (k = 0; k < num_latency_pending; k++)
+     hist_add(&latency_hist, (Uint32) ((now - latency_pending[k]) / 1000));
+  num_latency_pending = 0;
 
-  printf("Window factor %d\n", factor);
-  load_images();
+  if (latency_target > 0 && latency_hist.n >= (Uint32) latency_target)
+     exit(0);                      // cleanup() prints the results
+}
 
-  font_size = factor * 12;
-  TTF_CloseFont(font_large);
-  font_large = TTF_OpenFont("O2.ttf", font_size);
-  //printf("font size changed\n");
-     if (!font_large)
-        fprintf(stderr, "Cannot load font name O2.ttf large: %s\n", SDL_GetError());
-  TTF_CloseFont(font_small);
-  font_small = TTF_OpenFont("O2.ttf", font_size/2);
-     if (!font_small)
-        fprintf(stderr, "Cannot load font name O2.ttf small: %s\n", SDL_GetError());
 
-  sprintf(title_string, "UFO - factor: %d - difficulty: %d", factor, difficulty);
-  SDL_WM_SetCaption(title_string, "UFO");
+void print_latency_stats()
+{
+  histogram_type * h[2];
+  const char * names[2] = {"present", "queue"};
+  int k;
 
-  SDL_Flip(screen);
-  SDL_Delay(500);
+  h[0] = &latency_hist;
+  h[1] = &latency_queue_hist;
+  printf("Input latency: %u events\n", latency_hist.n);
+  printf("  us          min     p50     p90     p99     max    mean\n");
+  for (k = 0; k < 2; k++) {
+     if (h[k]->n == 0) continue;
+     printf("  %-8s%7u %7u %7u %7u %7u %7u\n", names[k], h[k]->min,
+            hist_percentile(h[k], 500), hist_percentile(h[k], 900),
+            hist_percentile(h[k], 990), h[k]->max, (Uint32) (h[k]->sum / h[k]->n));
+  }
 }
 
 
-void draw_stars()
+void push_injected_key(int type, SDLKey sym, int nr)
 {
-  int x,y;
-  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+  /* nr: index of the push time, INJECT_TIMES or more: not measured */
+  SDL_Event event;
 
-  /* screen top left = (0,0), bottom-right = (screen_width, screen_height))  */
+  memset(&event, 0, sizeof(event));
+  event.type = type;
+  event.key.which = INJECT_DEVICE;
+  event.key.state = (type == SDL_KEYDOWN) ? SDL_PRESSED : SDL_RELEASED;
+  event.key.keysym.sym = sym;
+  event.key.keysym.unicode = nr;
+  if (nr < INJECT_TIMES) inject_times[nr] = clock_ns();
+  SDL_PushEvent(&event);
+}
 
-  for (x=0; x < screen_width - SECTOR_SIZE; x = x + SECTOR_SIZE)
-  {
-    for (y=0; y < screen_height - SECTOR_SIZE; y = y + SECTOR_SIZE)
-    {
-      //srand( (x+offset_x) * (y+offset_y) );    /* seed randomizer based on x/y position */
-      srand( x * y );    /* seed randomizer based on x/y position */
-      /* in 1/20 of draw a star */
-      if (rand() % 20 == 1)
-      {
-        rect.x = x;
-        rect.y = y;
-        rect.w = (rand() % MAX_STAR_SIZE) + 1;
-        rect.h = rect.w;
 
-        SDL_FillRect(screen, &rect, getStarColor( rand() % 15) );
-      }    
-   }
+int inject_main(void * data)
+{
+  /* synthetic player: start a game, then hold an arrow key 30..100 ms and
+     wait 20..150 ms, at moments that have nothing to do with the frames */
+  const SDLKey arrows[4] = {SDLK_LEFT, SDLK_UP, SDLK_RIGHT, SDLK_DOWN};
+  Uint32 n = 0;
+
+  (void) data;
+  SDL_Delay(500);
+  push_injected_key(SDL_KEYDOWN, (SDLKey) 49, INJECT_TIMES);    // key 1
+  push_injected_key(SDL_KEYUP, (SDLKey) 49, INJECT_TIMES);
+  SDL_Delay(500);
+
+  while (inject_quit == 0) {
+     push_injected_key(SDL_KEYDOWN, arrows[n % 4], (2 * n) % INJECT_TIMES);
+     SDL_Delay(30 + hash_random(n, 1) % 71);
+     push_injected_key(SDL_KEYUP, arrows[n % 4], (2 * n + 1) % INJECT_TIMES);
+     SDL_Delay(20 + hash_random(n, 2) % 131);
+     n++;
   }
-  /* randomize randomizer for subsequent uses */
-  srand(SDL_GetTicks() * frame);
+  return 0;
 }
 
 
-void draw_ship()
+#ifdef TRACK_ALLOCS
+int track_site(const char * what, int line)
 {
-  SDL_Rect src_rect;     // image source rectangle
-  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+  int i;
 
-  /* draw ship satellite attack */
-  src_rect.x = 0;  // left
-  src_rect.y = 0;  // up
-  src_rect.w = SHIP_W * factor;   
-  src_rect.h = SHIP_H * factor;   
+  for (i = 0; i < num_alloc_sites; i++)
+     if (alloc_sites[i].line == line && alloc_sites[i].what == what) return i;
+  if (num_alloc_sites == TRACK_SITES) return TRACK_SITES - 1;   // last one is "other"
+  alloc_sites[i].what = what;
+  alloc_sites[i].line = line;
+  num_alloc_sites++;
+  return i;
+}
 
-  rect.x = ship_x;   // x position  on screen
-  rect.y = ship_y;   // y postition on scherm
-  rect.w = SHIP_W * factor;    // ignored!
-  rect.h = SHIP_H * factor;    // ignored!
 
-  SDL_BlitSurface(images[5], &src_rect, screen, &rect);
+int track_slot(void * p)
+{
+  /* slot of p in the hash table, or the free slot where it would go */
+  Uint32 k = (Uint32) (((size_t) p >> 4) * 2654435761u) & (TRACK_SLOTS - 1);
 
+  while (alloc_slots[k].p != NULL && alloc_slots[k].p != p)
+     k = (k + 1) & (TRACK_SLOTS - 1);
+  return k;
+}
 
-  /* draw "window" on ship : 1 black pixel */
 
-  src_rect.x = 0;  // left
-  src_rect.y = 0;  // up
-  src_rect.w = factor;   
-  src_rect.h = factor;   
+void track_add(void * p, const char * what, int line, Uint32 bytes)
+{
+  alloc_site_type * site;
+  int k;
 
-  rect.w = SHIP_W * factor;    // ignored!
-  rect.h = SHIP_H * factor;    // ignored!
-  rect.y = ship_y + (2 * factor);
+  if (p == NULL) return;
+  SDL_LockMutex(alloc_lock);
+  if (alloc_live >= TRACK_SLOTS / 2) {      // keep the hash table fast
+     SDL_UnlockMutex(alloc_lock);
+     fprintf(stderr, "Allocation tracker full, %s in line %d not counted\n", what, line);
+     return;
+  }
+  k = track_slot(p);
+  alloc_slots[k].p = p;
+  alloc_slots[k].site = track_site(what, line);
+  alloc_slots[k].bytes = bytes;
+  alloc_live++;
+
+  site = &alloc_sites[alloc_slots[k].site];
+  site->allocs++;
+  site->live++;
+  site->bytes += bytes;
+  site->live_bytes += bytes;
+  SDL_UnlockMutex(alloc_lock);
+}
 
 
-  switch (ship_window_step) {
-  case 1:
-     rect.x = ship_x + (3 * factor);
-     break;
-  case 2:
-     rect.x = ship_x + (4 * factor);
-     break;
-  case 3:
-     rect.x = ship_x + (5 * factor);
-     break;
-  case 4:
-     rect.x = ship_x + (6 * factor);
-     break;
-  case 5:
-     rect.x = ship_x + (7 * factor);
-     break;
-  case 6:
-     rect.x = ship_x + (-1 * factor);   // "behind" ship
-     break;
-  case 7:
-     rect.x = ship_x + (-1 * factor);
-     break;
-  case 8:
-     rect.x = ship_x + (-1 * factor);
-     break;
-  case 9:
-     rect.x = ship_x + (0 * factor);
-     break;
-  case 10:
-     rect.x = ship_x + (1 * factor);
-     break;
-  case 11:
-     rect.x = ship_x + (2 * factor);
-     break;
+void track_remove(void * p)
+{
+  /* remove p, move the next entries back so lookups need no tombstones */
+  alloc_site_type * site;
+  Uint32 i, j, k;
+
+  if (p == NULL) return;
+  SDL_LockMutex(alloc_lock);
+  i = track_slot(p);
+  if (alloc_slots[i].p == NULL) {           // not allocated by this file
+     SDL_UnlockMutex(alloc_lock);
+     return;
+  }
+  site = &alloc_sites[alloc_slots[i].site];
+  site->live--;
+  site->live_bytes -= alloc_slots[i].bytes;
+  alloc_live--;
+
+  j = i;
+  for (;;) {
+     j = (j + 1) & (TRACK_SLOTS - 1);
+     if (alloc_slots[j].p == NULL) break;
+     k = (Uint32) (((size_t) alloc_slots[j].p >> 4) * 2654435761u) & (TRACK_SLOTS - 1);
+     if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+        alloc_slots[i] = alloc_slots[j];
+        i = j;
+     }
   }
+  alloc_slots[i].p = NULL;
+  SDL_UnlockMutex(alloc_lock);
+}
 
-  if (frame % 2 == 0) { ship_window_step ++; }
-  if (ship_window_step > 11) { ship_window_step = 1;}
 
-  SDL_BlitSurface(images[8], &src_rect, screen, &rect);
+SDL_Surface * track_surface(SDL_Surface * s, const char * what, int line)
+{
+  if (s != NULL) track_add(s, what, line, sizeof(SDL_Surface) + s->pitch * s->h);
+  return s;
 }
 
 
-void setup_shield_bits()
+void track_free_surface(SDL_Surface * s)
 {
-  int i;
-  
-  for (i = 0; i < SHIELD_BITS ; i++)  
-  {
-      shield_bits[i].status = 1;                     // initial recharching
-      shield_bits[i].timer_bit = SHIELD_BIT_TIMER;   // recharching timer
-      shield_bits[i].img_white = 10;                 // initial pixel bit color
-      shield_bits[i].img_grey = 9;                   // initial pixel bit color
-      shield_bits[i].img_blue = 7;                   // initial pixel bit color
-      shield_bits[i].gun = 0;                        // gun bit
-  }
-  shield_bits[gun_bit].gun = 1;   // gun bit
-  play_sound(0, 0);
+  track_remove(s);
+  (SDL_FreeSurface)(s);
 }
 
 
-void handle_shield_bits()
+void * track_malloc(size_t n, int line)
 {
-  int i, j, found;
-  int active_shield_bits, sound_needed;
-  
-  // recharge sound if delay is set
-  if (recharge_sound_delay == 1) {
-     play_sound(0,0);
-     recharge_sound_delay = 0;
-  }
+  void * p = (malloc)(n);
 
-  if (recharge_sound_delay >= 1) recharge_sound_delay--;
+  track_add(p, "malloc", line, n);
+  return p;
+}
 
-  /* recharching of shield bit only if no bullets alive */
-  /* Find a slot: */
-  found = -1;
-  for (i = 0; i < MAX_BULLETS && found == -1; i++) {
-     if (bullets[i].alive == 1)
-        found = i;
-  }
 
-  if (found != -1) {
-    ; //printf("-- bullets alive\n");    // no recharching possible 
-  } else {
-      // printf("-- no bullets alive, check if recharching needed\n"); 
-      sound_needed = 0;
-      // loop shield bits
-      active_shield_bits = 0;
-      for (j = 0; j < SHIELD_BITS; j++)
+void track_free(void * p)
+{
+  track_remove(p);
+  (free)(p);
+}
+
+
+void track_frame()
+{
+  /* end of a frame (title or game): after the warm-up nothing may stay
+     allocated (with --alloc-check) */
+  int i;
+
+  alloc_frames++;
+  if (alloc_frames == TRACK_WARMUP) {
+     alloc_base_live = alloc_live;
+     for (i = 0; i < num_alloc_sites; i++)
+        alloc_sites[i].base_live = alloc_sites[i].live;
+  }
+  if (alloc_check == 1 && alloc_frames > TRACK_WARMUP && alloc_live > alloc_base_live) {
+     fprintf(stderr, "Allocation check failed: %u allocations more than after frame %d\n",
+             alloc_live - alloc_base_live, TRACK_WARMUP);
+     for (i = 0; i < num_alloc_sites; i++)
+        if (alloc_sites[i].live > alloc_sites[i].base_live)
+           fprintf(stderr, "  line %5d %-22s %u more\n", alloc_sites[i].line,
+                   alloc_sites[i].what, alloc_sites[i].live - alloc_sites[i].base_live);
+     exit(1);
+  }
+}
+
+
+void track_report()
+{
+  /* live surfaces and memory and the allocations per frame of every site */
+  alloc_site_type * site;
+  Uint32 surfaces = 0, blocks = 0, allocs = 0;
+  Uint64 surface_bytes = 0, block_bytes = 0;
+  int i;
+
+  for (i = 0; i < num_alloc_sites; i++) {
+     site = &alloc_sites[i];
+     allocs += site->allocs;
+     if (strcmp(site->what, "malloc") == 0) {
+        blocks += site->live;
+        block_bytes += site->live_bytes;
+     } else {
+        surfaces += site->live;
+        surface_bytes += site->live_bytes;
+     }
+  }
+  printf("Allocations: %u live surfaces (%u KB), %u live blocks (%u KB), %.2f allocations per frame\n",
+         surfaces, (Uint32) (surface_bytes / 1024), blocks, (Uint32) (block_bytes / 1024),
+         alloc_frames > 0 ? (double) allocs / alloc_frames : 0.0);
+  printf("  line  function                 allocs  per frame   live  live KB\n");
+  for (i = 0; i < num_alloc_sites; i++) {
+     site = &alloc_sites[i];
+     printf("  %5d %-22s %8u %10.2f %6u %8u\n", site->line, site->what, site->allocs,
+            alloc_frames > 0 ? (double) site->allocs / alloc_frames : 0.0,
+            site->live, (Uint32) (site->live_bytes / 1024));
+  }
+}
+#endif
+
+
+void init_game()
+{
+  frame = 0;
+  bullet_frame = 0;
+  ship_dying = 0;
+  ship_destroyed = 0;
+  high_score_broken = 0;
+  high_score_registration = 0;
+
+  start_new_game();
+  recharge_sound_delay = 0;  // initially off; no recharge delay
+}
+
+
+void game_frame(int draw)
+{
+  /* one frame of the game after the input: move, collide and draw. With
+     draw == 0 nothing is drawn, the game itself is the same (batch runner) */
+  if (draw) draw_stars();
+  PROF(PROF_STARS);
+  if (ship_dying == 0) {
+     if (draw) draw_ship();
+     handle_ship_window();
+  }
+  if (ship_dying == 1 && ship_destroyed == 0) {
+     if (draw) draw_ship_explosions();
+     handle_ship_explosions();
+  }
+  if (ship_dying == 0) handle_shield_bits();
+  if (ship_dying == 0 && draw) draw_shield_bits();
+  PROF(PROF_SHIP);
+  handle_bullets();
+  if (draw) draw_bullets();
+  PROF(PROF_BULLETS);
+  handle_lasers();
+  if (draw) draw_lasers();
+  PROF(PROF_LASERS);
+  handle_asteroids();
+  if (random_nr(RNG_SPAWN, ASTEROID_RANDOMNESS) == 1 ) add_asteroid(); 
+  if (draw) draw_asteroids();
+  handle_asteroid_shapes();
+  PROF(PROF_ASTEROIDS);
+
+  handle_ufo();
+  if (draw) draw_ufo();
+  handle_ufo_explosions();
+  PROF(PROF_UFO);
+
+  build_collision_world();
+  if (ship_dying == 0) check_bullet_hit();    
+  if (ship_dying == 0) check_ship_collision();
+  if (ship_dying ==0 ) check_laser_hit();
+  if (ship_dying == 0) check_colliding_asteroids();
+  PROF(PROF_COLLISION);
+  resolve_events();
+  PROF(PROF_RESOLVE);
+  handle_mini_explosions();
+  if (draw) draw_mini_explosions();
+  PROF(PROF_EXPLOSIONS);
+  check_asteroid_positions();
+  PROF(PROF_COLLISION);
+  if (draw) draw_score_line(); 
+  handle_high_score_flash();
+  PROF(PROF_SCORE);
+}
+
+
+void setup(void)
+{
+  int i;
+  char title_string[100];
+
+  STARTUP("init");       // arguments, threads
+
+  /* Init SDL Video: */
+  if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+      fprintf(stderr,
+              "\nError: I could not initialize video!\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", SDL_GetError());
+      exit(1);
+    }
+
+  /* enable console output in Windows */
+  #ifdef _WIN32
+  freopen("CON", "w", stdout); // redirects stdout
+  freopen("CON", "w", stderr); // redirects stderr
+  #endif
+
+
+  /* get monitor resolution */
+  d_monitor = SDL_GetVideoInfo();
+  monitor_width  = d_monitor->current_w;
+  monitor_height = d_monitor->current_h;
+  printf("Max monitor resolution w, h: %d, %d \n", monitor_width, monitor_height);
+   
+  /* define factor */
+  if (monitor_height >= 1080) factor = 5;   // 1080p and higer
+  if (monitor_height <= 768)  factor = 3;   // 768p and lower
+  if (start_factor > 0) factor = start_factor;
+  printf("Factor is: %d \n", factor);
+  screen_width  = VIDEOPAC_RES_W * factor;
+  screen_height = VIDEOPAC_RES_H * factor;
+
+  /* Open display: */
+      screen = SDL_SetVideoMode(screen_width, screen_height, 0, SDL_HWPALETTE | SDL_ANYFORMAT);
+      if (screen == NULL)
+        {
+          fprintf(stderr,
+                  "\nWarning: I could not set up video for "
+                  "1000x800 mode.\n"
+                  "The Simple DirectMedia error that occured was:\n"
+                  "%s\n\n", SDL_GetError());
+        } 
+  STARTUP("video");
+
+
+   /* Init True Type Font */
+   if (TTF_Init() < 0) 
+   { 
+      fprintf(stderr, "Impossible to initialize SDL_TTF: %s\n",SDL_GetError() );
+      exit(1);
+   }
+   font_size = 12 * factor;
+   font_large = TTF_OpenFont("O2.ttf", font_size);
+   if (!font_large)
+      fprintf(stderr, "Cannot load font name O2.ttf large: %s\n", SDL_GetError());
+
+   font_small = TTF_OpenFont("O2.ttf", font_size/2);
+   if (!font_small)
+      fprintf(stderr, "Cannot load font name O2.ttf small: %s\n", SDL_GetError());
+
+   high_score = 0; 
+   strcpy(high_score_name, "??????");
+   STARTUP("fonts");
+
+
+  setup_joystick();
+  STARTUP("joystick");
+
+  /* Set window manager stuff: */
+  sprintf(title_string, "UFO - factor: %d - difficulty: %d", factor, difficulty);
+  SDL_WM_SetCaption(title_string, "UFO");
+
+  load_images();
+  STARTUP("images");
+  load_masks();
+  STARTUP("masks");
+
+
+  /* Open sound */
+
+  if (Mix_OpenAudio(22050, AUDIO_S16, 1, 1024) < 0) {
+         fprintf(stderr,
+          "\nWarning: I could not set up audio for 22050 Hz "
+          "16-bit stereo.\n"
+          "The Simple DirectMedia error that occured was:\n"
+          "%s\n\n", SDL_GetError());
+          exit(1);
+  }
+        
+  vol_effects = 5;
+  vol_music = 5;
+  
+  Mix_Volume(-1, vol_effects * (MIX_MAX_VOLUME / 5));
+  Mix_VolumeMusic(vol_music * (MIX_MAX_VOLUME / 5));
+
+  Mix_AllocateChannels(32);
+  STARTUP("audio");
+
+ /* Load sounds */
+      
+ for (i = 0; i < NUM_SOUNDS; i++) {
+    TRACE_BEGIN(t);
+    sounds[i] = Mix_LoadWAV(sound_names[i]);
+    TRACE_END(t, "Mix_LoadWAV", sound_names[i]);
+    if (sounds[i] == NULL)
       {
-         if (shield_bits[j].status == 0) {
-            sound_needed = 1;
-            // change from 0 to 1
-            shield_bits[j].status = 1;
-            shield_bits[j].timer_bit = SHIELD_BIT_TIMER;
-         } else if (shield_bits[j].status == 1) {
-
-            ; // handle recharching timer
-            shield_bits[j].timer_bit--;
-            if (shield_bits[j].timer_bit == 0) {
-              // timer 0, set status to 2
-              shield_bits[j].status = 2;
-            }
-         } else {
-            // status == 2, count if all bits are on (active)
-            active_shield_bits++;
-         }   
-      }  // end loop shield bits   
-      if (sound_needed == 1 ) {  // activate recharge and start delay time for respawn sound
-          recharge_sound_delay = 10; 
-          recharge_active = 1;// start time for respawn sound
-          //printf("recharge activated\n");
+        fprintf(stderr,
+          "\nError: I could not load the sound file:\n"
+          "%s\n"
+          "The Simple DirectMedia error that occured was:\n"
+          "%s\n\n", sound_names[i], SDL_GetError());
+        exit(1);
+      }
+    }  
+ STARTUP("sounds");
+}   
+
+
+void setup_joystick()
+{
+  use_joystick = 1;
+  num_joysticks = 0;
+
+  if (SDL_Init(SDL_INIT_JOYSTICK) < 0) {
+      fprintf(stderr,
+        "\nWarning: I could not initialize joystick.\n"
+        "The Simple DirectMedia error that occured was:\n"
+        "%s\n\n", SDL_GetError());
+      
+      use_joystick = 0;
+  }
+  else
+    {
+      /* Look for joysticks */
+      
+      num_joysticks = SDL_NumJoysticks();
+      if (num_joysticks <= 0) {
+         fprintf(stderr, "\nWarning: No joysticks available.\n");
+      use_joystick = 0;
+      }
+      else
+  {
+    /* Open joystick */
+    
+    js = SDL_JoystickOpen(0);
+    if (js == NULL) {
+        fprintf(stderr,
+          "\nWarning: Could not open joystick 1.\n"
+          "The Simple DirectMedia error that occured was:\n"
+          "%s\n\n", SDL_GetError());
+         use_joystick = 0;
+      }
+    else
+      {
+        /* Check for proper stick configuration: */
+        
+        if (SDL_JoystickNumAxes(js) < 2) {
+      fprintf(stderr, "\nWarning: Joystick doesn't have enough axes!\n");
+      use_joystick = 0;
+    }
+        else
+    {
+      if (SDL_JoystickNumButtons(js) < 2) {
+          fprintf(stderr,
+            "\nWarning: Joystick doesn't have enough "
+            "buttons!\n");
+          use_joystick = 0;
+        }
+    }
+    }
+  }
+  }
+
+}
+
+
+void start_new_game() 
+{
+  int i;
+
+  ship_destroyed = 0;
+  ship_dying = 0;
+  death_cause = 0;
+  score = 0;
+  high_score_broken = 0;
+
+
+  ship_x = FIX(VIDEOPAC_RES_W / 2);
+  ship_y = FIX(VIDEOPAC_RES_H / 2);
+  speed = FIX(2);                 // 2 Videopac pixels per frame
+  joy_left = 0;
+  joy_right = 0;
+  joy_up = 0;
+  joy_down = 0;
+  
+  recharge_active = 1;       // initially on at startup
+  recharge_sound_delay = 1;  // initially off; no recharge delay
+
+  gun_bit = 4;                    // initial gun bit position
+  ship_window_step = 1;
+
+  setup_shield_bits();
+
+  /* init bullets off */
+  for (i = 0; i < MAX_BULLETS; i++)
+      bullets[i].alive = 0;
+  bullets_alive = 0;
+
+  /* init asteroids off */
+  for (i = 0; i < MAX_ASTEROIDS; i++)
+      asteroids[i].status = 0;
+
+  /* init mini_explosions off */
+  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
+      mini_explosions[i].alive = 0;
+
+  /* init ufo off */
+  for (i = 0; i < MAX_UFOS; i++)
+      ufo[i].status = 0;
+
+  /* init ufo laser off */
+  for (i = 0; i < MAX_LASERS; i++) {
+      laser[i].alive = 0;
+      laser[i].fired_by_ufo = -1;
+  }    
+  ufo_start_delay = frame;
+
+  if (headless == 0) printf("New game\n");
+}
+
+
+void setup_ship_explosions()
+{
+  int i, j;
+
+  for (j = 0; j < 4; j++) {  // 4/8: first 4 color cycls, 
+                             // green, blue, cyan, grey, groen, blauw, cyan grey
+                             //    1    2      3    4     5      6      7    8
+
+
+    for (i = 0; i < 9; i++) {  // first 9 animation sets 1 color
+       if (i < 4) { ship_explosions[i+(j*9)].img_nr = (39 + i) + (j * 4);
+       } else {     ship_explosions[i+(j*9)].img_nr = 0; }
+
+       ship_explosions[i+(j*9)].ship_nr  = 55 + j;         
+       ship_explosions[i+(j*9)].color_nr = j + 1 ;     // green
+     }    
+  }
+
+
+  for (j = 0; j < 4; j++) {  // 4/8: last 4 color cycls, 
+                             // green, blue, cyan, grey, groen, blauw, cyan grey 
+                             //    1    2      3    4     5      6      7    8
+
+
+    for (i = 0; i < 9; i++) {  // first 9 animation sets 1 color
+       if (i < 4) { ship_explosions[i+(j*9) + 36].img_nr = (39 + i) + (j * 4);
+       } else {     ship_explosions[i+(j*9) + 36].img_nr = 0; }
+
+       ship_explosions[i+(j*9) + 36].ship_nr  = 55 + j;         
+       ship_explosions[i+(j*9) + 36].color_nr = j + 1 ;     // green
+     }    
+  }
+
+  /* make duplicate of all above explosions */
+
+  for (i = 0; i < 36; i++) {
+     ship_explosions[72 + i].img_nr   = ship_explosions[i].img_nr;
+     ship_explosions[72 + i].ship_nr  = ship_explosions[i].ship_nr;
+     ship_explosions[72 + i].color_nr = ship_explosions[i].color_nr;
+  }
+
+  /* last animation, no ship, no explosion, only bullets (grey) */
+  for (i = 108; i < 115; i++) {  
+     ship_explosions[i].img_nr   = 0;
+     ship_explosions[i].ship_nr  = 0;         
+     ship_explosions[i].color_nr = 4;     // grey
+  }    
+}
+
+
+void load_images(void)
+{
+  int i;
+  char image_string[200];
+  char temp_string[200];
+  SDL_Surface * image;
+
+
+  for (i = 0; i <  NUM_IMAGES; i++)  
+  {
+    TRACE_BEGIN(t);
+    if (i == 5                             // ship image
+         || (i >= 11 && i <= 38)           // asteroids + mini exp.
+         || (i >= 55 && i <= 58)           // ship color
+         || (i >= 39 && i <= 54)           // ship explosions 
+         || (i >= 63 && i <= 71)) {        // ufo, lasers
+      
+      // load factor image                    + ship explosion
+      sprintf(image_string, "%s", image_names[i] );
+      sprintf(temp_string, "%d", factor);
+      strcat(image_string, temp_string);
+      strcat(image_string, ".bmp");
+
+      image = SDL_LoadBMP(image_string);
+    } else {  
+        strcpy(image_string, image_names[i] );
+        image = SDL_LoadBMP(image_string);
+    }
+
+    if (image == NULL)
+    {
+      fprintf(stderr,
+        "\nError: I couldn't load a graphics file:\n"
+        "%s\n"
+        "The Simple DirectMedia error that occured was:\n"
+        "%s\n\n", image_string, SDL_GetError());
+      exit(1);
+    }
+      
+    /* Convert to display format (after a resize: free the old size) */
+    SDL_FreeSurface(images[i]);
+    images[i] = SDL_DisplayFormat(image);
+    SDL_FreeSurface(image);
+    if (images[i] == NULL)
+    {
+        fprintf(stderr,
+                "\nError: I couldn't convert a file to the display format:\n"
+                "%s\n"
+                "The Simple DirectMedia error that occured was:\n"
+                "%s\n\n", image_names[i], SDL_GetError());
+        exit(1);
+    }
+
+    /* Set transparency: */
+    if (i != 10)       // do not set transparency for white gun bit and bullets
+    {  
+       if (SDL_SetColorKey(images[i], (SDL_SRCCOLORKEY | SDL_RLEACCEL),
+               SDL_MapRGB(images[i] -> format,
+               0xFF, 0xFF, 0xFF)) == -1)
+        {
+           fprintf(stderr,
+             "\nError: I could not set the color key for the file:\n"
+             "%s\n"
+             "The Simple DirectMedia error that occured was:\n"
+             "%s\n\n", image_names[i], SDL_GetError());
+           exit(1);
+        }
+    }
+    TRACE_END(t, "load_image", image_names[i]);
+
+  }  // end for loop
+}  
+
+
+void load_masks(void)
+{
+  int i, x, y, k, bpp, first, last;
+  char image_string[200];
+  SDL_Surface * image;
+  Uint8 * p;
+  Uint32 pixel;
+  Uint8 r, g, b;
+
+  /* make 1 bit collision masks of the factor 1 images, white is transparent */
+  for (i = 0; i < MASK_BULLET; i++)
+  {
+    sprintf(image_string, "%s1.bmp", image_names[mask_images[i]]);
+    image = SDL_LoadBMP(image_string);
+    if (image == NULL)
+    {
+      fprintf(stderr,
+        "\nError: I couldn't load a graphics file:\n"
+        "%s\n"
+        "The Simple DirectMedia error that occured was:\n"
+        "%s\n\n", image_string, SDL_GetError());
+      exit(1);
+    }
+    if (image->w > 64 || image->h > MASK_ROWS)
+    {
+      fprintf(stderr, "\nError: image too large for collision mask:\n%s\n\n", image_string);
+      exit(1);
+    }
+
+    masks[i].x = 0;
+    masks[i].y = 0;
+    masks[i].w = image->w;
+    masks[i].h = image->h;
+
+    if (SDL_MUSTLOCK(image)) SDL_LockSurface(image);
+    bpp = image->format->BytesPerPixel;
+    for (y = 0; y < image->h; y++) {
+      masks[i].row[y] = 0;
+      for (x = 0; x < image->w; x++) {
+        p = (Uint8 *) image->pixels + y * image->pitch + x * bpp;
+        switch (bpp) {
+          case 1:  pixel = *p; break;
+          case 2:  pixel = *(Uint16 *) p; break;
+          case 3:  pixel = p[0] | (p[1] << 8) | (p[2] << 16); break;   // little endian bmp
+          default: pixel = *(Uint32 *) p; break;
+        }
+        SDL_GetRGB(pixel, image->format, &r, &g, &b);
+        if (r != 0xFF || g != 0xFF || b != 0xFF)
+          masks[i].row[y] |= (Uint64) 1 << x;
+      }
+    }
+    if (SDL_MUSTLOCK(image)) SDL_UnlockSurface(image);
+    SDL_FreeSurface(image);
+  }
+
+  /* bullet and explosion bit: 1 pixel */
+  masks[MASK_BULLET].x = 0;
+  masks[MASK_BULLET].y = 0;
+  masks[MASK_BULLET].w = 1;
+  masks[MASK_BULLET].h = 1;
+  masks[MASK_BULLET].row[0] = 1;
+
+  /* shield: ship with the 15 shield bits around it (same positions as the
+     guns) and everything in between filled. The shield starts 4 pixels left
+     and above the ship */
+  masks[MASK_SHIELD].x = -4;
+  masks[MASK_SHIELD].y = -4;
+  masks[MASK_SHIELD].w = SHIP_W + 7;
+  masks[MASK_SHIELD].h = SHIP_H + 6;
+  for (y = 0; y < masks[MASK_SHIELD].h; y++) {
+    /* leftmost and rightmost shield bit on this row (or the rows next to it) */
+    first = 64;
+    last = -1;
+    for (k = 0; k < SHIELD_BITS; k++) {
+       if (gun_start[k][1] + 4 == y) {
+         if (gun_start[k][0] + 4 < first) first = gun_start[k][0] + 4;
+         if (gun_start[k][0] + 4 > last)  last  = gun_start[k][0] + 4;
+       }
+    }
+    if (last == -1) {
+      for (k = 0; k < SHIELD_BITS; k++) {
+         if (abs(gun_start[k][1] + 4 - y) == 1) {
+           if (gun_start[k][0] + 4 < first) first = gun_start[k][0] + 4;
+           if (gun_start[k][0] + 4 > last)  last  = gun_start[k][0] + 4;
+         }
+      }
+    }
+    masks[MASK_SHIELD].row[y] = 0;
+    for (x = first; x <= last; x++)
+      masks[MASK_SHIELD].row[y] |= (Uint64) 1 << x;
+    if (y >= 4 && y < 4 + SHIP_H)
+      masks[MASK_SHIELD].row[y] |= masks[MASK_SHIP].row[y - 4] << 4;
+  }
+}
+
+
+int get_user_input()
+{
+  SDL_Event event;
+    Uint8* keystate = SDL_GetKeyState(NULL);
+    int window_size_changed = 0;
+    int keys;
+    SDLKey key;
+
+  /* Loop through waiting messages and process them */
+  
+  while (SDL_PollEvent(&event))
+  {
+    if (latency_on) latency_event(&event);
+
+    /* keys of the input injector do not change the key state */
+    if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && event.key.which == INJECT_DEVICE) {
+      key = event.key.keysym.sym;
+      keys = (key == SDLK_LEFT) ? INPUT_LEFT : (key == SDLK_RIGHT) ? INPUT_RIGHT :
+             (key == SDLK_UP) ? INPUT_UP : (key == SDLK_DOWN) ? INPUT_DOWN : 0;
+      if (event.type == SDL_KEYDOWN) {
+        inject_keys |= keys;
+      } else {
+        inject_keys &= ~keys;
+      }
+    }
+
+    switch (event.type)
+    {
+      /* Closing the Window will exit the program */
+      case SDL_QUIT:   // close window
+        exit(0);
+      break;
+
+      case SDL_KEYDOWN:
+
+        if (event.key.keysym.sym == SDLK_ESCAPE ) {
+            printf("--key escape\n");   // return to instructions
+            if (rec_f != NULL) record_frame(REC_QUIT);
+            start_new_game();           // clear all objects
+            return(1);
+        } else {
+          // Handle decrease / enlarge window (keypad + -), once per key press
+          if (full_screen == 0 && ship_dying != 1) {
+             key = event.key.keysym.sym;
+             if (key == SDLK_KP_MINUS || key == SDLK_LEFTBRACKET || key == 57) { // decrease windows size
+               if (factor > 1) {
+                 window_size_changed = 1;
+                 factor --;
+                 }
+             }
+             if (key == SDLK_KP_PLUS || key == SDLK_RIGHTBRACKET || key == 48) { // increase windows size
+               if (factor < 9) {
+                 window_size_changed = 1;
+                 factor ++;
+                 }
+             }
+          }
+          if (event.key.keysym.sym == 56 && ship_dying != 1) { // toggle full_screen: 8 key
+             window_size_changed = 1;
+             if (full_screen == 1) {
+                full_screen = 0;
+             } else { 
+                full_screen = 1;
+             }
+             if (monitor_height >= 1080) factor = 5;   // 1080p and higer
+             if (monitor_height  <= 768)  factor = 3;   // 768p and lower
+             screen_width  =  factor * VIDEOPAC_RES_W;           
+             screen_height =  factor * VIDEOPAC_RES_H;
+          }
+
+#ifndef NO_PROFILER
+          if (event.key.keysym.sym == SDLK_F3) {    // profiler overlay on/off
+             prof_overlay = 1 - prof_overlay;
+             if (prof_overlay == 1 && prof_on == 0) prof_start();
+          }
+          if (event.key.keysym.sym == SDLK_F4 && trace_on) {   // write trace so far
+             write_trace();
+          }
+#endif
+          if (event.key.keysym.sym == SDLK_F5) print_frame_stats();
+          if (event.key.keysym.sym == SDLK_F7 && perf_on) print_perf_stats();
+          if (event.key.keysym.sym == SDLK_F8) save_snapshot_file(SNAPSHOT_FILE);
+          if (event.key.keysym.sym == SDLK_F9 && rec_f == NULL && replay_file == NULL)
+             load_snapshot_file(SNAPSHOT_FILE);
+#ifdef TRACK_ALLOCS
+          if (event.key.keysym.sym == SDLK_F6) track_report();
+#endif
+
+          if ( (event.key.keysym.sym >= 97 && event.key.keysym.sym <= 122)
+                 || event.key.keysym.sym == 32 || event.key.keysym.sym == 13) {    // spatie, return
+            if (high_score_registration == 1 && replay_file == NULL) {
+              print_high_score_char(event.key.keysym.sym);
+              if (rec_f != NULL && rec_num_chars < (int) sizeof(rec_chars))
+                 rec_chars[rec_num_chars++] = event.key.keysym.sym;
+            } 
+          }
+        }
+      break;
+
+      case SDL_JOYBUTTONDOWN:
+          if (  (event.jbutton.button == 0 || event.jbutton.button == 1)
+                && ship_dying != 1 && replay_file == NULL
+             ) {
+             //printf("Fire button presed\n");
+             fire_button();
+             rec_button = 1;
+          }
+      break;
+
+      case SDL_JOYAXISMOTION:
+        //If joystick 0 has moved
+        if ( event.jaxis.which == 0 ) {
+            //If the X axis changed
+            if ( event.jaxis.axis == 0 ) {
+                //If the X axis is neutral
+                if ( ( event.jaxis.value > -8000 ) && ( event.jaxis.value < 8000 ) ) {
+                     joy_left = 0;
+                     joy_right = 0;
+                } else {
+                    //Adjust the velocity
+                    if ( event.jaxis.value < 0 ) {
+                        joy_left = 1;
+                        joy_right = 0;
+                    } else {
+                        joy_left = 0;
+                        joy_right = 1;
+                    }
+                }
+            }
+            //If the Y axis changed
+            else if ( event.jaxis.axis == 1 ) {
+                //If the Y axis is neutral
+                if ( ( event.jaxis.value > -8000 ) && ( event.jaxis.value < 8000 ) ) {
+                     joy_up = 0;
+                     joy_down = 0;
+                } else {
+                    //Adjust the velocity
+                    if ( event.jaxis.value < 0 ) {
+                     joy_up = 1;
+                     joy_down = 0;
+                    } else {
+                        joy_up = 0;
+                        joy_down = 1;
+                    }
+                }
+            }
+        }   // if event.jaxis.which == 0      
+      break;      
+
+    }  // end switch
+  }    // end while
+
+  /* game objects are in Videopac coordinates, so the resize keeps them */
+  if (window_size_changed == 1) 
+        handle_screen_resize();
+
+
+   /* Check continuous-response keys , works even for diagonals ! */
+   keys = inject_keys;
+   if (keystate[SDLK_LEFT] || joy_left == 1)   keys |= INPUT_LEFT;
+   if (keystate[SDLK_RIGHT] || joy_right == 1) keys |= INPUT_RIGHT;
+   if (keystate[SDLK_UP] || joy_up == 1)       keys |= INPUT_UP;
+   if (keystate[SDLK_DOWN] || joy_down == 1)   keys |= INPUT_DOWN;
+   if (keystate[SDLK_LCTRL] || keystate[SDLK_RCTRL]) keys |= INPUT_FIRE;
+   if (replay_file != NULL) {
+      if (replay_input(&keys) == 1) return(1);
+   } else if (rec_f != NULL) {
+      record_frame(keys);
+   }
+   handle_ship_input(keys);
+
+ return(0);
+
+}
+
+
+
+void handle_ship_input(int keys)
+{
+   /* move ship, rotate gun and fire for the keys held down (INPUT_...) */
+   int rotate_gun = 0;
+
+   if (keys & INPUT_LEFT) {
+       if (ship_dying == 0) ship_x = ship_x - speed; 
+       rotate_gun = 1;
+   }
+   if (keys & INPUT_RIGHT) { 
+       if (ship_dying == 0) ship_x = ship_x + speed; 
+       rotate_gun = 1;
+   }
+   if (keys & INPUT_UP) { 
+       if (ship_dying == 0) ship_y = ship_y - speed; 
+       rotate_gun = 1;
+   }    
+   if (keys & INPUT_DOWN) { 
+       if (ship_dying == 0) ship_y = ship_y + speed; 
+       rotate_gun = 1;
+   }
+
+   if (rotate_gun == 1 && ship_dying != 1) { rotate_gun_bit();}
+
+   if (ship_x < 0) { ship_x = 0; }
+   if (ship_y < 0) { ship_y = 0; }
+   if (ship_x + FIX(SHIP_W) > FIX(VIDEOPAC_RES_W))  
+      { ship_x = FIX(VIDEOPAC_RES_W - SHIP_W); }   // depending on screen size and ship width
+   if (ship_y + FIX(SHIP_H) > FIX(VIDEOPAC_RES_H)) 
+      { ship_y = FIX(VIDEOPAC_RES_H - SHIP_H); }   // depending on screen size and ship height
+
+   /* handle fire key */
+   if ( (keys & INPUT_FIRE) && ship_dying != 1 ) fire_button();
+}
+
+
+void fire_button()
+{
+   // prevent bullets fired to soon after each other
+   if (frame - bullet_frame >= 5) {
+     add_bullet (ship_x, ship_y);
+     bullet_frame = frame;
+   }
+}
+
+
+void start_recording()
+{
+  /* header: version, seed, difficulty, factor, frames and hash_state() at
+     the end (written by stop_recording()), high score and the state of
+     the random streams at the start of the game */
+  char file[1024];
+  int i, j;
+
+  rec_games++;
+  if (rec_games == 1) {
+     snprintf(file, sizeof(file), "%s", record_file);
+  } else {
+     snprintf(file, sizeof(file), "%s.%d", record_file, rec_games);
+  }
+  rec_f = fopen(file, "wb");
+  if (rec_f == NULL) {
+     fprintf(stderr, "Cannot create %s: %s\n", file, strerror(errno));
+     exit(1);
+  }
+  fwrite("UFOREC1", 8, 1, rec_f);
+  put_uint32(rec_f, rng_seed);
+  put_uint32(rec_f, difficulty);
+  put_uint32(rec_f, factor);
+  put_uint32(rec_f, 0);                  // frames
+  put_uint32(rec_f, 0);                  // hash, low and high half
+  put_uint32(rec_f, 0);
+  put_uint32(rec_f, high_score);
+  fwrite(high_score_name, 7, 1, rec_f);
+  fputc(0, rec_f);                       // spare
+  for (i = 0; i < NUM_RNG_STREAMS; i++)
+     for (j = 0; j < 4; j++)
+        put_uint32(rec_f, rng_state[i][j]);
+  rec_frame = 0;
+  rec_keys = 0;
+  rec_button = 0;
+  rec_num_chars = 0;
+  clear_objects();                       // nothing left of the game before
+  printf("Recording to %s\n", file);
+}
+
+
+void record_frame(int input)
+{
+  /* a record for every frame in which the keys change or a button or
+     character is pressed: frames since the last record (7 bits per byte,
+     high bit: more bytes follow), the input byte, a character. Repeats
+     with delta 0 for more characters in one frame */
+  Uint32 delta;
+  int i = 0, b;
+
+  if (rec_button) input |= REC_BUTTON;
+  if (input == rec_keys && rec_num_chars == 0) return;
+  do {
+     for (delta = frame - rec_frame; delta >= 128; delta = delta >> 7)
+        fputc((delta & 127) | 128, rec_f);
+     fputc(delta, rec_f);
+     rec_frame = frame;
+     b = input | (i < rec_num_chars ? REC_CHAR : 0);
+     fputc(b, rec_f);
+     if (b & REC_CHAR) fputc(rec_chars[i], rec_f);
+     input = input & ~REC_BUTTON;        // once
+     i++;
+  } while (i < rec_num_chars);
+  rec_keys = input & ~REC_QUIT;
+  rec_button = 0;
+  rec_num_chars = 0;
+}
+
+
+void stop_recording()
+{
+  /* frames and hash of the state at the end in the header (the game ends
+     with Escape or by closing the window) */
+  Uint64 h = hash_state();
+
+  fseek(rec_f, 20, SEEK_SET);
+  put_uint32(rec_f, frame);
+  put_uint32(rec_f, (Uint32) h);
+  put_uint32(rec_f, (Uint32) (h >> 32));
+  fclose(rec_f);
+  rec_f = NULL;
+  printf("Recorded %d frames, score %d\n", frame, score);
+}
+
+
+void start_replay()
+{
+  /* the game of the file: same difficulty, high score and random streams */
+  FILE * f;
+  int i, j;
+
+  f = fopen(replay_file, "rb");
+  if (f == NULL) {
+     fprintf(stderr, "Cannot open %s: %s\n", replay_file, strerror(errno));
+     exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  replay_size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  replay_data = malloc(replay_size + 1);
+  if (replay_data == NULL) {
+     fprintf(stderr, "Out of memory\n");
+     exit(1);
+  }
+  if (replay_size < REC_HEADER || fread(replay_data, replay_size, 1, f) != 1 ||
+      memcmp(replay_data, "UFOREC1", 8) != 0 ||
+      get_uint32(replay_data + 12) < 1 || get_uint32(replay_data + 12) > 3 ||      // difficulty
+      get_uint32(replay_data + 16) < 1 || get_uint32(replay_data + 16) > 9) {      // factor
+     fprintf(stderr, "%s is not a recording (--record)\n", replay_file);
+     exit(1);
+  }
+  fclose(f);
+
+  rng_seed = get_uint32(replay_data + 8);
+  set_difficulty(get_uint32(replay_data + 12));
+  if (factor != (int) get_uint32(replay_data + 16)) {
+     factor = get_uint32(replay_data + 16);
+     handle_screen_resize();
+  }
+  replay_frames = get_uint32(replay_data + 20);
+  replay_hash = get_uint32(replay_data + 24) | (Uint64) get_uint32(replay_data + 28) << 32;
+  high_score = get_uint32(replay_data + 32);
+  memcpy(high_score_name, replay_data + 36, 7);
+  high_score_name[6] = 0;
+  for (i = 0; i < NUM_RNG_STREAMS; i++)
+     for (j = 0; j < 4; j++)
+        rng_state[i][j] = get_uint32(replay_data + 44 + (i * 4 + j) * 4);
+  clear_objects();
+  replay_pos = REC_HEADER;
+  rec_frame = 0;
+  replay_next = -1;
+  replay_keys = 0;
+  printf("Replay of %s: seed %u, difficulty %d, %u frames\n", replay_file, rng_seed,
+         difficulty, replay_frames);
+}
+
+
+int replay_input(int * keys)
+{
+  /* the input of this frame from the file, 1: the game ends here */
+  Uint32 delta;
+  int b, shift;
+
+  while (replay_pos < replay_size) {
+     if (replay_next < 0) {               // read the frame of the next record
+        delta = 0;
+        shift = 0;
+        do {
+           b = replay_data[replay_pos++];
+           delta |= (Uint32) (b & 127) << shift;
+           shift += 7;
+        } while ((b & 128) && replay_pos < replay_size);
+        replay_next = rec_frame + delta;
+     }
+     if (replay_next != frame || replay_pos >= replay_size) break;
+
+     rec_frame = replay_next;
+     replay_next = -1;
+     b = replay_data[replay_pos++];
+     if ((b & REC_BUTTON) && ship_dying != 1) fire_button();
+     if ((b & REC_CHAR) && replay_pos < replay_size)
+        print_high_score_char(replay_data[replay_pos++]);
+     replay_keys = b & 31;
+     if (b & REC_QUIT) {
+        start_new_game();
+        return(1);
+     }
+  }
+  if ((Uint32) frame >= replay_frames) end_replay();   // the window was closed here
+  *keys = replay_keys;
+  return(0);
+}
+
+
+void end_replay()
+{
+  /* the same game when it ends at the same frame with the same state */
+  if ((Uint32) frame == replay_frames && hash_state() == replay_hash) {
+     printf("Replay: the same game (%d frames, score %d)\n", frame, score);
+     exit(0);
+  }
+  printf("Replay: differs from the recording at the end (frame %d of %u, score %d)\n",
+         frame, replay_frames, score);
+  exit(1);
+}
+
+
+
+int save_snapshot(void * buffer, int size)
+{
+  /* the game state into buffer: bytes used, or -1 when size is too small */
+  snapshot_type * snap = buffer;
+  int used = sizeof(snapshot_type) + MAX_ASTEROIDS * sizeof(asteroid_type);
+
+  if (size < used) return -1;
+  memcpy(snap->magic, "UFOS", 4);
+  snap->version = SNAPSHOT_VERSION;
+  snap->size = sizeof(snapshot_type);
+  snap->num_asteroids = MAX_ASTEROIDS;
+  snap->difficulty = difficulty;
+  snap->max_ufos = MAX_UFOS;
+  snap->max_lasers = MAX_LASERS;
+  snap->ufo_randomness = UFO_RANDOMNESS;
+  snap->asteroid_randomness = ASTEROID_RANDOMNESS;
+  snap->ship_x = ship_x;
+  snap->ship_y = ship_y;
+  snap->speed = speed;
+  snap->gun_bit = gun_bit;
+  snap->ship_window_step = ship_window_step;
+  snap->ship_explosion_nr = ship_explosion_nr;
+  snap->ship_dying = ship_dying;
+  snap->ship_destroyed = ship_destroyed;
+  snap->bullet_frame = bullet_frame;
+  snap->recharge_active = recharge_active;
+  snap->recharge_sound_delay = recharge_sound_delay;
+  snap->high_score_broken = high_score_broken;
+  snap->high_score_registration = high_score_registration;
+  snap->high_score_character_pos = high_score_character_pos;
+  snap->score = score;
+  snap->high_score = high_score;
+  snap->flash_high_score_timer = flash_high_score_timer;
+  snap->frame = frame;
+  snap->ufo_start_delay = ufo_start_delay;
+  snap->death_cause = death_cause;
+  snap->bullets_alive = bullets_alive;
+  snap->joy_left = joy_left;
+  snap->joy_right = joy_right;
+  snap->joy_up = joy_up;
+  snap->joy_down = joy_down;
+  snap->bot_keys = bot_keys;
+  snap->bot_timer = bot_timer;
+  memcpy(snap->high_score_name, high_score_name, sizeof(high_score_name));
+  snap->high_score_name[7] = 0;
+  memcpy(snap->rng_state, rng_state, sizeof(rng_state));
+  snap->shield_up = shield_up;
+  snap->shield_charging = shield_charging;
+  memcpy(snap->shield_timer, shield_timer, sizeof(shield_timer));
+  memcpy(snap->bullets, bullets, sizeof(bullets));
+  memcpy(snap->mini_explosions, mini_explosions, sizeof(mini_explosions));
+  memcpy(snap->ufo, ufo, sizeof(ufo));
+  memcpy(snap->laser, laser, sizeof(laser));
+  memcpy(snap + 1, asteroids, MAX_ASTEROIDS * sizeof(asteroid_type));
+  return used;
+}
+
+
+int restore_snapshot(const void * buffer, int size)
+{
+  /* the game state from buffer: 0, or -1 when it is not a snapshot of
+     this version and build (the state is not changed then) */
+  const snapshot_type * snap = buffer;
+  int old_max = MAX_ASTEROIDS;
+
+  if (size < (int) sizeof(snapshot_type) || memcmp(snap->magic, "UFOS", 4) != 0 ||
+      snap->version != SNAPSHOT_VERSION || snap->size != sizeof(snapshot_type) ||
+      snap->num_asteroids > ASTEROID_SLOTS ||
+      size < (int) (sizeof(snapshot_type) + snap->num_asteroids * sizeof(asteroid_type)))
+     return -1;
+  /* values used as array index (a corrupt or edited file) */
+  if (snap->difficulty < 1 || snap->difficulty > 3 ||
+      snap->max_ufos < 0 || snap->max_ufos > 3 || snap->max_lasers < 0 || snap->max_lasers > 3 ||
+      snap->gun_bit < 0 || snap->gun_bit >= SHIELD_BITS ||
+      snap->ship_explosion_nr < 0 || snap->ship_explosion_nr >= SHIP_EXPLOSIONS ||
+      snap->high_score_character_pos < 0 || snap->high_score_character_pos > 6 ||
+      memchr(snap->high_score_name, 0, 7) == NULL)
+     return -1;
+
+  difficulty = snap->difficulty;
+  MAX_UFOS = snap->max_ufos;
+  MAX_LASERS = snap->max_lasers;
+  MAX_ASTEROIDS = snap->num_asteroids;
+  UFO_RANDOMNESS = snap->ufo_randomness;
+  ASTEROID_RANDOMNESS = snap->asteroid_randomness;
+  ship_x = snap->ship_x;
+  ship_y = snap->ship_y;
+  speed = snap->speed;
+  gun_bit = snap->gun_bit;
+  ship_window_step = snap->ship_window_step;
+  ship_explosion_nr = snap->ship_explosion_nr;
+  ship_dying = snap->ship_dying;
+  ship_destroyed = snap->ship_destroyed;
+  bullet_frame = snap->bullet_frame;
+  recharge_active = snap->recharge_active;
+  recharge_sound_delay = snap->recharge_sound_delay;
+  high_score_broken = snap->high_score_broken;
+  high_score_registration = snap->high_score_registration;
+  high_score_character_pos = snap->high_score_character_pos;
+  score = snap->score;
+  high_score = snap->high_score;
+  flash_high_score_timer = snap->flash_high_score_timer;
+  frame = snap->frame;
+  ufo_start_delay = snap->ufo_start_delay;
+  death_cause = snap->death_cause;
+  bullets_alive = snap->bullets_alive;
+  joy_left = snap->joy_left;
+  joy_right = snap->joy_right;
+  joy_up = snap->joy_up;
+  joy_down = snap->joy_down;
+  bot_keys = snap->bot_keys;
+  bot_timer = snap->bot_timer;
+  memcpy(high_score_name, snap->high_score_name, sizeof(high_score_name));
+  memcpy(rng_state, snap->rng_state, sizeof(rng_state));
+  shield_up = snap->shield_up;
+  shield_charging = snap->shield_charging;
+  memcpy(shield_timer, snap->shield_timer, sizeof(shield_timer));
+  memcpy(bullets, snap->bullets, sizeof(bullets));
+  memcpy(mini_explosions, snap->mini_explosions, sizeof(mini_explosions));
+  memcpy(ufo, snap->ufo, sizeof(ufo));
+  memcpy(laser, snap->laser, sizeof(laser));
+  memcpy(asteroids, snap + 1, MAX_ASTEROIDS * sizeof(asteroid_type));
+  if (old_max > MAX_ASTEROIDS)           // nothing left of the game before
+     memset(asteroids + MAX_ASTEROIDS, 0, (old_max - MAX_ASTEROIDS) * sizeof(asteroid_type));
+  col_order_ready = 0;                   // the sort order is of other positions
+  event_head = event_tail;
+  return 0;
+}
+
+
+int save_snapshot_file(const char * file)
+{
+  /* 0, or -1 with a message */
+  static Uint8 buffer[SNAPSHOT_SIZE];
+  FILE * f;
+  int n;
+
+  n = save_snapshot(buffer, sizeof(buffer));
+  f = fopen(file, "wb");
+  if (f == NULL || fwrite(buffer, n, 1, f) != 1) {
+     fprintf(stderr, "Couldn't write %s: %s\n", file, strerror(errno));
+     if (f != NULL) fclose(f);
+     return -1;
+  }
+  fclose(f);
+  printf("Snapshot of frame %d saved to %s\n", frame, file);
+  return 0;
+}
+
+
+int load_snapshot_file(const char * file)
+{
+  /* 0, or -1 with a message (the game goes on unchanged) */
+  static Uint8 buffer[SNAPSHOT_SIZE];
+  FILE * f;
+  int n;
+
+  f = fopen(file, "rb");
+  if (f == NULL) {
+     fprintf(stderr, "Cannot open %s: %s\n", file, strerror(errno));
+     return -1;
+  }
+  n = fread(buffer, 1, sizeof(buffer), f);
+  fclose(f);
+  if (restore_snapshot(buffer, n) < 0) {
+     fprintf(stderr, "%s is not a snapshot of this version of the game\n", file);
+     return -1;
+  }
+  printf("Snapshot of frame %d restored from %s\n", frame, file);
+  return 0;
+}
+
+void test_snapshots()
+{
+  /* a snapshot of a game with one bad field at a time must be refused and
+     leave the game as it was */
+  static Uint8 good[SNAPSHOT_SIZE], bad[SNAPSHOT_SIZE], after[SNAPSHOT_SIZE];
+  const char * names[] = {"difficulty 0", "difficulty 4", "max_ufos -1", "max_ufos 4",
+                          "max_lasers -1", "max_lasers 4", "gun_bit -1", "gun_bit 15",
+                          "ship_explosion_nr -1", "ship_explosion_nr 115",
+                          "high_score_character_pos 7", "high_score_name without end"};
+  const int num_tests = sizeof(names) / sizeof(names[0]);
+  snapshot_type * snap = (snapshot_type *) bad;
+  int n, t, size, failed = 0;
+
+  setup_ship_explosions();
+  load_masks();
+  headless = 1;
+  start_headless_game(rng_seed);
+  for (n = 0; n < 300 && ship_dying == 0; n++) {
+     frame++;
+     handle_ship_input(bot_input());
+     game_frame(0);
+  }
+  size = save_snapshot(good, sizeof(good));
+
+  for (t = 0; t < num_tests; t++) {
+     memcpy(bad, good, size);
+     switch (t) {
+       case 0:  snap->difficulty = 0; break;
+       case 1:  snap->difficulty = 4; break;
+       case 2:  snap->max_ufos = -1; break;
+       case 3:  snap->max_ufos = 4; break;
+       case 4:  snap->max_lasers = -1; break;
+       case 5:  snap->max_lasers = 4; break;
+       case 6:  snap->gun_bit = -1; break;
+       case 7:  snap->gun_bit = SHIELD_BITS; break;
+       case 8:  snap->ship_explosion_nr = -1; break;
+       case 9:  snap->ship_explosion_nr = SHIP_EXPLOSIONS; break;
+       case 10: snap->high_score_character_pos = 7; break;
+       case 11: memset(snap->high_score_name, 'A', sizeof(snap->high_score_name)); break;
+     }
+     memset(after, 0, size);
+     if (restore_snapshot(bad, size) != -1) {
+        printf("Snapshot with %s: restored, should be refused\n", names[t]);
+        failed++;
+     } else if (save_snapshot(after, sizeof(after)) != size || memcmp(after, good, size) != 0) {
+        printf("Snapshot with %s: refused, but the game changed\n", names[t]);
+        failed++;
+     }
+  }
+  if (restore_snapshot(good, size) != 0) {
+     printf("Good snapshot refused\n");
+     failed++;
+  }
+  printf("Snapshot test: %d of %d bad snapshots handled wrong\n", failed, num_tests);
+  exit(failed > 0 ? 1 : 0);
+}
+
+
+
+void kernel_save_snapshot()
+{
+  save_snapshot(kernel_snapshot, sizeof(kernel_snapshot));
+}
+
+
+void kernel_restore_snapshot()
+{
+  /* the snapshot of the population by kernel_save_snapshot() */
+  restore_snapshot(kernel_snapshot, sizeof(kernel_snapshot));
+}
+
+void put_uint32(FILE * f, Uint32 x)
+{
+  /* little endian */
+  fputc(x & 255, f);
+  fputc((x >> 8) & 255, f);
+  fputc((x >> 16) & 255, f);
+  fputc(x >> 24, f);
+}
+
+
+Uint32 get_uint32(const Uint8 * p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((Uint32) p[3] << 24);
+}
+
+
+void cleanup()
+{
+  /* Shut down SDL */
+  printf("Exit game, cleaning up\n");
+  Mix_HaltMusic();
+  Mix_HaltChannel(-1);
+  if (use_joystick == 1) SDL_JoystickClose(js);
+  stop_threads();
+  if (inject_thread != NULL) {
+     inject_quit = 1;
+     SDL_WaitThread(inject_thread, NULL);
+  }
+  stop_metrics();
+  print_frame_stats();
+  if (latency_on) print_latency_stats();
+  if (perf_on) print_perf_stats();
+#ifdef TRACK_ALLOCS
+  track_report();
+#endif
+  if (prof_csv != NULL) fclose(prof_csv);
+  if (rec_f != NULL) stop_recording();
+  TTF_CloseFont(font_large);
+  TTF_CloseFont(font_small);
+  SDL_FreeSurface(screen);
+  SDL_Quit();
+}
+
+
+void handle_screen_resize()
+{
+  /* only the display is resized: game objects are stored in Videopac
+     coordinates and keep their position, speed and state */
+  char title_string[100];
+  TRACE_BEGIN(t);
+
+  screen_width  =  factor * VIDEOPAC_RES_W;           
+  screen_height =  factor * VIDEOPAC_RES_H;
+  //printf("Window resize in handle resize: full_screen=%d, width=%d, height=%d, factor=%d\n",
+  //        full_screen, screen_width, screen_height, factor);
+  if (full_screen == 0) {
+         screen = SDL_SetVideoMode(screen_width, screen_height, 0, SDL_HWPALETTE | SDL_ANYFORMAT);
+  } else {       
+         screen = SDL_SetVideoMode(screen_width, screen_height, 0, SDL_HWPALETTE | SDL_ANYFORMAT | SDL_FULLSCREEN);
+  }
+  if (screen == NULL) {
+      fprintf(stderr, "\nWarning: I could not set up video for "
+              "larger/smaller mode.\n"
+              "The Simple DirectMedia error that occured was:\n"
+              "%s\n\n", SDL_GetError());
+  }
+
+  printf("Window factor %d\n", factor);
+  load_images();
+
+  font_size = factor * 12;
+  TTF_CloseFont(font_large);
+  font_large = TTF_OpenFont("O2.ttf", font_size);
+  //printf("font size changed\n");
+     if (!font_large)
+        fprintf(stderr, "Cannot load font name O2.ttf large: %s\n", SDL_GetError());
+  TTF_CloseFont(font_small);
+  font_small = TTF_OpenFont("O2.ttf", font_size/2);
+     if (!font_small)
+        fprintf(stderr, "Cannot load font name O2.ttf small: %s\n", SDL_GetError());
+
+  sprintf(title_string, "UFO - factor: %d - difficulty: %d", factor, difficulty);
+  SDL_WM_SetCaption(title_string, "UFO");
+
+  SDL_Flip(screen);
+  TRACE_END(t, "handle_screen_resize", NULL);
+}
+
+
+void draw_stars()
+{
+  int x,y;
+  Uint32 h;
+  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+
+  /* screen top left = (0,0), bottom-right = (screen_width, screen_height))  */
+
+  for (x=0; x < screen_width - SECTOR_SIZE; x = x + SECTOR_SIZE)
+  {
+    for (y=0; y < screen_height - SECTOR_SIZE; y = y + SECTOR_SIZE)
+    {
+      /* star field is fixed: hash of x/y position, no random stream used */
+      h = hash_random(x, y);
+      /* in 1/20 of draw a star */
+      if (h % 20 == 1)
+      {
+        rect.x = x;
+        rect.y = y;
+        rect.w = ((h >> 8) % MAX_STAR_SIZE) + 1;
+        rect.h = rect.w;
+
+        SDL_FillRect(screen, &rect, getStarColor( (h >> 16) % 15) );
+      }    
+   }
+  }
+}
+
+
+void draw_ship()
+{
+  SDL_Rect src_rect;     // image source rectangle
+  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+  int sx, sy;            // ship position on screen
+
+  sx = FIX_TO_SCREEN(ship_x);
+  sy = FIX_TO_SCREEN(ship_y);
+
+  /* draw ship satellite attack */
+  src_rect.x = 0;  // left
+  src_rect.y = 0;  // up
+  src_rect.w = SHIP_W * factor;   
+  src_rect.h = SHIP_H * factor;   
+
+  rect.x = sx;       // x position  on screen
+  rect.y = sy;       // y postition on scherm
+  rect.w = SHIP_W * factor;    // ignored!
+  rect.h = SHIP_H * factor;    // ignored!
+
+  SDL_BlitSurface(images[5], &src_rect, screen, &rect);
+
+
+  /* draw "window" on ship : 1 black pixel */
+
+  src_rect.x = 0;  // left
+  src_rect.y = 0;  // up
+  src_rect.w = factor;   
+  src_rect.h = factor;   
+
+  rect.w = SHIP_W * factor;    // ignored!
+  rect.h = SHIP_H * factor;    // ignored!
+  rect.y = sy + (2 * factor);
+
+
+  switch (ship_window_step) {
+  case 1:
+     rect.x = sx + (3 * factor);
+     break;
+  case 2:
+     rect.x = sx + (4 * factor);
+     break;
+  case 3:
+     rect.x = sx + (5 * factor);
+     break;
+  case 4:
+     rect.x = sx + (6 * factor);
+     break;
+  case 5:
+     rect.x = sx + (7 * factor);
+     break;
+  case 6:
+     rect.x = sx + (-1 * factor);   // "behind" ship
+     break;
+  case 7:
+     rect.x = sx + (-1 * factor);
+     break;
+  case 8:
+     rect.x = sx + (-1 * factor);
+     break;
+  case 9:
+     rect.x = sx + (0 * factor);
+     break;
+  case 10:
+     rect.x = sx + (1 * factor);
+     break;
+  case 11:
+     rect.x = sx + (2 * factor);
+     break;
+  }
+
+  SDL_BlitSurface(images[8], &src_rect, screen, &rect);
+}
+
+
+void handle_ship_window()
+{
+  /* animation of ship's window */
+  if (frame % 2 == 0) { ship_window_step ++; }
+  if (ship_window_step > 11) { ship_window_step = 1;}
+}
+
+
+void setup_shield_bits()
+{
+  int i;
+  
+  shield_up = 0;
+  shield_charging = SHIELD_ALL;                      // initial recharching
+  for (i = 0; i < SHIELD_BITS ; i++)  
+      shield_timer[i] = SHIELD_BIT_TIMER;            // recharching timer
+  play_sound(0, 0);
+}
+
+
+void handle_shield_bits()
+{
+  int j;
+  Uint16 off, done;
+  
+  // recharge sound if delay is set
+  if (recharge_sound_delay == 1) {
+     play_sound(0,0);
+     recharge_sound_delay = 0;
+  }
+
+  if (recharge_sound_delay >= 1) recharge_sound_delay--;
+
+  /* recharching of shield bit only if no bullets alive */
+  if (bullets_alive > 0) {
+    ; //printf("-- bullets alive\n");    // no recharching possible 
+  } else {
+      // printf("-- no bullets alive, check if recharching needed\n"); 
+      off = SHIELD_ALL & ~(shield_up | shield_charging);
+
+      /* all bits on (counted before this frame), recharge complete */
+      if (shield_up == SHIELD_ALL) recharge_active = 0;
+
+      /* handle recharching timers in one pass (no branches), bits that
+         reach 0 change from recharching to on */
+      done = 0;
+      for (j = 0; j < SHIELD_BITS; j++) {
+         shield_timer[j] -= (shield_charging >> j) & 1;
+         done |= (shield_timer[j] == 0) << j;
+      }
+      done &= shield_charging;
+      shield_up |= done;
+      shield_charging &= ~done;
+
+      if (off != 0) {  // change from off to recharching
+          for (j = 0; j < SHIELD_BITS; j++)
+             if (off & (1 << j)) shield_timer[j] = SHIELD_BIT_TIMER;
+          shield_charging |= off;
+          // activate recharge and start delay time for respawn sound
+          recharge_sound_delay = 10; 
+          recharge_active = 1;// start time for respawn sound
+          //printf("recharge activated\n");
+      }
+  }  // end bullets_alive
+
+}
+
+
+void shield_off()
+{
+  /* all shield bits off (black) */
+  shield_up = 0;
+  shield_charging = 0;
+}
+
+
+ void draw_shield_bits()
+ {   
+   int i;  
+   SDL_Rect src_rect;     // image source rectangle
+   SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+   int sx, sy;            // ship position on screen
+
+   sx = FIX_TO_SCREEN(ship_x);
+   sy = FIX_TO_SCREEN(ship_y);
+
+   for (i = 0; i < SHIELD_BITS; i++)
+   {
+    if ((shield_up | shield_charging) & (1 << i)) {  // only display for recharching and active bits
+
+      src_rect.x = 0;
+      src_rect.y = 0;
+      src_rect.w = factor;         // width of bit      
+      src_rect.h = factor;         // height of bit     
+
+      /* position shield bits is relative to top/left corner of ship
+         no problem if displayed off-screen */
+
+      switch (i) {
+        case 0:
+          rect.x = sx + (3 * factor);
+          rect.y = sy - (4 * factor);
+          break;
+        case 1:
+          rect.x = sx + (5 * factor);
+          rect.y = sy - (3 * factor);
+          break;
+        case 2:
+          rect.x = sx + (7 * factor);
+          rect.y = sy - (2 * factor);
+          break;
+        case 3:
+          rect.x = sx + (9 * factor);
+          rect.y = sy - (1 * factor);
+          break;
+        case 4:
+          rect.x = sx + (10 * factor);
+          rect.y = sy + (1 * factor);
+          break;
+        case 5:   
+          rect.x = sx + (9 * factor);
+          rect.y = sy + (3 * factor);
+          break;
+        case 6:
+          rect.x = sx + (7 * factor);
+          rect.y = sy + (4 * factor);
+          break;
+        case 7:
+          rect.x = sx + (5 * factor);
+          rect.y = sy + (5 * factor);
+          break;
+        case 8:
+          rect.x = sx + (2 * factor);
+          rect.y = sy + (5 * factor);
+          break;
+        case 9:
+          rect.x = sx - (1 * factor);
+          rect.y = sy + (4 * factor);
+          break;
+        case 10:
+          rect.x = sx - (3 * factor);
+          rect.y = sy + (3 * factor);
+          break;
+        case 11:
+          rect.x = sx - (4 * factor);
+          rect.y = sy + (1 * factor);
+          break;
+        case 12:
+          rect.x = sx - (3 * factor);
+          rect.y = sy - (1 * factor);
+          break;
+        case 13:
+          rect.x = sx - (1 * factor);
+          rect.y = sy - (2 * factor);
+          break;
+        case 14:
+          rect.x = sx + (1 * factor);
+          rect.y = sy - (3 * factor);
+          break;
+        default:   // wil never happen
+          rect.x = sx + (10 * factor);
+          rect.y = sy + (1 * factor);
+      }
+
+      rect.w = 4;     // ignored
+      rect.h = 4;     // ignored
+      
+      /* display 3 bits at a time (in 5 sets) 
+         global variable 'frame' determines which set is displayed */
+      if ( 
+           ((frame % 5 == 4) && (i == 2 || i == 9 || i == 13))
+           || 
+           ((frame % 5 == 3) && (i == 5 || i == 11 || i == 0))
+           || 
+           ((frame % 5 == 2) && (i == 8 || i == 14 || i == 4))
+           || 
+           ((frame % 5 == 1) && (i == 10 || i == 1 || i == 7))
+           || 
+           ((frame % 5 == 0) && (i == 6 || i == 12 || i == 3))
+         ) {
+           if (shield_charging & (1 << i)) {
+             SDL_BlitSurface(images[9],        // grey
+                             &src_rect, screen, &rect);
+           } else {  // on
+             SDL_BlitSurface(images[7],        // blue
+                             &src_rect, screen, &rect);
+           }  
+
+        }
+        
+        /* always display gun pixel */
+        if (i == gun_bit){
+           SDL_BlitSurface(images[10],         // white
+                           &src_rect, screen, &rect);
+        }
+    }
+  }  // next i in loop
+}
+
+
+void rotate_gun_bit()
+{
+  if (frame % 3 == 0) {
+       gun_bit++;
+       
+       /* gun bit sound only if no bullets active and no recharching*/
+       if (recharge_active == 0 && bullets_alive == 0) play_sound(1, -1);   
+       if (gun_bit == 15) {gun_bit = 0;}  // recycle bits
+  }
+}
+
+
+void add_bullet(int xx, int yy)
+{
+  int i, found;
+  
+  /* Find a slot: */
+  found = -1;
+  for (i = 0; i < MAX_BULLETS && found == -1; i++) {
+     if (bullets[i].alive == 0)
+        found = i;
+  }
+  
+  /* Turn the bullet on: */
+  if (found != -1)
+    { 
+      bullets[found].alive = 1;
+      bullets_alive++;
+      bullets[found].timer = 15;  // 15 frames
+                                  // 10 frames = 1/3 seconds = 333 ms
+      /* start point and direction of bullet */   
+      bullets[found].x  = xx + FIX(gun_start[gun_bit][0]);
+      bullets[found].y  = yy + FIX(gun_start[gun_bit][1]);
+      bullets[found].px = bullets[found].x;
+      bullets[found].py = bullets[found].y;
+      bullets[found].xm = gun_speed[gun_bit][0];
+      bullets[found].ym = gun_speed[gun_bit][1];
+      //printf("Bullet added from gun_bit %d, met xm,ym: %d, %d\n", gun_bit + 1, bullets[found].xm, bullets[found].ym); 
+
+      /* disable shield */
+      shield_off();
+      play_sound(2, -1);   
+
+    }  // if (found != -1)
+}
+
+
+void add_explosion_bits(int x, int y)
+{
+  int k;
+
+  /* replace all bullets by 3 explosion bits, starting at x, y */
+  for (k = 0; k < MAX_BULLETS; k++) {
+     bullets[k].alive = 1;
+     bullets[k].timer = 15;
+     bullets[k].x  = x;
+     bullets[k].y  = y;
+     bullets[k].px = x;
+     bullets[k].py = y;
+     bullets[k].xm = explosion_bit_speed[k][0];
+     bullets[k].ym = explosion_bit_speed[k][1];
+  }
+  bullets_alive = MAX_BULLETS;
+}
+
+
+void handle_bullets()
+{      
+    int i;
+    for (i = 0; i < MAX_BULLETS; i++)
+    {
+      if (bullets[i].alive == 1)
+        {
+          /* Move: */
+          bullets[i].px = bullets[i].x;
+          bullets[i].py = bullets[i].y;
+          bullets[i].x = bullets[i].x + bullets[i].xm;
+          bullets[i].y = bullets[i].y + bullets[i].ym;
+          
+          /* Count down: */
+          bullets[i].timer--;
+
+          /* Die? */
+          if (bullets[i].y < 0 || bullets[i].y >= FIX(VIDEOPAC_RES_H) ||
+              bullets[i].x < 0 || bullets[i].x >= FIX(VIDEOPAC_RES_W) ||
+              bullets[i].timer <= 0) {
+                  bullets[i].alive = 0;
+                  bullets_alive--;
+          }
+     }
+   }
+}     
+
+
+void draw_bullets()
+{
+  int i;
+  SDL_Rect src_rect;     // image source rectangle
+  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+
+  for (i = 0; i < MAX_BULLETS; i++)
+  {
+    if (bullets[i].alive == 1) {
+      src_rect.x = 0;            // left
+      src_rect.y = 0;            // up
+      src_rect.w = factor;       // 1 factor pixel
+      src_rect.h = factor;       // 1 factor pixel
+
+      rect.x = FIX_TO_SCREEN(bullets[i].x);
+      rect.y = FIX_TO_SCREEN(bullets[i].y);
+      rect.w = 8;                // ignored!
+      rect.h = 8;                // ignored!
+      
+      if (ship_dying == 0) {   // white bullet/explosion bit
+         SDL_BlitSurface(images[10], &src_rect, screen, &rect);
+      } else {                 // green, blue, cytan or grey explosion bit
+         // pick correct color
+         SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].color_nr + 58], &src_rect, screen, &rect);
+      }
+    }  // if bullet alive
+  }    // for loop
+}
+
+
+void add_laser(int xx, int yy, int xxm, int yym, int ufo)
+{
+  ;
+  int i, found;
+  
+  /* Find a slot: */
+  found = -1;
+  for (i = 0; i < MAX_LASERS && found == -1; i++) {
+     if (laser[i].alive == 0)
+        found = i;
+  }
+  
+  /* Turn the laser on: */
+  if (found != -1)
+    { 
+      laser[found].alive = 1;
+      laser[found].fired_by_ufo = ufo;
+      /* start point and direction of laser */   
+      laser[found].x = xx;
+      laser[found].y = yy;
+      laser[found].px = xx;
+      laser[found].py = yy;
+      laser[found].xm = xxm * FIX(4);      // 4 pixels per frame
+      laser[found].ym = yym * FIX(4);  
+
+      play_sound(8, -1);   
+    }  // if (found != -1)
+
+}
+
+
+void handle_lasers()
+{
+   int i;
+    for (i = 0; i < MAX_LASERS; i++)
+    {
+      if (laser[i].alive == 1)
+        {
+          /* Move: */
+          laser[i].px = laser[i].x;
+          laser[i].py = laser[i].y;
+          laser[i].x = laser[i].x + laser[i].xm;
+          laser[i].y = laser[i].y + laser[i].ym;
+          
+          /* Die? */
+          if (laser[i].y < 0 || laser[i].y >= FIX(VIDEOPAC_RES_H) ||
+              laser[i].x < 0 || laser[i].x >= FIX(VIDEOPAC_RES_W) ) {
+                  laser[i].alive = 0;
+                  laser[i].fired_by_ufo = -1;
+          }      
+
+     }
+   }  
+}
+
+
+void draw_lasers()
+{
+  int i;
+  SDL_Rect src_rect;     // image source rectangle
+  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+
+  for (i = 0; i < MAX_LASERS; i++)
+  {
+    if (laser[i].alive == 1) {
+      src_rect.x = 0;                // left
+      src_rect.y = 0;                // up
+      src_rect.w = 7 * factor;       // 1 factor pixel
+      src_rect.h = 8 * factor;       // 1 factor pixel
+
+      rect.x = FIX_TO_SCREEN(laser[i].x);
+      rect.y = FIX_TO_SCREEN(laser[i].y);
+      rect.w = 8;                // ignored!
+      rect.h = 8;                // ignored!
+      
+      // left or right laser
+      if ( (laser[i].xm < 0 && laser[i].ym < 0) ||
+           (laser[i].xm > 0 && laser[i].ym > 0) ) {
+                SDL_BlitSurface(images[70], &src_rect, screen, &rect);  // \ laser  
+      }  else { SDL_BlitSurface(images[71], &src_rect, screen, &rect);  // / laser
+    }
+      
+    }  // if laser alive
+  }    // for loop
+}
+
+
+void check_laser_hit()
+{
+  int i, j, k;
+  int toi, hit_toi, hit_asteroid, hit_ship;
+  int asteroid_toi[3], asteroid_nr[3], ship_toi[3];   // per laser
+  
+  /* check if an active laser hits an active asteroid or ship
+     the laser path of this frame (px,py -> x,y) is tested, not only the end
+     position, and only the first object on the path (earliest time of impact)
+     is hit. So a laser cannot jump over an asteroid.
+     Only the pairs found by build_collision_world() are tested and hits are
+     pushed as events (resolve_events) */
+
+  for (j = 0; j < MAX_LASERS; j++) {
+     asteroid_toi[j] = FIX_ONE + 1;
+     asteroid_nr[j] = -1;
+     ship_toi[j] = -1;
+  }
+
+  /* first asteroid on the path of each laser */
+  for (k = 0; k < num_col_pairs[PAIR_LASER_ASTEROID]; k++) {
+     j = col_pairs[PAIR_LASER_ASTEROID][k].a;
+     i = col_pairs[PAIR_LASER_ASTEROID][k].b;
+     if (laser[j].alive == 1 && (asteroids[i].status == 1 || asteroids[i].status == 2)) {
+        toi = sweep_box(laser[j].px, laser[j].py, laser[j].x, laser[j].y, FIX(8), FIX(7),
+                        asteroids[i].x, asteroids[i].y, FIX(6), FIX(5));
+        if (toi >= 0)
+           toi = sweep_mask(laser[j].px, laser[j].py, laser[j].x, laser[j].y, laser_mask(j),
+                            asteroids[i].x, asteroids[i].y, asteroid_mask(&asteroids[i]), toi);
+        if (toi >= 0 && (toi < asteroid_toi[j] || (toi == asteroid_toi[j] && i < asteroid_nr[j]))) {
+           asteroid_toi[j] = toi;
+           asteroid_nr[j] = i;
+        }
+     }
+  }
+
+  /* does the laser hit the ship */
+  for (k = 0; k < num_col_pairs[PAIR_LASER_SHIP]; k++) {
+     j = col_pairs[PAIR_LASER_SHIP][k].a;
+     if (laser[j].alive == 1) {
+        toi = sweep_box(laser[j].px, laser[j].py, laser[j].x, laser[j].y, FIX(8), FIX(7),
+                        ship_x, ship_y, FIX(SHIP_W), FIX(SHIP_H));
+        if (toi >= 0)
+           toi = sweep_mask(laser[j].px, laser[j].py, laser[j].x, laser[j].y, laser_mask(j),
+                            ship_x, ship_y, MASK_SHIP, toi);
+        ship_toi[j] = toi;
+     }
+  }
+
+  for (j = 0; j < MAX_LASERS; j++) {
+     if (laser[j].alive == 1) {
+
+         hit_toi = asteroid_toi[j];
+         hit_asteroid = asteroid_nr[j];
+         hit_ship = 0;
+
+         /* laser hits ship (before it would hit an asteroid) */
+         if (ship_toi[j] >= 0 && ship_toi[j] < hit_toi) {
+            hit_toi = ship_toi[j];
+            hit_asteroid = -1;
+            hit_ship = 1;
+         }
+
+         if (hit_asteroid != -1)
+            push_event(EV_LASER_HIT_ASTEROID, j, hit_asteroid,
+                       sweep_pos(laser[j].px, laser[j].x, hit_toi),
+                       sweep_pos(laser[j].py, laser[j].y, hit_toi));
+
+         if (hit_ship == 1) push_event(EV_LASER_HIT_SHIP, j, 0, 0, 0);
+
+      }   // end if laser alive
+
+  } //end active lasers
+}
+
+
+void add_asteroid()
+{
+ int i, found, direction;
+  
+  /* Find a slot: */
+  found = -1;
+  for (i = 0; i < MAX_ASTEROIDS && found == -1; i++) {
+     if (asteroids[i].status == 0)
+        found = i;
+  }
+  
+  /* Turn the asteroid on: */
+  /* (size is 6 pixels wide and 5 pixels tall) */
+  if (found != -1) {
+      asteroids[found].status      = 1;                      // normal, not magnetic
+      asteroids[found].colour      = random_nr(RNG_SPAWN, 7) + 1;       // random 1-7
+      asteroids[found].shape_timer = ASTEROID_SHAPE_TIMER;   // count_down timer for shape
+
+      /* random 1 of 4 starting positions */
+      direction = random_nr(RNG_SPAWN, 4) + 1; 
+        switch (direction) {
+        case (1):
+          /* spawn from top */
+          asteroids[found].x  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_W - 20) + 10 );
+          asteroids[found].y  = FIX(-5);                       // height of asteroid out of screen
+          asteroids[found].xm = random_nr(RNG_SPAWN, 5) - 2;             // values -2, -1, 0, 1 or 2) 
+          asteroids[found].ym = random_nr(RNG_SPAWN, 2) + 1;             // values 1 or 2) 
+          break;
+        case (2):
+          /* spawn from bottom */
+          asteroids[found].x  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_W - 20) + 10 );
+          asteroids[found].y  = FIX(VIDEOPAC_RES_H + 5);       // height of asteroid out of screen
+          asteroids[found].xm = random_nr(RNG_SPAWN, 5) - 2;             // values -2, -1, 0, 1 or 2) 
+          asteroids[found].ym = random_nr(RNG_SPAWN, 2) - 2;             // values -1 or -2) 
+          break;
+        case (3):
+          /* spawn from left */
+          asteroids[found].x  = FIX(-6);                         // width of asteroid out of screen
+          asteroids[found].y  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_H - 20) + 10 );
+          asteroids[found].xm = random_nr(RNG_SPAWN, 2) + 1;               // values 1 or 2) 
+          asteroids[found].ym = random_nr(RNG_SPAWN, 5) - 2;               // values -2, -1, 0, 1 or 2) 
+          break;
+        case (4):
+          /* spawn from right */
+          asteroids[found].x  = FIX(VIDEOPAC_RES_W + 6);         // width of asteroid out of screen
+          asteroids[found].y  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_H - 20) + 10 );
+          asteroids[found].xm = random_nr(RNG_SPAWN, 2) - 2;                // values -1 or -2) 
+          asteroids[found].ym = random_nr(RNG_SPAWN, 5) - 2;                // values -2, -1, 0, 1 or 2) 
+          break;
+        }
+      /*  speed is in 1/5 pixels per frame */
+      asteroids[found].xm = asteroids[found].xm * FIX_ONE / 5;
+      asteroids[found].ym = asteroids[found].ym * FIX_ONE / 5;
+
+  }
+
+  /* debug */
+  //found = 0;
+  //for (i = 0; i < MAX_ASTEROIDS; i++) {
+  //   if (asteroids[i].status > 0)
+  //      found++;
+  //}
+  //printf("Active asteroids: %d \n", found);
+}
+
+
+void handle_asteroids()
+{
+    int i;
+    for (i = 0; i < MAX_ASTEROIDS; i++)
+    {
+      if (asteroids[i].status >= 1 && asteroids[i].status <= 2)
+        {
+          /* Move: */
+          if (asteroids[i].status == 1) {     // normal asteroid
+             asteroids[i].x = asteroids[i].x + asteroids[i].xm;
+             asteroids[i].y = asteroids[i].y + asteroids[i].ym;
+
+          } else {  // magnetic, move towards ship
+            
+              if (ship_dying == 0) {   // only when ship is still alive
+                 if (asteroids[i].x > ship_x)
+                   asteroids[i].x = asteroids[i].x - FIX_ONE / 5;
+                 else asteroids[i].x = asteroids[i].x + FIX_ONE / 5;
+                 if (asteroids[i].y > ship_y)
+                   asteroids[i].y = asteroids[i].y - FIX_ONE / 5;
+                 else asteroids[i].y = asteroids[i].y + FIX_ONE / 5;
+              }  
+          }
+
+          asteroids[i].shape_timer--;;          
+          if (asteroids[i].shape_timer == 0)
+              asteroids[i].shape_timer = ASTEROID_SHAPE_TIMER ;
+          
+          /* Off screen? */
+          if (asteroids[i].x < FIX(-6) || asteroids[i].x >= FIX(VIDEOPAC_RES_W + 6) ||
+              asteroids[i].y < FIX(-5) || asteroids[i].y >= FIX(VIDEOPAC_RES_H + 5)) {
+
+              asteroids[i].status = 0;
+              //printf("-- asteroid off screen: removed...\n");
+          }
+     }
+   }
+
+}
+
+
+void draw_asteroids()
+{
+  int i;
+  SDL_Rect src_rect;     // image source rectangle
+  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+
+  for (i = 0; i < MAX_ASTEROIDS; i++)
+  {
+    if (asteroids[i].status == 1 || asteroids[i].status == 2) {   // normal or magnetic
+      src_rect.x = 0;            // left
+      src_rect.y = 0;            // up
+      src_rect.w = 6 * factor;   // width factor pixel
+      src_rect.h = 5 * factor;   // heightfactor pixel
+
+      rect.x = FIX_TO_SCREEN(asteroids[i].x);
+      rect.y = FIX_TO_SCREEN(asteroids[i].y);
+      rect.w = 8;                // ignored!
+      rect.h = 8;                // ignored!
+
+      // too complex code below for displaying asteroid images per frame
+
+      if (asteroids[i].status == 1) {  // display alternating + en x for normal asteroid, 3 frames per image
+                                       // example +++xxx+++xxx+++xxx
+         if (asteroids[i].shape_timer >= 1 && asteroids[i].shape_timer <= ASTEROID_SHAPE_TIMER/2) {
+              SDL_BlitSurface(images[ 8 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);   // x
+         } else {  
+              SDL_BlitSurface(images[ 9 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);  // plus
       }
-      if (active_shield_bits == 15)   // all bits active, recharge complete
-             recharge_active = 0;
-  }  // end found != -1
 
+      } else if (asteroids[i].status == 2) {  // display alternating O, + en x for normal asteroid, 3 frames per image
+                                       
+         if (asteroids[i].shape_timer >= 1 && asteroids[i].shape_timer <= ASTEROID_SHAPE_TIMER/2) {
+              SDL_BlitSurface(images[10 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);   // O
+              //printf("O\n");
+         } else { if (asteroids[i].magnetic_timer%2 == 0) {
+                     SDL_BlitSurface(images[9 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);    // plus
+                     //printf("+ timer=%d\n", asteroids[i].magnetic_timer); 
+                  } else {
+                     SDL_BlitSurface(images[8 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);    // x
+                     //printf("x timer=%d\n", asteroids[i].magnetic_timer); 
+                  }
+                }
+       }  // if asteroids[i].status == 2
+      
+ 
+       } else if (asteroids[i].status == 3) {    // exploding 5 images
+                //printf("exploding asteroid \n");
+                src_rect.x = 0;            // left
+                src_rect.y = 0;            // up
+                src_rect.w = 16 * factor;   // width factor pixel
+                src_rect.h = 13 * factor;   // heightfactor pixel
+
+                rect.x = FIX_TO_SCREEN(asteroids[i].x) - 5 * factor;
+                rect.y = FIX_TO_SCREEN(asteroids[i].y) - 4 * factor;
+                rect.w = 8;                // ignored!
+                rect.h = 8;                // ignored!
+
+                SDL_BlitSurface(images[asteroids[i].shape_timer + 31], &src_rect, screen, &rect); 
+      
+    }  // if asteroid[i].status 
+  }     // end for loop
 }
 
 
- void draw_shield_bits()
- {   
-   int i;  
-   SDL_Rect src_rect;     // image source rectangle
-   SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+void handle_asteroid_shapes()
+{
+  /* next image of magnetic and exploding asteroids (after drawing) */
+  int i;
 
-   for (i = 0; i < SHIELD_BITS; i++)
-   {
-    if (shield_bits[i].status >= 1) {  // only display for recharching and active bits
+  for (i = 0; i < MAX_ASTEROIDS; i++)
+  {
+    if (asteroids[i].status == 2 &&
+        !(asteroids[i].shape_timer >= 1 && asteroids[i].shape_timer <= ASTEROID_SHAPE_TIMER/2)) {
+       // alternate + en x
+       asteroids[i].magnetic_timer++; 
+       if (asteroids[i].magnetic_timer > 5)
+          asteroids[i].magnetic_timer = 0; 
+    } else if (asteroids[i].status == 3) {    // exploding 5 images
+       asteroids[i].shape_timer++;
+       if (asteroids[i].shape_timer == 6) {
+          //  after explosion disable asteroid completely
+          asteroids[i].status = 0;
+          //printf("asteroid completely disabled \n");
+       }
+    }
+  }
+}
 
-      src_rect.x = 0;
-      src_rect.y = 0;
-      src_rect.w = factor;         // width of bit      
-      src_rect.h = factor;         // height of bit     
 
-      /* position shield bits is relative to top/left corner of ship
-         no problem if displayed off-screen */
+void build_collision_world()
+{
+  /* broadphase: put the box of every active object in the collision world
+     (once per frame), sort on left x and find all pairs of boxes that
+     overlap (sweep and prune). The check functions only test these pairs.
+     Bullets and lasers get the box around their path of this frame and the
+     ship gets the box of the shield, so no swept or shield hit is missed */
+  int i, k, m, slot, pair_type;
+  col_box_type * a;
+  col_box_type * b;
+
+  if (col_order_ready == 0) {
+     for (i = 0; i < MAX_COL_BOXES; i++) {
+        col_order[i] = i;
+        col_boxes[i].active = 0;
+     }
+     col_order_ready = 1;
+  }
 
-      switch (i) {
-        case 0:
-          rect.x = ship_x + (3 * factor);
-          rect.y = ship_y - (4 * factor);
-          break;
-        case 1:
-          rect.x = ship_x + (5 * factor);
-          rect.y = ship_y - (3 * factor);
-          break;
-        case 2:
-          rect.x = ship_x + (7 * factor);
-          rect.y = ship_y - (2 * factor);
-          break;
-        case 3:
-          rect.x = ship_x + (9 * factor);
-          rect.y = ship_y - (1 * factor);
-          break;
-        case 4:
-          rect.x = ship_x + (10 * factor);
-          rect.y = ship_y + (1 * factor);
-          break;
-        case 5:   
-          rect.x = ship_x + (9 * factor);
-          rect.y = ship_y + (3 * factor);
-          break;
-        case 6:
-          rect.x = ship_x + (7 * factor);
-          rect.y = ship_y + (4 * factor);
-          break;
-        case 7:
-          rect.x = ship_x + (5 * factor);
-          rect.y = ship_y + (5 * factor);
-          break;
-        case 8:
-          rect.x = ship_x + (2 * factor);
-          rect.y = ship_y + (5 * factor);
-          break;
-        case 9:
-          rect.x = ship_x - (1 * factor);
-          rect.y = ship_y + (4 * factor);
-          break;
-        case 10:
-          rect.x = ship_x - (3 * factor);
-          rect.y = ship_y + (3 * factor);
-          break;
-        case 11:
-          rect.x = ship_x - (4 * factor);
-          rect.y = ship_y + (1 * factor);
-          break;
-        case 12:
-          rect.x = ship_x - (3 * factor);
-          rect.y = ship_y - (1 * factor);
-          break;
-        case 13:
-          rect.x = ship_x - (1 * factor);
-          rect.y = ship_y - (2 * factor);
-          break;
-        case 14:
-          rect.x = ship_x + (1 * factor);
-          rect.y = ship_y - (3 * factor);
-          break;
-        default:   // wil never happen
-          rect.x = ship_x + (10 * factor);
-          rect.y = ship_y + (1 * factor);
+  for (i = 0; i < MAX_BULLETS; i++) {
+     set_col_box(i, bullets[i].alive == 1, COL_BULLET, i,
+                 bullets[i].px < bullets[i].x ? bullets[i].px : bullets[i].x,
+                 bullets[i].py < bullets[i].y ? bullets[i].py : bullets[i].y,
+                 (bullets[i].px > bullets[i].x ? bullets[i].px : bullets[i].x) + FIX(1),
+                 (bullets[i].py > bullets[i].y ? bullets[i].py : bullets[i].y) + FIX(1));
+  }
+  for (i = 0; i < 3; i++) {
+     set_col_box(COL_SLOT_LASER + i, i < MAX_LASERS && laser[i].alive == 1, COL_LASER, i,
+                 laser[i].px < laser[i].x ? laser[i].px : laser[i].x,
+                 laser[i].py < laser[i].y ? laser[i].py : laser[i].y,
+                 (laser[i].px > laser[i].x ? laser[i].px : laser[i].x) + FIX(8),
+                 (laser[i].py > laser[i].y ? laser[i].py : laser[i].y) + FIX(7));
+  }
+  set_col_box(COL_SLOT_SHIP, ship_dying == 0, COL_SHIP, 0,
+              ship_x + FIX(masks[MASK_SHIELD].x),
+              ship_y + FIX(masks[MASK_SHIELD].y),
+              ship_x + FIX(masks[MASK_SHIELD].x + masks[MASK_SHIELD].w),
+              ship_y + FIX(masks[MASK_SHIELD].y + masks[MASK_SHIELD].h));
+  col_targets = 0;
+  for (i = 0; i < ASTEROID_SLOTS; i++) {
+     set_col_box(COL_SLOT_ASTEROID + i,
+                 i < MAX_ASTEROIDS && (asteroids[i].status == 1 || asteroids[i].status == 2),
+                 COL_ASTEROID, i, asteroids[i].x, asteroids[i].y,
+                 asteroids[i].x + FIX(6), asteroids[i].y + FIX(5));
+     col_targets += col_boxes[COL_SLOT_ASTEROID + i].active;
+  }
+  for (i = 0; i < 3; i++) {
+     set_col_box(COL_SLOT_UFO + i, i < MAX_UFOS && ufo[i].status == 1, COL_UFO, i,
+                 ufo[i].x, ufo[i].y, ufo[i].x + FIX(8), ufo[i].y + FIX(2));
+     col_targets += col_boxes[COL_SLOT_UFO + i].active;
+  }
+
+  /* insertion sort on x; objects move little, so the order of last frame
+     is almost right and this is about one pass */
+  for (i = 1; i < MAX_COL_BOXES; i++) {
+     slot = col_order[i];
+     for (k = i - 1; k >= 0 && col_boxes[col_order[k]].x > col_boxes[slot].x; k--)
+        col_order[k + 1] = col_order[k];
+     col_order[k + 1] = slot;
+  }
+
+  /* sweep: boxes that start before the right side of box k overlap in x */
+  for (i = 0; i < NUM_PAIR_TYPES; i++) num_col_pairs[i] = 0;
+  for (k = 0; k < MAX_COL_BOXES; k++) {
+     a = &col_boxes[col_order[k]];
+     if (a->active == 0) continue;
+     for (m = k + 1; m < MAX_COL_BOXES && col_boxes[col_order[m]].x < a->xr; m++) {
+        b = &col_boxes[col_order[m]];
+        if (b->active == 0 || b->y >= a->yb || a->y >= b->yb) continue;
+        pair_type = col_pair_types[a->type][b->type];
+        if (pair_type == -1) continue;
+        if (num_col_pairs[pair_type] == MAX_COL_PAIRS) continue;   // full (only with many asteroids)
+        /* lowest object type first (e.g. bullet before asteroid) */
+        if (a->type < b->type || (a->type == b->type && a->nr < b->nr)) {
+           col_pairs[pair_type][num_col_pairs[pair_type]].a = a->nr;
+           col_pairs[pair_type][num_col_pairs[pair_type]].b = b->nr;
+        } else {
+           col_pairs[pair_type][num_col_pairs[pair_type]].a = b->nr;
+           col_pairs[pair_type][num_col_pairs[pair_type]].b = a->nr;
+        }
+        num_col_pairs[pair_type]++;
+     }
+  }
+}
+
+
+void set_col_box(int slot, int active, int type, int nr, int x, int y, int xr, int yb)
+{
+  col_boxes[slot].active = active;
+  col_boxes[slot].type = type;
+  col_boxes[slot].nr = nr;
+  if (active) {           // inactive box keeps its place in the sort order
+     col_boxes[slot].x  = x;
+     col_boxes[slot].y  = y;
+     col_boxes[slot].xr = xr;
+     col_boxes[slot].yb = yb;
+  }
+}
+
+
+void check_ship_collision()
+{
+  int i, p;
+  /* check if ship collides with an asteroid/ufo while shield is down
+     (shield is down when at least one shield-bit is not recharched 
+     Only the pairs found by build_collision_world() are tested.
+     Nothing is changed here, hits are pushed as events (resolve_events) */
+  
+  /* check if an asteroid or ufo is colliding with ship */
+  if (shield_up != SHIELD_ALL) {  // shield is down
+    
+    /* loop active astroids */
+    for (p = 0; p < num_col_pairs[PAIR_SHIP_ASTEROID]; p++)
+    {
+      i = col_pairs[PAIR_SHIP_ASTEROID][p].b;
+      if (asteroids[i].status == 1 || asteroids[i].status == 2) {
+         /* check overlap of astroid and ship */
+         if (mask_hit(MASK_SHIP, ship_x, ship_y, asteroid_mask(&asteroids[i]), asteroids[i].x, asteroids[i].y))
+            push_event(EV_SHIP_DIES, DEATH_ASTEROID, 0, 0, 0);
       }
+    }  // end loop active asteroids
 
-      rect.w = 4;     // ignored
-      rect.h = 4;     // ignored
-      
-      /* display 3 bits at a time (in 5 sets) 
-         global variable 'frame' determines which set is displayed */
-      if ( 
-           ((frame % 5 == 4) && (i == 2 || i == 9 || i == 13))
-           || 
-           ((frame % 5 == 3) && (i == 5 || i == 11 || i == 0))
-           || 
-           ((frame % 5 == 2) && (i == 8 || i == 14 || i == 4))
-           || 
-           ((frame % 5 == 1) && (i == 10 || i == 1 || i == 7))
-           || 
-           ((frame % 5 == 0) && (i == 6 || i == 12 || i == 3))
-         ) {
-           if (shield_bits[i].status == 1) {
-             SDL_BlitSurface(images[shield_bits[i].img_grey],
-                             &src_rect, screen, &rect);
-           } else {  // status == 2
-             SDL_BlitSurface(images[shield_bits[i].img_blue],
-                             &src_rect, screen, &rect);
-           }  
+    /* loop active ufos */
+    for (p = 0; p < num_col_pairs[PAIR_SHIP_UFO]; p++)
+    {
+      i = col_pairs[PAIR_SHIP_UFO][p].b;
+      if (ufo[i].status == 1) {
+         /* check overlap of ufo and ship */
+         if (mask_hit(MASK_SHIP, ship_x, ship_y, MASK_UFO, ufo[i].x, ufo[i].y))
+            push_event(EV_SHIP_DIES, DEATH_UFO, 0, 0, 0);
+      }
+    }    // end loop active ufos
+
+  } else {   // shield is active, check on hitting an asteroid or ufo
+
+      /* loop active astroids */
+      for (p = 0; p < num_col_pairs[PAIR_SHIP_ASTEROID]; p++)
+      {
+        i = col_pairs[PAIR_SHIP_ASTEROID][p].b;
+        if (asteroids[i].status == 1 || asteroids[i].status == 2) {
+           /* check overlap of astroid and ship */
+           /* (ship is larger when shield is active: shield mask) */
+           if (mask_hit(MASK_SHIELD, ship_x, ship_y, asteroid_mask(&asteroids[i]), asteroids[i].x, asteroids[i].y)) {
+              //printf("hit asteroid with ship\n");
+              push_event(EV_HIT_ASTEROID, i, 0, 0, 0);
+              push_event(EV_SHIELD_OFF, 0, 0, 0, 0);
+           }
+        }  
+      } // end loop active asteroids
+
+      /* loop active ufo */
+      for (p = 0; p < num_col_pairs[PAIR_SHIP_UFO]; p++)
+      {
+        i = col_pairs[PAIR_SHIP_UFO][p].b;
+        if (ufo[i].status == 1) {
+           /* check overlap of ufo and ship */
+           /* (ship is larger when shield is active: shield mask) */
+           if (mask_hit(MASK_SHIELD, ship_x, ship_y, MASK_UFO, ufo[i].x, ufo[i].y)) {
+              push_event(EV_HIT_UFO, i, 1, 0, 0);     // 1: hit by ship
+              push_event(EV_SHIELD_OFF, 0, 0, 0, 0);
+           }
+        }  
+      } // end loop active ufos
+
+  }  // end found != -1 (shield is down)
+}
+
+
+void check_bullet_hit()
+{
+  int i, j, k;
+  int toi;
+  int hit_toi[MAX_BULLETS], hit_nr[MAX_BULLETS], hit_type[MAX_BULLETS];
+  
+  /* check if an active bullet hits an active asteroid or ufo
+     the bullet path of this frame (px,py -> x,y) is tested and only the first
+     object on the path (earliest time of impact) is hit, so fast bullets do
+     not fly through an asteroid.
+     Only the pairs found by build_collision_world() are tested and hits are
+     pushed as events (resolve_events) */
+
+  for (j = 0; j < MAX_BULLETS; j++) {
+     hit_toi[j] = FIX_ONE + 1;
+     hit_nr[j] = -1;
+     hit_type[j] = -1;
+  }
+
+  for (k = 0; k < num_col_pairs[PAIR_BULLET_ASTEROID]; k++) {
+     j = col_pairs[PAIR_BULLET_ASTEROID][k].a;
+     i = col_pairs[PAIR_BULLET_ASTEROID][k].b;
+     if (bullets[j].alive == 1 && (asteroids[i].status == 1 || asteroids[i].status == 2)) {
+        toi = sweep_box(bullets[j].px, bullets[j].py, bullets[j].x, bullets[j].y, FIX(1), FIX(1),
+                        asteroids[i].x, asteroids[i].y, FIX(6), FIX(5));
+        if (toi >= 0)
+           toi = sweep_mask(bullets[j].px, bullets[j].py, bullets[j].x, bullets[j].y, MASK_BULLET,
+                            asteroids[i].x, asteroids[i].y, asteroid_mask(&asteroids[i]), toi);
+        if (toi >= 0 && (toi < hit_toi[j] || (toi == hit_toi[j] && i < hit_nr[j]))) {
+           hit_toi[j] = toi;
+           hit_nr[j] = i;
+           hit_type[j] = COL_ASTEROID;
+        }
+     }
+  }
+
+  for (k = 0; k < num_col_pairs[PAIR_BULLET_UFO]; k++) {
+     j = col_pairs[PAIR_BULLET_UFO][k].a;
+     i = col_pairs[PAIR_BULLET_UFO][k].b;
+     if (bullets[j].alive == 1 && ufo[i].status == 1) {
+        toi = sweep_box(bullets[j].px, bullets[j].py, bullets[j].x, bullets[j].y, FIX(1), FIX(1),
+                        ufo[i].x, ufo[i].y, FIX(8), FIX(2));
+        if (toi >= 0)
+           toi = sweep_mask(bullets[j].px, bullets[j].py, bullets[j].x, bullets[j].y, MASK_BULLET,
+                            ufo[i].x, ufo[i].y, MASK_UFO, toi);
+        if (toi >= 0 && (toi < hit_toi[j] || (toi == hit_toi[j] && hit_type[j] == COL_UFO && i < hit_nr[j]))) {
+           hit_toi[j] = toi;
+           hit_nr[j] = i;
+           hit_type[j] = COL_UFO;
+        }
+     }
+  }
+
+  for (j = 0; j < MAX_BULLETS; j++) {
+     if (bullets[j].alive == 1) {
+
+         // disable shield
+         if (col_targets > 0) push_event(EV_SHIELD_OFF, 0, 0, 0, 0);
+
+         if (hit_type[j] == COL_ASTEROID) push_event(EV_HIT_ASTEROID, hit_nr[j], 0, 0, 0);
+         if (hit_type[j] == COL_UFO)      push_event(EV_HIT_UFO, hit_nr[j], 0, 0, 0);
+     }
+  } // end loop active bullets
+}
+
+
+int sweep_box(int x0, int y0, int x1, int y1, int w, int h,
+              int bx, int by, int bw, int bh)
+{
+  /* swept collision of a moving box (w x h, top-left from x0,y0 to x1,y1)
+     with a box (bx,by bw x bh); all in fixed point.
+     Returns time of impact 0..FIX_ONE (part of the path) or -1 for no hit.
+     Same overlap rule as the old end position test (touching is no hit) */
+  int t_in = 0, t_out = FIX_ONE;
+
+  if (sweep_axis(x0, x1 - x0, bx - w, bx + bw, &t_in, &t_out) == 0) return -1;
+  if (sweep_axis(y0, y1 - y0, by - h, by + bh, &t_in, &t_out) == 0) return -1;
+  if (t_in >= t_out) return -1;
+  return t_in;
+}
+
+
+int sweep_axis(int p, int d, int lo, int hi, int * t_in, int * t_out)
+{
+  /* one axis of sweep_box(): limit t_in..t_out to the part of the path
+     where lo < p + d*t < hi. Returns 0 if there is no such part */
+  Sint64 t_lo, t_hi, t;
+
+  if (d == 0) return (p > lo && p < hi);
+
+  t_lo = ((Sint64) (lo - p) * FIX_ONE) / d;
+  t_hi = ((Sint64) (hi - p) * FIX_ONE) / d;
+  if (t_lo > t_hi) {       // moving left or up
+     t = t_lo;
+     t_lo = t_hi;
+     t_hi = t;
+  }
+  if (t_lo > *t_in)  *t_in  = (int) t_lo;
+  if (t_hi < *t_out) *t_out = (int) t_hi;
+  return (*t_in < *t_out);
+}
+
+
+int sweep_pos(int p0, int p1, int toi)
+{
+  /* position on path p0 -> p1 at time of impact */
+  return p0 + (int) (((Sint64) (p1 - p0) * toi) >> FIX_SHIFT);
+}
+
+
+void check_colliding_asteroids()
+{
+  int i, j, k;
+  asteroid_job_type job;
+
+  /* handle colliding asteroid with other asteroid and
+     colliding asteroid with ufos (ufo alway loses)
+     Only the pairs found by build_collision_world() are tested,
+     collisions are applied by resolve_events() */
+
+  /* asteroid pairs (magnetic and non-magnetic): overlap is tested on all
+     threads, then the events are pushed in pair order, so the result is
+     the same for any number of threads */
+  job.asteroids = asteroids;
+  job.pairs = col_pairs[PAIR_ASTEROID_ASTEROID];
+  job.pair_hit = col_pair_hit;
+  run_parallel(test_asteroid_pairs, &job, num_col_pairs[PAIR_ASTEROID_ASTEROID], 256);
+  for (k = 0; k < num_col_pairs[PAIR_ASTEROID_ASTEROID]; k++)
+  {
+     if (col_pair_hit[k]) {
+        i = col_pairs[PAIR_ASTEROID_ASTEROID][k].a;
+        j = col_pairs[PAIR_ASTEROID_ASTEROID][k].b;
+        collide_asteroids(i, j);
+        collide_asteroids(j, i);
+     }
+  }
+
+  /* asteroid with ufo */
+  for (k = 0; k < num_col_pairs[PAIR_ASTEROID_UFO]; k++)
+  {
+     i = col_pairs[PAIR_ASTEROID_UFO][k].a;
+     j = col_pairs[PAIR_ASTEROID_UFO][k].b;
+     if ((asteroids[i].status == 1 || asteroids[i].status == 2) && ufo[j].status == 1) {
+        /* check overlap of asteroid[i] with ufo */
+        if (mask_hit(asteroid_mask(&asteroids[i]), asteroids[i].x, asteroids[i].y,
+                     MASK_UFO, ufo[j].x, ufo[j].y))
+           push_event(EV_ASTEROID_HITS_UFO, i, j, 0, 0);
+     }
+  }  // end asteroid-ufo pairs
+}   
+
+
+void test_asteroid_pairs(void * data, int begin, int end)
+{
+  /* overlap of asteroid pairs begin..end-1 (any thread, only reads) */
+  asteroid_job_type * d = data;
+  asteroid_type * a;
+  asteroid_type * b;
+  int k;
+
+  for (k = begin; k < end; k++)
+  {
+     a = &d->asteroids[d->pairs[k].a];
+     b = &d->asteroids[d->pairs[k].b];
+     d->pair_hit[k] = (a->status == 1 || a->status == 2) &&
+                      (b->status == 1 || b->status == 2) &&
+                      mask_hit(asteroid_mask(a), a->x, a->y, asteroid_mask(b), b->x, b->y);
+  }
+}
+
+
+void collide_asteroids(int i, int j)
+{
+  /* overlapping asteroid i bumps into asteroid j */
+  if ((asteroids[i].status == 1 || asteroids[i].status == 2) &&
+      (asteroids[j].status == 1 || (asteroids[j].status == 2 && asteroids[i].status == 2)))
+     push_event(EV_ASTEROIDS_BUMP, i, j, 0, 0);
+}
+
+
+void push_event(int type, int a, int b, int x, int y)
+{
+  event_type * e;
+
+  if (event_tail - event_head == MAX_EVENTS) {
+     events_lost++;          // reported once per frame by resolve_events
+     return;
+  }
+  e = &events[event_tail & (MAX_EVENTS - 1)];
+  e->type = type;
+  e->a = a;
+  e->b = b;
+  e->x = x;
+  e->y = y;
+  event_tail++;
+}
+
+
+void resolve_events()
+{
+  /* apply all events of this frame in the order they were pushed. An object
+     that is already hit (or dead) is not hit again, so more hits in one
+     frame count only once. Sounds are played at the end, max 1 per channel */
+  event_type * e;
+
+  defer_sounds = 1;
+  while (event_head != event_tail) {
+     e = &events[event_head & (MAX_EVENTS - 1)];
+     event_head++;
+
+     switch (e->type) {
+       case EV_HIT_ASTEROID:
+         hit_asteroid(e->a);
+         break;
+       case EV_HIT_UFO:
+         hit_ufo(e->a, e->b);
+         break;
+       case EV_SHIELD_OFF:
+         shield_off();
+         break;
+       case EV_SHIP_DIES:
+         ship_dies(e->a);
+         break;
+       case EV_LASER_HIT_ASTEROID:
+         if (laser[e->a].alive == 1) {
+           laser[e->a].alive = 0;
+           laser[e->a].fired_by_ufo = -1;
+           add_mini_explosion(e->x, e->y);
+           if (asteroids[e->b].status == 1)
+             asteroids[e->b].status = 2;          // make magnetic if asteroid hit by laser
+         }
+         break;
+       case EV_LASER_HIT_SHIP:
+         laser_hits_ship(e->a);
+         break;
+       case EV_ASTEROIDS_BUMP:
+         bump_asteroids(e->a, e->b);
+         break;
+       case EV_ASTEROID_HITS_UFO:
+         if ((asteroids[e->a].status == 1 || asteroids[e->a].status == 2) && ufo[e->b].status == 1) {
+           // kill ufo, keep asteroid (do not make magnetic, there will be too many)
+           ufo[e->b].status = 0;
+           stop_ufo_sound();    // stop audio for ufo               
+           add_mini_explosion(ufo[e->b].x , ufo[e->b].y);                          
+         }
+         break;
+     }
+  }
+  flush_sounds();
+
+  if (events_lost != events_reported) {
+     if (bench_kernels == 0)
+        fprintf(stderr, "Warning: event queue full, %llu events lost this frame\n",
+                (unsigned long long) (events_lost - events_reported));
+     events_reported = events_lost;
+  }
+}
+
+
+void hit_asteroid(int i)
+{
+  /* asteroid hit by bullet or by ship with shield up */
+  if (asteroids[i].status != 1 && asteroids[i].status != 2) return;   // already hit
+
+  // disable asteroid: set status = 3 exploding
+  play_sound(3, 3);
+
+  /* increase score */
+  if (asteroids[i].status == 1) add_score(1);
+  if (asteroids[i].status == 2) add_score(3);
+
+  asteroids[i].status = 3;
+  asteroids[i].shape_timer = 1;   // explosion takes 5 images
+
+  /* replace all bullets by 3 explosion bits */
+  add_explosion_bits(asteroids[i].x + FIX(3), asteroids[i].y + FIX(2));  // halfway asteroid
+}
+
+
+void hit_ufo(int i, int by_ship)
+{
+  int k;
+
+  /* ufo hit by bullet or by ship with shield up */
+  if (ufo[i].status != 1) return;   // already hit
+  if (by_ship && headless == 0) printf("hit ufo with ship\n");
+
+  // disable ufo: set status = 3 exploding
+  play_sound(3, 3);
 
-        }
-        
-        /* always display gun pixel */
-        if (shield_bits[i].gun == 1){
-           SDL_BlitSurface(images[shield_bits[i].img_white],
-                           &src_rect, screen, &rect);
-        }
-    }
-  }  // next i in loop
+  /* increase score */
+  add_score(10);
+
+  ufo[i].status = 3;
+  ufo[i].shape_timer = 1;   // explosion takes 5 images
+
+  /* replace all bullets by 3 explosion bits */
+  add_explosion_bits(ufo[i].x + FIX(4), ufo[i].y + FIX(1));  // halfway ufo
+
+  if (by_ship) {
+    // Disable laser if fired from ufo (to prevent ship hit again)
+    for (k = 0; k < MAX_LASERS; k++) {
+       if (laser[k].alive == 1 && laser[k].fired_by_ufo == i) {  
+         if (headless == 0) printf("-- disable laser from ufo which is hit by ship \n");
+         laser[k].alive = 0;
+       }
+    }    
+  }
 }
 
 
-void rotate_gun_bit()
+void laser_hits_ship(int j)
 {
-  int i, found;
-  if (frame % 3 == 0) {
-       shield_bits[gun_bit].gun = 0;      // current gun bit off
-       gun_bit++;
-       
-       /* gun bit sound only if no bullets active and no recharching*/
-       /* Find a slot: */
-       if (recharge_active == 0) {
-          found = -1;
-          for (i = 0; i < MAX_BULLETS && found == -1; i++) {
-             if (bullets[i].alive == 1)
-              found = i;
+  int l, found_asteroid;
+
+  if (laser[j].alive == 0) return;   // laser is gone (its ufo was hit)
+
+  if (shield_up != SHIELD_ALL) {   // shield is down
+     ship_dies(DEATH_LASER);
+  } else {
+     if (headless == 0) printf("HIT BY LASER, SHIELD WAS UP\n");
+
+     /* create ship explosion (= asteroid object with status = 3)
+        find a slot: */
+     found_asteroid = -1;
+     for (l = 0; l < MAX_ASTEROIDS && found_asteroid == -1; l++) {
+        if (asteroids[l].status == 0)
+           found_asteroid = l;
+     }
+
+     /* Turn the asteroid/explosion on. */
+     /* (there is a small change no slots where free) */
+     if (found_asteroid != -1) {
+         asteroids[found_asteroid].status      = 3;    // eploding
+         asteroids[found_asteroid].colour      = 6;    // grey
+         asteroids[found_asteroid].shape_timer = 0;    // for explosion start = 0
+
+         asteroids[found_asteroid].x  = ship_x + FIX(3);  // halfway the ship
+         asteroids[found_asteroid].y  = ship_y + FIX(2);  // halfway the ship
+         asteroids[found_asteroid].xm = 0;
+         asteroids[found_asteroid].ym = 0; 
+         //printf("explosion created for shield ship\n");
+      } else { ; //printf("explosion NOT created for shield ship\n"); 
+      }
+      // end found_asteroid
+   
+     /* replace all bullets by 3 explosion bits */
+     add_explosion_bits(ship_x + FIX(3), ship_y + FIX(2));  // halfway the ship
+
+     // disable shield
+     shield_off();
+   
+  } // end shield is up/down
+
+  // disable laser after hitting ship 
+  laser[j].alive = 0;
+  laser[j].fired_by_ufo = -1;
+}
+
+
+void bump_asteroids(int i, int j)
+{
+  /* asteroid i bumps into asteroid j, status is checked again because an
+     earlier event may have changed it */
+  if ((asteroids[i].status == 1 || asteroids[i].status == 2) &&
+      (asteroids[j].status == 1 || (asteroids[j].status == 2 && asteroids[i].status == 2))) {
+     /* create magnetic 1 out of 10 */
+     if (random_nr(RNG_COLLISION, 10) == 0) {
+
+          /* determine which asteroid is non-magnetic */
+          if (asteroids[i].status == 1) {
+             asteroids[i].status = 2;   // make magnetic, keep colour //
+             asteroids[i].magnetic_timer = 0;
+
+             // kill the other one (only if this one is non-magnetic)
+             if (asteroids[j].status == 1) {
+               asteroids[j].status = 0;
+               add_mini_explosion(asteroids[j].x , asteroids[j].y);                          
+             }                            
+          } else {
+             // asteroids[i] is magnetic, check if asteroids[j] is normal 
+             // if so, make kill j
+             if (asteroids[j].status == 1) {
+                //printf("Magnetic (j) created!\n");
+                // kill the other one
+                asteroids[j].status = 0;
+                add_mini_explosion(asteroids[j].x , asteroids[j].y);                          
+             } else {
+                  // both asteroids are magnetic
+                  //printf("collision of 2 magnetic asteroid!\n");
+                  // kill the second one
+                  asteroids[j].status = 0;
+                  add_mini_explosion(asteroids[j].x , asteroids[j].y);                          
+             }
           }
-          if (found == -1) play_sound(1, -1);   
-       }
-       if (gun_bit == 15) {gun_bit = 0;}  // recycle bits
-       shield_bits[gun_bit].gun = 1;      // nextgun bit on
+
+     }
   }
 }
 
 
-void add_bullet(int xx, int yy)
+void ship_dies(int cause)
 {
-  int i, j, found;
-  
-  /* Find a slot: */
-  found = -1;
-  for (i = 0; i < MAX_BULLETS && found == -1; i++) {
-     if (bullets[i].alive == 0)
-        found = i;
+  if (ship_dying == 1) return;   // already dying
+
+  if (headless == 0) {
+    if (cause == DEATH_ASTEROID) printf("DEADLY COLLISION WITH ASTEROID!\n");
+    if (cause == DEATH_UFO)      printf("DEADLY COLLISION WITH UFO!\n");
+    if (cause == DEATH_LASER)    printf("HIT BY LASER, SHIELD WAS DOWN\n");
   }
-  
-  /* Turn the bullet on: */
-  if (found != -1)
-    { 
-      bullets[found].alive = 1;
-      bullets[found].timer = 15;  // 15 frames
-                                  // 10 frames = 1/3 seconds = 333 ms
-      /* start point and direction of bullet */   
-      if (gun_bit + 1 == 1) {
-          bullets[found].x = xx + (3 * factor);
-          bullets[found].y = yy - (4 * factor);
-          bullets[found].xm = 0;
-          bullets[found].ym = (-40.74074 / 10) * factor;  
-      } else if (gun_bit + 1 == 2) {
-          bullets[found].x = xx + (5 * factor);
-          bullets[found].y = yy - (3 * factor);
-          bullets[found].xm = (20.0 / 10) * factor;
-          bullets[found].ym = (-34.81 / 10) * factor;  
-      } else if (gun_bit + 1 == 3) {
-          bullets[found].x = xx + (7 * factor);
-          bullets[found].y = yy - (2 * factor);
-          bullets[found].xm = (28.80805 / 10) * factor;
-          bullets[found].ym = (-28.80805 / 10) * factor;  
-      } else if (gun_bit + 1 == 4) {
-          bullets[found].x = xx + (9 * factor);
-          bullets[found].y = yy - (1 * factor);
-          bullets[found].xm = (34.81805 / 10) * factor;
-          bullets[found].ym = (-20.0 / 10) * factor;  
-      } else if (gun_bit + 1 == 5) {
-          bullets[found].x = xx + (10 * factor);
-          bullets[found].y = yy + (1 * factor);
-          bullets[found].xm = (40.74074 / 10) * factor;
-          bullets[found].ym = 0;  
-      } else if (gun_bit + 1 == 6) {
-          bullets[found].x = xx + (9 * factor);
-          bullets[found].y = yy + (3 * factor);
-          bullets[found].xm = (34.81805 / 10) * factor;
-          bullets[found].ym = (20.0 / 10) * factor;  
-      } else if (gun_bit + 1 == 7) {
-          bullets[found].x = xx + (7 * factor);
-          bullets[found].y = yy + (4 * factor);
-          bullets[found].xm = (28.80805 / 10) * factor;
-          bullets[found].ym = (28.80805 / 10) * factor;  
-      } else if (gun_bit + 1 == 8) {
-          bullets[found].x = xx + (5 * factor);
-          bullets[found].y = yy + (5 * factor);
-          bullets[found].xm = 0;
-          bullets[found].ym = (40.74074 / 10) * factor;  
-      } else if (gun_bit + 1 == 9) {
-          bullets[found].x = xx + (2 * factor);
-          bullets[found].y = yy + (5 * factor);
-          bullets[found].xm = 0;
-          bullets[found].ym = (40.74074 / 10) * factor;  
-      } else if (gun_bit + 1 == 10) {
-          bullets[found].x = xx - (1 * factor);
-          bullets[found].y = yy + (4 * factor);
-          bullets[found].xm = (-28.80805 / 10) * factor;
-          bullets[found].ym = (28.80805 / 10) * factor;  
-      } else if (gun_bit + 1 == 11) {
-          bullets[found].x = xx - (3 * factor);
-          bullets[found].y = yy + (3 * factor);
-          bullets[found].xm = (-34.81805 / 10) * factor;
-          bullets[found].ym = (20.0 / 10) * factor;  
-      } else if (gun_bit + 1 == 12) {
-          bullets[found].x = xx - (4 * factor);
-          bullets[found].y = yy + (1 * factor);
-          bullets[found].xm = (-40.74074 / 10) * factor;
-          bullets[found].ym = 0;  
-      } else if (gun_bit + 1 == 13) {
-          bullets[found].x = xx - (3 * factor);
-          bullets[found].y = yy - (1 * factor);
-          bullets[found].xm = (-40.74074 / 10) * factor;
-          bullets[found].ym = (-20.0 / 10) * factor;  
-      } else if (gun_bit + 1 == 14) {
-          bullets[found].x = xx - (1 * factor);
-          bullets[found].y = yy - (2 * factor);
-          bullets[found].xm = (-28.80805 / 10) * factor;
-          bullets[found].ym = (-28.80805 / 10) * factor;
-      } else if (gun_bit + 1 == 15) {
-          bullets[found].x = xx + (1 * factor);
-          bullets[found].y = yy - (3 * factor);
-          bullets[found].xm = (-20.0 / 10) * factor;
-          bullets[found].ym = (-34.81805 / 10) * factor;
-      }
-      //printf("Bullet added from gun_bit %d, met xm,ym: %f, %f\n", gun_bit + 1, bullets[found].xm, bullets[found].ym); 
+  death_cause = cause;
+  ship_dying = 1;
+  ship_explosion_nr = 0;
+  play_sound(5, 5); 
+}
 
-      /* disable shield */
-      for (j = 0; j < SHIELD_BITS; j++) {
-        shield_bits[j].status = 0;
-      } 
-      play_sound(2, -1);   
 
-    }  // if (found != -1)
+void add_score(int points)
+{
+  score = score + points;
+  if (score > high_score) {
+    high_score = score;
+    high_score_broken = 1;
+  }  
 }
 
 
-void handle_bullets()
-{      
-    int i;
-    for (i = 0; i < MAX_BULLETS; i++)
-    {
-      if (bullets[i].alive == 1)
-        {
-          /* Move: */
-          
-          bullets[i].x = bullets[i].x + bullets[i].xm;
-          bullets[i].y = bullets[i].y + bullets[i].ym;
-          
-          /* Count down: */
-          bullets[i].timer--;
+void flush_sounds()
+{
+  /* play the sounds queued by resolve_events() */
+  int k;
 
-          /* Die? */
-          if (bullets[i].y < 0 || bullets[i].y >= screen_height ||
-              bullets[i].x < 0 || bullets[i].x >= screen_width  ||
-              bullets[i].timer <= 0)
-                  bullets[i].alive = 0;
+  defer_sounds = 0;
+  for (k = 0; k < num_queued_sounds; k++)
+     play_sound(queued_sounds[k][0], queued_sounds[k][1]);
+  num_queued_sounds = 0;
+}
+
+
+void check_asteroid_positions()
+{
+  /* check of asteroids are about to collide
+     if so, try to avoid that (but collisions may still happen) 
+     Only the pairs found by find_near_pairs() are tested, on all threads
+     (positions do not change here), the avoiding is done in the same order
+     as a single thread: i ascending, then j ascending */
+  int i, j, k, n;
+  asteroid_job_type job;
+
+  find_near_pairs();
+  job.asteroids = asteroids;
+  job.pairs = near_pairs;
+  job.pair_hit = near_pair_hit;
+  run_parallel(test_near_pairs, &job, num_near_pairs, 256);
+
+  n = 0;
+  for (k = 0; k < num_near_pairs; k++)
+  {
+     if (near_pair_hit[k]) {
+        near_order[n].a = near_pairs[k].a;
+        near_order[n].b = near_pairs[k].b;
+        near_order[n + 1].a = near_pairs[k].b;
+        near_order[n + 1].b = near_pairs[k].a;
+        n = n + 2;
      }
-   }
-}     
+  }
+  sort_near_pairs(near_order, near_sorting, n, 0);
+  sort_near_pairs(near_sorting, near_order, n, 1);
+
+  /* loop near astroids */
+  for (k = 0; k < n; k++)
+  {
+     i = near_order[k].a;
+     j = near_order[k].b;
+     //printf("-- asteroids too near %d, %d \n", asteroids[i].colour, asteroids[j].colour);
+     if (random_nr(RNG_COLLISION, 10) == 1) {    // 1 out of 10, when larger increases chance
+                                // of collision (= magnetic asteroid)
+          //printf("avoiding started!\n");
+          // change x-direction (near, so dx < FIX(10))
+          asteroids[i].xm = -1 * asteroids[i].xm;
+          asteroids[j].xm = -1 * asteroids[i].xm;
+          // change y-direction (near, so dy < FIX(10))
+          asteroids[i].ym = -1 * asteroids[i].ym;
+          asteroids[j].ym = -1 * asteroids[i].ym;
+     }
+  }
+}
 
 
-void draw_bullets()
+void find_near_pairs()
+{
+  /* asteroid pairs less than 10 pixels apart in x and y, from the sort
+     order of build_collision_world() (asteroid boxes start at the top-left
+     corner): only the boxes up to 10 pixels to the right are looked at.
+     Asteroids hit in resolve_events() are skipped by test_near_pairs() */
+  int k, m, dy;
+  col_box_type * a;
+  col_box_type * b;
+
+  num_near_pairs = 0;
+  for (k = 0; k < MAX_COL_BOXES; k++) {
+     a = &col_boxes[col_order[k]];
+     if (a->active == 0 || a->type != COL_ASTEROID) continue;
+     for (m = k + 1; m < MAX_COL_BOXES && col_boxes[col_order[m]].x - a->x < FIX(10); m++) {
+        b = &col_boxes[col_order[m]];
+        if (b->active == 0 || b->type != COL_ASTEROID) continue;
+        dy = b->y - a->y;
+        if (dy >= FIX(10) || dy <= -FIX(10)) continue;
+        if (num_near_pairs == MAX_COL_PAIRS) return;   // full (only with many asteroids)
+        near_pairs[num_near_pairs].a = a->nr;
+        near_pairs[num_near_pairs].b = b->nr;
+        num_near_pairs++;
+     }
+  }
+}
+
+
+void sort_near_pairs(col_pair_type * from, col_pair_type * to, int n, int on_a)
+{
+  /* stable counting sort of n pairs on asteroid a (on_a == 1) or b */
+  int i, k, sum;
+
+  memset(near_count, 0, (MAX_ASTEROIDS + 1) * sizeof(int));
+  for (k = 0; k < n; k++)
+     near_count[on_a ? from[k].a : from[k].b]++;
+  sum = 0;
+  for (i = 0; i <= MAX_ASTEROIDS; i++) {
+     k = near_count[i];
+     near_count[i] = sum;
+     sum = sum + k;
+  }
+  for (k = 0; k < n; k++)
+     to[near_count[on_a ? from[k].a : from[k].b]++] = from[k];
+}
+
+
+void test_near_pairs(void * data, int begin, int end)
+{
+  /* distance of near pairs begin..end-1 (any thread, only reads) */
+  asteroid_job_type * d = data;
+  asteroid_type * a;
+  asteroid_type * b;
+  int k;
+  int dx, dy;   // distance between asteroid centers (fixed point)
+
+  for (k = begin; k < end; k++)
+  {
+     a = &d->asteroids[d->pairs[k].a];
+     b = &d->asteroids[d->pairs[k].b];
+     /* (both asteroids have the same size, so the distance of the
+        centers is the distance of the top-left corners) */
+     dx = abs(b->x - a->x);
+     dy = abs(b->y - a->y);
+
+     /* check distance of asteroids: Pythagoras, in integers (1/256 pixel) 
+        to keep it the same on all platforms */
+     d->pair_hit[k] = (a->status == 1 || a->status == 2) &&
+                      (b->status == 1 || b->status == 2) &&
+                      dx < FIX(10) && dy < FIX(10) &&
+                      (dx >> 8) * (dx >> 8) + (dy >> 8) * (dy >> 8) < (FIX(10) >> 8) * (FIX(10) >> 8);
+  }
+}
+
+
+void draw_mini_explosions()
 {
   int i;
   SDL_Rect src_rect;     // image source rectangle
   SDL_Rect rect;         // image desc rectangle (w and h are ignored)
 
-  for (i = 0; i < MAX_BULLETS; i++)
+  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
   {
-    if (bullets[i].alive == 1) {
+    if (mini_explosions[i].alive == 1) {
       src_rect.x = 0;            // left
       src_rect.y = 0;            // up
-      src_rect.w = factor;       // 1 factor pixel
-      src_rect.h = factor;       // 1 factor pixel
+      src_rect.w = factor * 8 ;  // 1 factor pixel x w
+      src_rect.h = factor * 8 ;  // 1 factor pixel x h
 
-      rect.x = bullets[i].x;
-      rect.y = bullets[i].y;
+      rect.x = FIX_TO_SCREEN(mini_explosions[i].x);
+      rect.y = FIX_TO_SCREEN(mini_explosions[i].y);
       rect.w = 8;                // ignored!
       rect.h = 8;                // ignored!
       
-      if (ship_dying == 0) {   // white bullet/explosion bit
-         SDL_BlitSurface(images[10], &src_rect, screen, &rect);
-      } else {                 // green, blue, cytan or grey explosion bit
-         // pick correct color
-         SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].color_nr + 58], &src_rect, screen, &rect);
+      if (mini_explosions[i].timer > 5) {   
+        SDL_BlitSurface(images[37], &src_rect, screen, &rect);   // yello
       }
-    }  // if bullet alive
-  }    // for loop
+      else {
+        SDL_BlitSurface(images[38], &src_rect, screen, &rect);   // grey
+      } 
+    }   // alive == 1
+  }     // end for loop 
 }
 
 
-void add_laser(int xx, int yy, int xxm, int yym, int ufo)
+void handle_mini_explosions()
+{
+  /* count down mini explosions (before drawing) */
+  int i;
+
+  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
+  {
+    if (mini_explosions[i].alive == 1) {
+      mini_explosions[i].timer--;
+      if (mini_explosions[i].timer == 0) {
+          //printf("Mini explosion timed oud\n");
+          mini_explosions[i].alive = 0;
+      }
+    }
+  }
+}
+
+
+void add_mini_explosion(int x, int y)
 {
-  ;
   int i, found;
   
   /* Find a slot: */
   found = -1;
-  for (i = 0; i < MAX_LASERS && found == -1; i++) {
-     if (laser[i].alive == 0)
+  for (i = 0; i < MAX_MINI_EXPLOSIONS && found == -1; i++) {
+     if (mini_explosions[i].alive == 0)
         found = i;
   }
   
-  /* Turn the laser on: */
+  /* Turn the explosion on: */
   if (found != -1)
     { 
-      laser[found].alive = 1;
-      laser[found].fired_by_ufo = ufo;
-      /* start point and direction of laser */   
-      laser[found].x = xx;
-      laser[found].y = yy;
-      laser[found].xm = xxm * 4 * factor;  
-      laser[found].ym = yym * 4 * factor;  
+      mini_explosions[found].alive = 1;
+      mini_explosions[found].timer = 15;  // 15 frames; 
+                                          // 10 frames = 1/3 seconds = 333 ms
+      mini_explosions[found].x = x;
+      mini_explosions[found].y = y;
+      
+      //printf("Mini explosion added x,y: %d, %d \n", x, y); 
+      play_sound(4, 4);   
 
-      play_sound(8, -1);   
     }  // if (found != -1)
 
 }
 
 
-void handle_lasers()
-{
-   int i;
-    for (i = 0; i < MAX_LASERS; i++)
-    {
-      if (laser[i].alive == 1)
-        {
-          /* Move: */
-          
-          laser[i].x = laser[i].x + laser[i].xm;
-          laser[i].y = laser[i].y + laser[i].ym;
-          
-          /* Die? */
-          if (laser[i].y < 0 || laser[i].y >= screen_height ||
-              laser[i].x < 0 || laser[i].x >= screen_width  ) {
-                  laser[i].alive = 0;
-                  laser[i].fired_by_ufo = -1;
-          }      
-
-     }
-   }  
-}
-
-
-void draw_lasers()
+void draw_ufo()
 {
   int i;
   SDL_Rect src_rect;     // image source rectangle
   SDL_Rect rect;         // image desc rectangle (w and h are ignored)
 
-  for (i = 0; i < MAX_LASERS; i++)
+  for (i = 0; i < MAX_UFOS; i++)
   {
-    if (laser[i].alive == 1) {
-      src_rect.x = 0;                // left
-      src_rect.y = 0;                // up
-      src_rect.w = 7 * factor;       // 1 factor pixel
-      src_rect.h = 8 * factor;       // 1 factor pixel
+    if (ufo[i].status == 1 || ufo[i].status == 3) {   // active or exploding
+      src_rect.x = 0;            // left
+      src_rect.y = 0;            // up
+      src_rect.w = 8 * factor;   // width  factor pixel
+      src_rect.h = 2 * factor;   // height factor pixel
 
-      rect.x = laser[i].x;
-      rect.y = laser[i].y;
+      rect.x = FIX_TO_SCREEN(ufo[i].x);
+      rect.y = FIX_TO_SCREEN(ufo[i].y);
       rect.w = 8;                // ignored!
       rect.h = 8;                // ignored!
-      
-      // left or right laser
-      if ( (laser[i].xm < 0 && laser[i].ym < 0) ||
-           (laser[i].xm > 0 && laser[i].ym > 0) ) {
-                SDL_BlitSurface(images[70], &src_rect, screen, &rect);  // \ laser  
-      }  else { SDL_BlitSurface(images[71], &src_rect, screen, &rect);  // / laser
-    }
-      
-    }  // if laser alive
-  }    // for loop
-}
-
-
-void check_laser_hit()
-{
-  int i, j, k, l, found, found_asteroid;
-  int a_x, a_y, a_xr, a_yb;       // top-left and bottom-right coordinates of asteroid
-  int b_x, b_y, b_xr, b_yb;       // top-left and bottom-right coordinates of laser
-  
-  /* check if an active laser hits an active asteroid or ship */
-
-  for (j = 0; j < MAX_LASERS; j++) {
-     if (laser[j].alive == 1) {
-
-         b_xr = laser[j].x + 8 * factor;   // width  laser factor pixel
-         b_yb = laser[j].y + 7 * factor;   // height laser factor pixel
-         b_x  = laser[j].x;
-         b_y  = laser[j].y;
-
-         // check if active laser has a hit an asteroid
-
-         /* loop active astroids */
-         for (i = 0; i < MAX_ASTEROIDS; i++)
-         {
-           if (asteroids[i].status == 1 || asteroids[i].status == 2) {
-              a_xr = (asteroids[i].x + 6 * factor);   // width  factor pixel
-              a_yb = (asteroids[i].y + 5 * factor);   // height factor pixel
-              a_x  = asteroids[i].x;
-              a_y  = asteroids[i].y;
-
-              /* check overlap of bullet and asteroid */
-              if (b_xr  > a_x   &&
-                  b_x   < a_xr  &&
-                  b_yb  > a_y   &&
-                  b_y   < a_yb) {
-
-                    //printf("laser hit on astroid color %d\n", asteroids[i].colour);  
-                    laser[j].alive = 0;
-                    laser[j].fired_by_ufo = -1;
-                    add_mini_explosion(laser[j].x , laser[j].y);     
-
-                    if (asteroids[i].status == 1) {
-                      asteroids[i].status = 2;          // make magnetic if asteroid hit by laser
-                    }                    
-                  
-              }
 
-           }  // if status = 1
-         }    // end loop active asteroids 
-
-
-         /* check if laser hits ship */
-         /* check overlap of laser and ship */
-         if ( (ship_x + SHIP_W * factor)        > b_x   &&
-               ship_x                           < b_xr  &&
-              (ship_y + SHIP_H * factor)        > b_y   &&
-               ship_y                           < b_yb) {
+      if (ufo[i].status == 1) {  // 
+              SDL_BlitSurface(images[62 + (ufo[i].colour) ], &src_rect, screen, &rect);  // colour 1-7
+      } else if (ufo[i].status == 3) {    // exploding 5 images
+                //printf("exploding ufo \n");
+                src_rect.x = 0;            // left
+                src_rect.y = 0;            // up
+                src_rect.w = 16 * factor;   // width factor pixel of explosion
+                src_rect.h = 13 * factor;   // heightfactor pixel of explosion
 
-             // is shield down?
-             found = -1;
-             for (k = 0; k < SHIELD_BITS && found == -1; k++) {
-                if (shield_bits[k].status != 2) found = 1;   // shield is down
-             }
+                rect.x = FIX_TO_SCREEN(ufo[i].x) - 5 * factor;
+                rect.y = FIX_TO_SCREEN(ufo[i].y) - 4 * factor;
+                rect.w = 8;                // ignored!
+                rect.h = 8;                // ignored!
 
-             if (found == 1) {
-                printf("HIT BY LASER, SHIELD WAS DOWN\n");
-                ship_dying = 1;
-                ship_explosion_nr = 0;
-                play_sound(5, 5); 
-             } else {
-                printf("HIT BY LASER, SHIELD WAS UP\n");
-
-                /* create ship explosion (= asteroid object with status = 3)
-                   find a slot: */
-                found_asteroid = -1;
-                for (l = 0; l < MAX_ASTEROIDS && found_asteroid == -1; l++) {
-                   if (asteroids[l].status == 0)
-                      found_asteroid = l;
-                }
+                SDL_BlitSurface(images[ufo[i].shape_timer + 31], &src_rect, screen, &rect); 
+           }  
+    }   // if ufo[i].status 
+  }     // end for loop
+}
 
-                /* Turn the asteroid/explosion on. */
-                /* (there is a small change no slots where free) */
-                if (found_asteroid != -1) {
-                    asteroids[found_asteroid].status      = 3;    // eploding
-                    asteroids[found_asteroid].colour      = 6;    // grey
-                    asteroids[found_asteroid].shape_timer = 0;    // for explosion start = 0
-
-                    asteroids[found_asteroid].x  = ship_x + (3 * factor);  // halfway the ship
-                    asteroids[found_asteroid].y  = ship_y + (2 * factor);  // halfway the ship
-                    asteroids[found_asteroid].xm = 0;
-                    asteroids[found_asteroid].ym = 0; 
-                    //printf("explosion created for shield ship\n");
-                 } else { ; //printf("explosion NOT created for shield ship\n"); 
-                 }
-                 // end found_asteroid
-              
-                /* disable all bullets (if any) */
-                for (k = 0; k < MAX_BULLETS; k++)
-                     bullets[k].alive = 0;
-
-                /* create 3 new bullets (=explosion bits) */
-                for (k = 0; k < MAX_BULLETS; k++) {
-                  bullets[k].alive = 1;
-                  bullets[k].timer = 15;  
-                  bullets[k].x = ship_x + (3 * factor);  // halfway the ship 
-                  bullets[k].y = ship_y + (2 * factor);  // halfway the ship 
-                }      
-                bullets[0].xm = 0;
-                bullets[0].ym = ( 40.74074 / 15) * factor; // slower and less far than normal bullet
-                bullets[1].xm = ( 28.80805 / 15) * factor;
-                bullets[1].ym = (-28.80805 / 15) * factor;  
-                bullets[2].xm = (-28.80805 / 15) * factor;
-                bullets[2].ym = (-28.80805 / 15) * factor;  
-          
-                // disable shield
-                for (k = 0; k < SHIELD_BITS; k++)
-                    shield_bits[k].status = 0;
-              
-             } // end shield is up/down (found ==1)
 
-             // disable laser after hitting ship 
-             laser[j].alive = 0;
-             laser[j].fired_by_ufo = -1;
+void handle_ufo_explosions()
+{
+  /* next image of exploding ufos (after drawing) */
+  int i;
 
-         }  // end check overlap laser and ship
+  for (i = 0; i < MAX_UFOS; i++)
+  {
+    if (ufo[i].status == 3) {
+       ufo[i].shape_timer++;
+       if (ufo[i].shape_timer == 6) {
+          //  after explosion disable ufo completely
+          ufo[i].status = 0;
+          //printf("ufo completely disabled \n");
+       }
+    }
+  }
+}
 
-      }   // end if laser alive
 
-  } //end active lasers
+void stop_ufo_sound()
+{
+  if (headless == 0 && Mix_Playing(6)) Mix_HaltChannel(6);
 }
 
 
-void add_asteroid()
+void add_ufo()
 {
  int i, found, direction;
   
   /* Find a slot: */
   found = -1;
-  for (i = 0; i < MAX_ASTEROIDS && found == -1; i++) {
-     if (asteroids[i].status == 0)
+  for (i = 0; i < MAX_UFOS && found == -1; i++) {
+     if (ufo[i].status == 0)
         found = i;
   }
   
-  /* Turn the asteroid on: */
-  /* (size is 6 pixels wide and 5 pixels tall) */
+  /* Turn the ufo on: */
+  /* (size is 8 pixels wide and 2 pixels tall) */
   if (found != -1) {
-      asteroids[found].status      = 1;                      // normal, not magnetic
-      asteroids[found].colour      = (rand() % 7) + 1;       // random 1-7
-      asteroids[found].shape_timer = ASTEROID_SHAPE_TIMER;   // count_down timer for shape
+      //printf("UFO created\n");  
+      ufo[found].status      = 1;                      // active
+      ufo[found].colour      = random_nr(RNG_SPAWN, 7) + 1;       // random 1-7
+      ufo[found].shape_timer = ASTEROID_SHAPE_TIMER;   // count_down timer for explosion
 
-      /* random 1 of 4 starting positions */
-      direction = rand() %4 + 1; 
+      /* random 1 of 4 starting positions 
+         but always moving diagonal and speed 3 */
+      direction = random_nr(RNG_SPAWN, 4) + 1; 
         switch (direction) {
         case (1):
           /* spawn from top */
-          asteroids[found].x  = ( (rand() % (screen_width - 20 * factor)) + 10 * factor );
-          asteroids[found].y  = -5 * factor;                   // height of asteroid out of screen
-          asteroids[found].xm = ( rand() % 5) - 2;             // values -2, -1, 0, 1 or 2) 
-          asteroids[found].ym = ( rand() % 2) + 1;             // values 1 or 2) 
+          //ufo[found].x  = ( (rand() % (screen_width - 20 * factor)) + 10 * factor );
+          ufo[found].x  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_W - 80) + 40 );
+          ufo[found].y  = FIX(-2);                        // height of ufo out of screen
+          ufo[found].xm = (-6 * random_nr(RNG_SPAWN, 2))  + 3;         // values -3 or 3) 
+          ufo[found].ym = 2;    
           break;
         case (2):
           /* spawn from bottom */
-          asteroids[found].x  = ( (rand() % (screen_width - 20 * factor)) + 10 * factor );
-          asteroids[found].y  = screen_height + (factor * 5);  // height of asteroid out of screen
-          asteroids[found].xm = ( rand() % 5) - 2;             // values -2, -1, 0, 1 or 2) 
-          asteroids[found].ym = ( rand() % 2) - 2;             // values -1 or -2) 
+          //ufo[found].x  = ( (rand() % (screen_width - 20 * factor)) + 10 * factor );
+          ufo[found].x  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_W - 80) + 40 );
+          ufo[found].y  = FIX(VIDEOPAC_RES_H + 2);        // height of ufo out of screen
+          ufo[found].xm = (-6 * random_nr(RNG_SPAWN, 2))  + 3;         // values -3 or 3) 
+          ufo[found].ym = -2;
           break;
         case (3):
           /* spawn from left */
-          asteroids[found].x  = -6 * factor;                     // width of asteroid out of screen
-          asteroids[found].y  = ( (rand() % (screen_height - 20 * factor)) + 10 * factor );
-          asteroids[found].xm = ( rand() % 2) + 1;               // values 1 or 2) 
-          asteroids[found].ym = ( rand() % 5) - 2;               // values -2, -1, 0, 1 or 2) 
+          ufo[found].x  = FIX(-8);                         // width of ufo out of screen
+          //ufo[found].y  = ( (rand() % (screen_height - 20 * factor)) + 10 * factor );
+          ufo[found].y  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_H - 80) + 20 );
+          ufo[found].xm = 2;
+          ufo[found].ym = random_nr(RNG_SPAWN, 5) - 2;               // values -2, -1, 0, 1 or 2) 
+          ufo[found].ym = (-6 * random_nr(RNG_SPAWN, 2))  + 3;          // values -3 or 3) 
           break;
         case (4):
           /* spawn from right */
-          asteroids[found].x  = screen_width + (factor * 6);      // width of asteroid out of screen
-          asteroids[found].y  = ( (rand() % (screen_height - 20 * factor)) + 10 * factor );
-          asteroids[found].xm = ( rand() % 2) - 2;                // values -1 or -2) 
-          asteroids[found].ym = ( rand() % 5) - 2;                // values -2, -1, 0, 1 or 2) 
+          ufo[found].x  = FIX(VIDEOPAC_RES_W + 8);          // width of asteroid out of screen
+          //ufo[found].y  = ( (rand() % (screen_height - 20 * factor)) + 10 * factor );
+          ufo[found].y  = FIX( random_nr(RNG_SPAWN, VIDEOPAC_RES_H - 80) + 20 );
+          ufo[found].xm = -2;
+          ufo[found].ym = (-6 * random_nr(RNG_SPAWN, 2))  + 3;          // values -3 or 3) 
           break;
         }
-      /*  adjust speed for current factor */
-      asteroids[found].xm = asteroids[found].xm * (factor / 5.0);
-      asteroids[found].ym = asteroids[found].ym * (factor / 5.0);
+      /*  speed is in 1/5 pixels per frame */
+      ufo[found].xm = ufo[found].xm * FIX_ONE / 5;
+      ufo[found].ym = ufo[found].ym * FIX_ONE / 5;
 
-  }
+      //printf("ufo i=%d added\n", found);
+      play_sound(9,6);
 
-  /* debug */
-  //found = 0;
-  //for (i = 0; i < MAX_ASTEROIDS; i++) {
-  //   if (asteroids[i].status > 0)
-  //      found++;
-  //}
-  //printf("Active asteroids: %d \n", found);
+  }  // if not found 
 }
 
 
-void handle_asteroids()
+void handle_ufo()
 {
-    int i;
-    for (i = 0; i < MAX_ASTEROIDS; i++)
-    {
-      if (asteroids[i].status >= 1 && asteroids[i].status <= 2)
-        {
-          /* Move: */
-          if (asteroids[i].status == 1) {     // normal asteroid
-             asteroids[i].x = asteroids[i].x + asteroids[i].xm;
-             asteroids[i].y = asteroids[i].y + asteroids[i].ym;
+   int i, j, k, lx, ly, xm, ym;
+   int laser_for_ufo_added;
+   int laser_type;    // 1 = backward down     3 = forward down
+                      // 2 = backward up       4 = forward up
 
-          } else {  // magnetic, move towards ship
-            
-              if (ship_dying == 0) {   // only when ship is still alive
-                 if (asteroids[i].x > ship_x)
-                   asteroids[i].x = asteroids[i].x - (factor / 5.0);
-                 else asteroids[i].x = asteroids[i].x + (factor / 5.0);
-                 if (asteroids[i].y > ship_y)
-                   asteroids[i].y = asteroids[i].y - (factor / 5.0) ;
-                 else asteroids[i].y = asteroids[i].y + (factor / 5.0);
-              }  
-          }
+   for (i = 0; i < MAX_UFOS; i++)
+   {
 
-          asteroids[i].shape_timer--;;          
-          if (asteroids[i].shape_timer == 0)
-              asteroids[i].shape_timer = ASTEROID_SHAPE_TIMER ;
-          
-          /* Off screen? */
-          if (asteroids[i].x < -6 * factor || asteroids[i].x >= screen_width + 6 * factor ||
-              asteroids[i].y < -5 * factor || asteroids[i].y >= screen_height + 5 * factor) {
+     if (ufo[i].status == 1)
+     {
+       /* Move: */
+        ufo[i].x = ufo[i].x + ufo[i].xm;
+        ufo[i].y = ufo[i].y + ufo[i].ym;
+        ufo[i].shape_timer--;;          
+        
+        // timer for ufo explosion
+        if (ufo[i].shape_timer == 0) {
+            ufo[i].shape_timer = ASTEROID_SHAPE_TIMER ;
+        }
 
-              asteroids[i].status = 0;
-              //printf("-- asteroid off screen: removed...\n");
+        /* Is ufo off-screen? */
+        if (ufo[i].x < FIX(-8) || ufo[i].x >= FIX(VIDEOPAC_RES_W + 8) ||
+            ufo[i].y < FIX(-2) || ufo[i].y >= FIX(VIDEOPAC_RES_H + 2)) {
+            ufo[i].status = 0;
+            stop_ufo_sound();
+            //printf("-- ufo off screen: removed...\n");
+        }
+
+        /* If possible fire a laser
+           First check if UFO already has an active laser, if so, don't fire 
+           a possible second laser for this ufo */
+        laser_for_ufo_added = -1;
+        for (k = 0; k < MAX_LASERS && laser_for_ufo_added == -1; k++) {
+          if (laser[k].fired_by_ufo == i) {
+            laser_for_ufo_added = j;
           }
+        } // end loop j
+
+
+        for (j = 0; j < MAX_LASERS && laser_for_ufo_added == -1; j++)  
+        {
+          if ( laser[j].alive == 1) {   // skip active lasers
+              ; 
+          } else {
+              /* fire laser if ship is in range */
+              lx = ufo[i].x + FIX(2);          // possible laser x starting point
+              ly = ufo[i].y;                   // possible laser x starting point
+
+              // check if backward or forward laser can hit ship 
+              laser_type = 0;
+                if ( abs( ((ship_x + FIX(2)) - (lx-ly))  -  ((ship_y + FIX(2))) ) <= FIX(2) ) {   // middle of ship +- 2        
+                 if (ship_y > ufo[i].y + FIX(4)) {
+                   laser_type = 1;
+                 } else {   
+                   laser_type = 2;
+                 }
+              }
+                if ( abs( (lx - (ship_x - FIX(2))) - ((ship_y + FIX(2)) - ly) ) <= FIX(2) ) {   // middle of ship +- 2
+                 if (ship_y > ufo[i].y + FIX(4)) {
+                   laser_type = 3;
+                 } else {   
+                   laser_type = 4;
+                 }
+              }
+
+              if (laser_type != 0) {
+                  switch (laser_type) {
+                    case 1:
+                      xm = 1;
+                      ym = 1;
+                      break;
+                    case 2:
+                      xm = -1;
+                      ym = -1;
+                      break;
+                    case 3:
+                      xm = -1;
+                      ym = 1;
+                      break;
+                    case 4:
+                      xm = 1;
+                      ym = -1;
+                      break;
+                  }    
+               add_laser(ufo[i].x + FIX(2), ufo[i].y, xm, ym, i );
+               laser_for_ufo_added = i;
+              }    
+           }  // end laser[j].alive == 1 && laser[j].fired_by_ufo == i   
+        }     // end j-loop
+
      }
+   }  // end for i-loop
+  
+   /* create new ufo if possible (and randomnes and new game at least 15 frame/30  sec active)  */
+   if (random_nr(RNG_AI, UFO_RANDOMNESS) == 1 && ship_dying == 0 && (frame - ufo_start_delay > 10*30)) {
+      add_ufo(); 
    }
+}
+
+
+void draw_score_line() 
+{
+  SDL_Color fgColor_green  = {0,182,0};   
+  SDL_Color fgColor_red    = {182,0,0};   
+  SDL_Color fgColor_grey   = {182,182,182};   // grey/white
+  SDL_Rect text_position;  
+  char text_line[20]; 
+
+  // highscore in green
+  sprintf(text_line, "%04d", high_score);
+  text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
+  text_position.x = 24 * factor;
+  text_position.y = 145 * factor;
+  SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
+
+  // arrow sign in grey/white
+  sprintf(text_line, "%c", 124); // arrow-char in modified o2 font
+  text = TTF_RenderText_Solid(font_large, text_line, fgColor_grey);
+  text_position.x = (24 * factor) + (3 * 12 * factor); // skip 3 chars
+  text_position.y = 145 * factor;
+  SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
+
+  // highscore name in green
+  if (ship_destroyed == 1) {
+    flash_high_score_name();
+  } else {  
+    sprintf(text_line, "%s ", high_score_name);
+    text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
+    text_position.x = (24 * factor) + (4 * 12 * factor); // skip 4 chars
+    text_position.y = 145 * factor;
+    SDL_BlitSurface(text, NULL , screen, &text_position);
+    SDL_FreeSurface(text);
+  }
+
+  // current score in red
+  sprintf(text_line, " %04d", score);
+  text = TTF_RenderText_Solid(font_large, text_line, fgColor_red);
+  text_position.x = (24 * factor) + (9 * 12 * factor); // skip 9 chars
+  text_position.y = 145 * factor;
+  SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
+
+}
+
+
+void flash_high_score_name()
+{
+  SDL_Color fgColor_green  = {0,182,0};   
+  SDL_Rect text_position;  
+  char text_line[8];
+
+  // highscore name in green
+  sprintf(text_line, "%s ", high_score_name);
+  
+  text_line[flash_high_score_timer%6] = ' ';
+  text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
+  text_position.x = (24 * factor) + (4 * 12 * factor); // skip 4 chars
+  text_position.y = 145 * factor;
+  
+  SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
+}
+
+
+void handle_high_score_flash()
+{
+  /* timer of flashing high score name after game over (after drawing),
+     new game starts when it is 0 */
+  if (ship_destroyed == 1) {
+    if (frame%3 == 0) {
+      flash_high_score_timer--;
+    }  
+    if (flash_high_score_timer < 0) flash_high_score_timer = 150;
+  }
+}
+
+
+void print_high_score_char(int character)
+{
+  SDL_Color fgColor_green = {0,182,0};   
+  SDL_Color fgColor_red    = {182,0,0};   
+  SDL_Rect text_position;  
+  char text_line[8];
+  
+  // highscore name in green
+  strcpy(text_line, high_score_name);
+  
+  if (character != 13) text_line[high_score_character_pos] = character;
+  strcpy(high_score_name, text_line);
+
+  high_score_character_pos++;
+  if (high_score_character_pos > 5 || character == 13) {  // max length or return
+    high_score_registration = 0;
+    printf("stop registration\n");
+  }
+    
+  text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
+  text_position.x = (24 * factor) + (4 * 12 * factor); // skip 4 chars
+  text_position.y = 145 * factor;
+  SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
+
+  // current score in red
+  sprintf(text_line, " %04d", score);
+  text = TTF_RenderText_Solid(font_large, text_line, fgColor_red);
+  text_position.x = (24 * factor) + (9 * 12 * factor); // skip 9 chars
+  text_position.y = 145 * factor;
+  SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
+  play_sound(7, -1);
 }
 
 
-void draw_asteroids()
+void draw_ship_explosions()
 {
-  int i;
   SDL_Rect src_rect;     // image source rectangle
   SDL_Rect rect;         // image desc rectangle (w and h are ignored)
 
-  for (i = 0; i < MAX_ASTEROIDS; i++)
-  {
-    if (asteroids[i].status == 1 || asteroids[i].status == 2) {   // normal or magnetic
-      src_rect.x = 0;            // left
-      src_rect.y = 0;            // up
-      src_rect.w = 6 * factor;   // width factor pixel
-      src_rect.h = 5 * factor;   // heightfactor pixel
+  /* draw ship explosion */
+  src_rect.x = 0;  // left
+  src_rect.y = 0;  // up
+  src_rect.w = 16 * factor;   
+  src_rect.h = 13 * factor;   
 
-      rect.x = asteroids[i].x;
-      rect.y = asteroids[i].y;
-      rect.w = 8;                // ignored!
-      rect.h = 8;                // ignored!
+  rect.x = FIX_TO_SCREEN(ship_x) - 3*factor;    // x  
+  rect.y = FIX_TO_SCREEN(ship_y) - 4*factor;    // y 
+  rect.w = SHIP_W * factor;      // ignored!
+  rect.h = SHIP_H * factor;      // ignored!
 
-      // too complex code below for displaying asteroid images per frame
+  if (ship_explosions[ship_explosion_nr].img_nr != 0) {     // draw explosion
+     SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].img_nr], &src_rect, screen, &rect);
+  }  
 
-      if (asteroids[i].status == 1) {  // display alternating + en x for normal asteroid, 3 frames per image
-                                       // example +++xxx+++xxx+++xxx
-         if (asteroids[i].shape_timer >= 1 && asteroids[i].shape_timer <= ASTEROID_SHAPE_TIMER/2) {
-              SDL_BlitSurface(images[ 8 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);   // x
-         } else {  
-              SDL_BlitSurface(images[ 9 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);  // plus
-      }
+  if (ship_explosions[ship_explosion_nr].ship_nr != 0) {     // draw ship */
+    src_rect.w = SHIP_W * factor;   
+    src_rect.h = SHIP_H * factor;   
+    rect.x = FIX_TO_SCREEN(ship_x);   // x 
+    rect.y = FIX_TO_SCREEN(ship_y);   // y 
+    SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].ship_nr], &src_rect, screen, &rect);  // ship green
+  }
 
-      } else if (asteroids[i].status == 2) {  // display alternating O, + en x for normal asteroid, 3 frames per image
-                                       
-         if (asteroids[i].shape_timer >= 1 && asteroids[i].shape_timer <= ASTEROID_SHAPE_TIMER/2) {
-              SDL_BlitSurface(images[10 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);   // O
-              //printf("O\n");
-         } else { if (asteroids[i].magnetic_timer%2 == 0) {
-                     SDL_BlitSurface(images[9 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);    // plus
-                     //printf("+ timer=%d\n", asteroids[i].magnetic_timer); 
-                  } else {
-                     SDL_BlitSurface(images[8 + (asteroids[i].colour * 3 ) ], &src_rect, screen, &rect);    // x
-                     //printf("x timer=%d\n", asteroids[i].magnetic_timer); 
-                  }
-                  asteroids[i].magnetic_timer++; 
-                  if (asteroids[i].magnetic_timer > 5)
-                  asteroids[i].magnetic_timer = 0; 
-                  
-                }
-       }  // if asteroids[i].status == 2
-      
- 
-       } else if (asteroids[i].status == 3) {    // exploding 5 images
-                //printf("exploding asteroid \n");
-                src_rect.x = 0;            // left
-                src_rect.y = 0;            // up
-                src_rect.w = 16 * factor;   // width factor pixel
-                src_rect.h = 13 * factor;   // heightfactor pixel
+  if (ship_explosions[ship_explosion_nr].img_nr != 0) {     // draw explosion
+     SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].img_nr], &src_rect, screen, &rect);
+  }  
+}
 
-                rect.x = asteroids[i].x - 5 * factor;
-                rect.y = asteroids[i].y - 4 * factor;
-                rect.w = 8;                // ignored!
-                rect.h = 8;                // ignored!
 
-                SDL_BlitSurface(images[asteroids[i].shape_timer + 31], &src_rect, screen, &rect); 
-                asteroids[i].shape_timer++;
-                if (asteroids[i].shape_timer == 6) {
-                  //  after explosion disable asteroid completely
-                  asteroids[i].status = 0;
-                  //printf("asteroid completely disabled \n");
-                }
-      
-    }  // if asteroid[i].status 
-  }     // end for loop
+void handle_ship_explosions()
+{
+  /* next step of the ship explosion (after drawing) */
+  if (ship_explosion_nr%8 == 0 ) {     // add 3 bullets (=explosion bits) every 8 images*/
+                                       // these are displayed on screen in function
+                                       // draw_bullets()
+       add_explosion_bits(ship_x + FIX(SHIP_W/2), ship_y + FIX(SHIP_H/2));  // halfway ship
+   }    
+
+  ship_explosion_nr++;    // every frame 
+  if (ship_explosion_nr + 1 == SHIP_EXPLOSIONS) { // end of explosion sequences, ship gone
+     if (headless == 0) printf("GAME OVER\n");
+     ship_destroyed = 1;
+     if (high_score_broken == 1) strcpy(high_score_name, "??????");
+     flash_high_score_timer = 55;  // +/- 5 seconds : 
+     play_sound(6, -1); 
+  } 
 }
 
 
-void check_ship_collision()
+int getStarColor(int speed)
 {
-  int i, k, found;
-  int a_x, a_y, a_xr, a_yb;       // top-left and bottom-right coordinates of asteroid
-  ;
-  /* check if ship collides with an asteroid/ufo while shield is down
-     (shield is down when at least one shield-bit is not recharched */
+  SDL_Color color;
   
-  found = -1;
-  for (i = 0; i < SHIELD_BITS && found == -1; i++ ) {
-       if (shield_bits[i].status != 2) 
-            found = 1;  // shield is down
+  switch (speed)
+  {
+    case 1:
+    case 2:
+    case 3:
+      color.r = 221;  /* red */
+      color.g =  44;
+      color.b =   0;
+      break;
+        
+    case 4:
+    case 5:
+    case 6:
+      color.r =  76; /* green */
+      color.g = 175;
+      color.b =  80;
+      break;
+        
+    case 7:
+    case 8:
+    case 9:
+      color.r = 255; /* yellow */
+      color.g = 234;
+      color.b =   0;
+      break;
+      
+    default:
+      color.r = 255;  /* default white */
+      color.g = 255;
+      color.b = 255;
+      break;
   }
+  
+  return SDL_MapRGB(screen->format, color.r, color.g, color.b);
+}
 
-  /* check if an asteroid or ufo is colliding with ship */
-  if (found != -1) {  // shield is down
-    
-    /* loop active astroids */
-    for (i = 0; i < MAX_ASTEROIDS; i++)
-    {
-      if (asteroids[i].status == 1 || asteroids[i].status == 2) {
-         a_xr = (asteroids[i].x + 6 * factor) ;   // width  factor pixel
-         a_yb = (asteroids[i].y + 5 * factor) ;   // height factor pixel
-         a_x  = asteroids[i].x;
-         a_y  = asteroids[i].y;
 
-         /* check overlap of astroid and ship */
-         if ( (ship_x + SHIP_W * factor)        > a_x   &&
-               ship_x                           < a_xr  &&
-              (ship_y + SHIP_H * factor)        > a_y   &&
-               ship_y                           < a_yb) {
-         printf("DEADLY COLLISION WITH ASTEROID!\n");
-         ship_dying = 1;
-         ship_explosion_nr = 0;
-         play_sound(5, 5); 
-         }
-      }
-    }  // end loop active asteroids
+int sweep_mask(int x0, int y0, int x1, int y1, int m1, int bx, int by, int m2, int toi)
+{
+  /* pixel test after sweep_box(): walk the path from toi on in steps of
+     (at most) 1 pixel, return the first time the masks overlap or -1 */
+  int steps, t;
+
+  steps = (abs(x1 - x0) > abs(y1 - y0) ? abs(x1 - x0) : abs(y1 - y0)) / FIX_ONE + 1;
+  for (t = toi; ; t = t + FIX_ONE / steps) {
+     if (t > FIX_ONE) t = FIX_ONE;
+     if (mask_hit(m1, sweep_pos(x0, x1, t), sweep_pos(y0, y1, t), m2, bx, by)) return t;
+     if (t == FIX_ONE) return -1;
+  }
+}
 
-    /* loop active ufos */
-    for (i = 0; i < MAX_UFOS; i++)
-    {
-      if (ufo[i].status == 1) {
-         a_xr = (ufo[i].x + 8 * factor) ;   // width  factor pixel
-         a_yb = (ufo[i].y + 2 * factor) ;   // height factor pixel
-         a_x  = ufo[i].x;
-         a_y  = ufo[i].y;
 
-         /* check overlap of astroid and ship */
-         if ( (ship_x + SHIP_W * factor)        > a_x   &&
-               ship_x                           < a_xr  &&
-              (ship_y + SHIP_H * factor)        > a_y   &&
-               ship_y                           < a_yb) {
-         printf("DEADLY COLLISION WITH UFO!\n");
-         ship_dying = 1;
-         ship_explosion_nr = 0;
-         play_sound(5, 5); 
-         }
-      }
-    }    // end loop active ufos
+int mask_hit(int m1, int x1, int y1, int m2, int x2, int y2)
+{
+  /* pixel accurate collision of mask m1 at x1,y1 and mask m2 at x2,y2
+     (fixed point object positions): bounding box first, then AND the rows
+     of both masks, shifted to the same position */
+  int ax, ay, bx, by, dx, dy, y, y_end;
+  Uint64 r;
+  const mask_type * a = &masks[m1];
+  const mask_type * b = &masks[m2];
+
+  ax = (x1 >> FIX_SHIFT) + a->x;
+  ay = (y1 >> FIX_SHIFT) + a->y;
+  bx = (x2 >> FIX_SHIFT) + b->x;
+  by = (y2 >> FIX_SHIFT) + b->y;
+
+  if (ax + a->w <= bx || bx + b->w <= ax ||
+      ay + a->h <= by || by + b->h <= ay) return 0;
+
+  dx = bx - ax;      // mask b relative to mask a
+  dy = by - ay;
+  y = dy > 0 ? dy : 0;
+  y_end = (dy + b->h < a->h) ? dy + b->h : a->h;
+  for ( ; y < y_end; y++) {
+     r = b->row[y - dy];
+     r = (dx >= 0) ? (r << dx) : (r >> -dx);
+     if (a->row[y] & r) return 1;
+  }
+  return 0;
+}
 
 
+int asteroid_mask(asteroid_type * a)
+{
+  /* mask of the current asteroid shape (same choice as draw_asteroids) */
+  if (a->shape_timer >= 1 && a->shape_timer <= ASTEROID_SHAPE_TIMER/2) {
+     if (a->status == 2) return MASK_ASTEROID_BALL;
+     return MASK_ASTEROID_X;
+  }
+  if (a->status == 2 && a->magnetic_timer%2 != 0) return MASK_ASTEROID_X;
+  return MASK_ASTEROID_PLUS;
+}
 
-  } else {   // shield is active, check on hitting an asteroid or ufo
 
-      /* loop active astroids */
-      for (i = 0; i < MAX_ASTEROIDS; i++)
-      {
-        if (asteroids[i].status == 1 || asteroids[i].status == 2) {
-           a_xr = (asteroids[i].x + 6 * factor) ;   // width  factor pixel
-           a_yb = (asteroids[i].y + 5 * factor) ;   // height factor pixel
-           a_x  = asteroids[i].x;
-           a_y  = asteroids[i].y;
-           
-           /* check overlap of astroid and ship */
-           /* (ship size is larger when shield is active) */
-           if ( ((ship_x - 3) + (SHIP_W + 5) * factor)        > a_x   &&
-                 (ship_x - 3)                                 < a_xr  &&
-                ((ship_y - 3) + (SHIP_H + 3) * factor)        > a_y   &&
-                 (ship_y - 3)                                 < a_yb) {
-              //printf("hit asteroid with ship\n");
+int laser_mask(int i)
+{
+  /* \ or / laser (same choice as draw_lasers) */
+  if ( (laser[i].xm < 0 && laser[i].ym < 0) ||
+       (laser[i].xm > 0 && laser[i].ym > 0) ) return MASK_LASER_LEFT;
+  return MASK_LASER_RIGHT;
+}
 
-              // disable asteroid: set status = 3 exploding
-              play_sound(3, 3);
-
-              /* increase score */
-              if (asteroids[i].status == 1) score++;
-              if (asteroids[i].status == 2) score = score + 3;
-              if (score > high_score) {
-                    high_score = score;
-                    high_score_broken = 1;
-              }      
-
-              asteroids[i].status = 3;
-              asteroids[i].shape_timer = 1;   // explosion takes 5 images
-
-              /* disable all bullets */
-              for (k = 0; k < MAX_BULLETS; k++)
-                   bullets[k].alive = 0;
-
-              /* create 3 new bullets (=explosion bits) */
-              for (k = 0; k < MAX_BULLETS; k++) {
-                     bullets[k].alive = 1;
-                     bullets[k].timer = 15; 
-                     bullets[k].x = asteroids[i].x + (3 * factor);  // halfway asteroid
-                     bullets[k].y = asteroids[i].y + (2 * factor);  // halfway asteroid
-              }      
-              bullets[0].xm = 0;
-              bullets[0].ym = ( 40.74074 / 15) * factor; // slower and less far than normal bullet
-              bullets[1].xm = ( 28.80805 / 15) * factor;
-              bullets[1].ym = (-28.80805 / 15) * factor;  
-              bullets[2].xm = (-28.80805 / 15) * factor;
-              bullets[2].ym = (-28.80805 / 15) * factor;  
-
-              // disable shield
-              for (k = 0; k < SHIELD_BITS; k++)
-                  shield_bits[k].status = 0;
-
-           }  // end if bump asteroid with ship
-        }  
-      } // end loop active asteroids
 
-      /* loop active ufo */
-      for (i = 0; i < MAX_UFOS; i++)
-      {
-        if (ufo[i].status == 1) {
-           a_xr = (ufo[i].x + 8 * factor) ;   // width  factor pixel
-           a_yb = (ufo[i].y + 2 * factor) ;   // height factor pixel
-           a_x  = ufo[i].x;
-           a_y  = ufo[i].y;
-           
-           /* check overlap of ufo and ship */
-           /* (ship size is larger when shield is active) */
-           if ( ((ship_x - 3) + (SHIP_W + 5) * factor)        > a_x   &&
-                 (ship_x - 3)                                 < a_xr  &&
-                ((ship_y - 3) + (SHIP_H + 3) * factor)        > a_y   &&
-                 (ship_y - 3)                                 < a_yb) {
-              printf("hit ufo with ship\n");
-            
-              /* increase score */
-              score = score + 10;
-              if (score > high_score) {
-                    high_score = score;
-                    high_score_broken = 1;
-              }      
-
-              // disable ufo: set status = 3 exploding
-              play_sound(3, 3);
-
-              ufo[i].status = 3;
-              ufo[i].shape_timer = 1;   // explosion takes 5 images
-
-              /* disable all bullets */
-              for (k = 0; k < MAX_BULLETS; k++)
-                   bullets[k].alive = 0;
-
-              /* create 3 new bullets (=explosion bits) */
-              for (k = 0; k < MAX_BULLETS; k++) {
-                     bullets[k].alive = 1;
-                     bullets[k].timer = 15; 
-                     bullets[k].x = ufo[i].x + (4 * factor);  // halfway ufo
-                     bullets[k].y = ufo[i].y + (1 * factor);  // halfway ufo
-              }      
-              bullets[0].xm = 0;
-              bullets[0].ym = ( 40.74074 / 15) * factor; // slower and less far than normal bullet
-              bullets[1].xm = ( 28.80805 / 15) * factor;
-              bullets[1].ym = (-28.80805 / 15) * factor;  
-              bullets[2].xm = (-28.80805 / 15) * factor;
-              bullets[2].ym = (-28.80805 / 15) * factor;  
-
-              // disable shield
-              for (k = 0; k < SHIELD_BITS; k++)
-                  shield_bits[k].status = 0;
-
-              // Disable laser if fired from ufo (to prevent ship hit again)
-              for (k = 0; k < MAX_LASERS; k++) {
-                 if (laser[k].alive == 1 && laser[k].fired_by_ufo == i) {  
-                   printf("-- disable laser from ufo which is hit by ship \n");
-                   laser[k].alive = 0;
-                 }
-              }    
+void benchmark_collision()
+{
+  /* microbenchmark: cost per frame of the swept collision test (3 bullets and
+     3 lasers against n asteroid boxes, earliest hit) compared with the old
+     end position box test. No SDL needed */
+  const int counts[] = {35, 350, 3500, 35000};
+  int c, i, n, k, f, frames, toi, best, hits_swept, hits_box;
+  int * boxes;
+  int px[6], py[6], x[6], y[6], w[6], h[6];
+  Uint64 start, t_swept, t_box;
+
+  printf("Collision benchmark (ns per frame, 6 projectiles)\n");
+  printf("%8s %12s %12s %10s %10s\n", "objects", "swept", "end box", "hits swept", "hits box");
+
+  for (c = 0; c < 4; c++) {
+    n = counts[c];
+    boxes = malloc(n * 2 * sizeof(int));
+    if (boxes == NULL) {
+       fprintf(stderr, "Out of memory\n");
+       exit(1);
+    }
+    seed_random(1);
+    for (k = 0; k < n; k++) {
+       boxes[k*2]     = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W)) + random_nr(RNG_SPAWN, FIX_ONE);
+       boxes[k*2 + 1] = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H)) + random_nr(RNG_SPAWN, FIX_ONE);
+    }
 
-           }  // end if bump ufo with ship and active shield
-        }  
-      } // end loop active ufos
+    /* enough frames for at least 0.2 second per test */
+    frames = 20000000 / n + 10;
+    hits_swept = 0;
+    hits_box = 0;
+    t_swept = 0;
+    t_box = 0;
+
+    for (f = 0; f < frames; f++) {
+      /* 3 bullets and 3 lasers at a different spot every frame */
+      for (k = 0; k < 6; k++) {
+         px[k] = FIX((f * 7 + k * 31) % VIDEOPAC_RES_W);
+         py[k] = FIX((f * 3 + k * 17) % VIDEOPAC_RES_H);
+         if (k < 3) {
+            x[k] = px[k] + gun_speed[(f + k * 5) % SHIELD_BITS][0];
+            y[k] = py[k] + gun_speed[(f + k * 5) % SHIELD_BITS][1];
+            w[k] = FIX(1);
+            h[k] = FIX(1);
+         } else {
+            x[k] = px[k] + FIX(4);
+            y[k] = py[k] + FIX(4);
+            w[k] = FIX(8);
+            h[k] = FIX(7);
+         }
+      }
 
-  }  // end found != -1 (shield is down)
+      start = clock_ns();
+      for (k = 0; k < 6; k++) {
+         best = FIX_ONE + 1;
+         for (i = 0; i < n; i++) {
+            toi = sweep_box(px[k], py[k], x[k], y[k], w[k], h[k],
+                            boxes[i*2], boxes[i*2 + 1], FIX(6), FIX(5));
+            if (toi >= 0 && toi < best) best = toi;
+         }
+         if (best <= FIX_ONE) hits_swept++;
+      }
+      t_swept += clock_ns() - start;
+
+      start = clock_ns();
+      for (k = 0; k < 6; k++) {
+         best = 0;
+         for (i = 0; i < n; i++) {
+            if (x[k] + w[k] > boxes[i*2]          && x[k] < boxes[i*2] + FIX(6) &&
+                y[k] + h[k] > boxes[i*2 + 1]      && y[k] < boxes[i*2 + 1] + FIX(5)) best = 1;
+         }
+         hits_box += best;
+      }
+      t_box += clock_ns() - start;
+    }
+    printf("%8d %12llu %12llu %10d %10d\n", n,
+           (unsigned long long) (t_swept / frames), (unsigned long long) (t_box / frames),
+           hits_swept, hits_box);
+    free(boxes);
+  }
+
+  /* all collision checks of a game frame (with pixel masks) at 35 asteroids,
+     3 ufos, 3 bullets and 3 lasers. The objects are restored every frame */
+  load_masks();
+  MAX_ASTEROIDS = 35;
+  MAX_UFOS = 3;
+  MAX_LASERS = 3;
+  frames = 20000;
+  t_box = 0;
+  hits_box = 0;
+  for (f = 0; f < frames; f++) {
+    seed_random(f);
+    for (i = 0; i < MAX_ASTEROIDS; i++) {
+       asteroids[i].status = random_nr(RNG_SPAWN, 2) + 1;
+       asteroids[i].shape_timer = random_nr(RNG_SPAWN, ASTEROID_SHAPE_TIMER) + 1;
+       asteroids[i].magnetic_timer = 0;
+       asteroids[i].x = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W));
+       asteroids[i].y = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H));
+    }
+    for (i = 0; i < 3; i++) {
+       ufo[i].status = 1;
+       ufo[i].x = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W));
+       ufo[i].y = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H));
+       bullets[i].alive = 1;
+       bullets[i].timer = 10;
+       bullets[i].px = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W));
+       bullets[i].py = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H));
+       bullets[i].x = bullets[i].px + gun_speed[i * 5][0];
+       bullets[i].y = bullets[i].py + gun_speed[i * 5][1];
+       laser[i].alive = 1;
+       laser[i].fired_by_ufo = -1;
+       laser[i].xm = FIX(4);
+       laser[i].ym = FIX(4);
+       laser[i].px = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W));
+       laser[i].py = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H));
+       laser[i].x = laser[i].px + laser[i].xm;
+       laser[i].y = laser[i].py + laser[i].ym;
+    }
+    shield_up = SHIELD_ALL;
+    shield_charging = 0;
+    bullets_alive = MAX_BULLETS;
+    ship_x = FIX(-40);           // out of reach, no ship explosions
+    ship_y = FIX(-40);
+
+    start = clock_ns();
+    build_collision_world();
+    check_bullet_hit();
+    check_ship_collision();
+    check_laser_hit();
+    check_colliding_asteroids();
+    resolve_events();
+    t_box += clock_ns() - start;
+
+    for (i = 0; i < MAX_ASTEROIDS; i++) {
+       if (asteroids[i].status == 0 || asteroids[i].status == 3) hits_box++;
+    }
+  }
+  printf("All collision checks, 35 asteroids: %llu ns per frame (%d asteroids hit)\n",
+         (unsigned long long) (t_box / frames), hits_box);
 }
 
 
-void check_bullet_hit()
+void benchmark_threads()
 {
-  int i, j, k;
-  int a_x, a_y, a_xr, a_yb;       // top-left and bottom-right coordinates of asteroid
-  int b_x, b_y, b_xr, b_yb;       // top-left and bottom-right coordinates of bullet
-  
-  /* check if an active bullet hits an active asteroid or ufo*/
+  /* time the parallel collision tests (asteroid pairs and near asteroids)
+     on 1..16 threads, with all asteroid slots in use. The checksum of the
+     results must be the same for every number of threads */
+  const int thread_counts[] = {1, 2, 4, 8, 16};
+  int c, i, f, frames;
+  Uint32 checksum, checksum_1;
+  Uint64 start, t, t_1;
+
+  load_masks();
+  MAX_ASTEROIDS = ASTEROID_SLOTS;
+  MAX_UFOS = 0;
+  MAX_LASERS = 0;
+  ship_dying = 1;                 // no ship
+  frames = 20000000 / (ASTEROID_SLOTS * ASTEROID_SLOTS) + 10;
+  t_1 = 0;
+  checksum_1 = 0;
+
+  printf("Thread benchmark, %d asteroids (ns per frame)\n", ASTEROID_SLOTS);
+  printf("%8s %12s %8s %10s\n", "threads", "time", "speedup", "checksum");
+  for (c = 0; c < 5; c++) {
+    start_threads(thread_counts[c]);
+    col_order_ready = 0;          // same pair order as the first run
+    t = 0;
+    checksum = 0;
+    for (f = 0; f < frames; f++) {
+      /* asteroids everywhere on the screen */
+      seed_random(f);
+      for (i = 0; i < MAX_ASTEROIDS; i++) {
+         asteroids[i].status = random_nr(RNG_SPAWN, 2) + 1;
+         asteroids[i].shape_timer = random_nr(RNG_SPAWN, ASTEROID_SHAPE_TIMER) + 1;
+         asteroids[i].x = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W));
+         asteroids[i].y = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H));
+         asteroids[i].xm = FIX(1);
+         asteroids[i].ym = FIX(1);
+      }
 
-  for (j = 0; j < MAX_BULLETS; j++) {
-     if (bullets[j].alive == 1) {
+      start = clock_ns();
+      build_collision_world();
+      check_colliding_asteroids();
+      check_asteroid_positions();
+      t += clock_ns() - start;
+
+      /* checksum of the events and the new asteroid speeds */
+      for (i = event_head; i != event_tail; i++)
+         checksum = checksum * 31 + events[i & (MAX_EVENTS - 1)].a * 7 + events[i & (MAX_EVENTS - 1)].b;
+      event_head = event_tail;
+      for (i = 0; i < MAX_ASTEROIDS; i++)
+         checksum = checksum * 31 + (Uint32) (asteroids[i].xm ^ asteroids[i].ym);
+    }
+    if (c == 0) {
+      t_1 = t;
+      checksum_1 = checksum;
+    }
+    printf("%8d %12llu %8.2f %10x%s\n", num_threads,
+           (unsigned long long) (t / frames), (double) t_1 / t, checksum,
+           checksum == checksum_1 ? "" : "  DIFFERENT!");
+  }
+  stop_threads();
+}
 
-         b_xr = bullets[j].x + factor;   // width  factor pixel
-         b_yb = bullets[j].y + factor;   // height factor pixel
-         b_x  = bullets[j].x;
-         b_y  = bullets[j].y;
-
-         // check if active bullet has a hit 
-
-         /* loop active astroids */
-         for (i = 0; i < MAX_ASTEROIDS; i++)
-         {
-           if (asteroids[i].status == 1 || asteroids[i].status == 2) {
-              a_xr = (asteroids[i].x + 6 * factor);   // width  factor pixel
-              a_yb = (asteroids[i].y + 5 * factor);   // height factor pixel
-              a_x  = asteroids[i].x;
-              a_y  = asteroids[i].y;
-
-              /* check overlap of bullet and asteroid */
-              if (b_xr  > a_x   &&
-                  b_x   < a_xr  &&
-                  b_yb  > a_y   &&
-                  b_y   < a_yb) {
-
-                    // disable asteroid: set status = 3 exploding
-                    play_sound(3, 3);
-
-                    /* increase score */
-                    if (asteroids[i].status == 1) score++;
-                    if (asteroids[i].status == 2) score = score + 3;
-                    if (score > high_score) {
-                      high_score = score;
-                      high_score_broken = 1;
-                    }  
-
-                    asteroids[i].status = 3;
-                    asteroids[i].shape_timer = 1;   // explosion takes 5 images
-
-                    /* disable all bullets */
-                    for (k = 0; k < MAX_BULLETS; k++)
-                         bullets[k].alive = 0;
-
-                    /* create 3 new bullets (=explosion bits) */
-                    for (k = 0; k < MAX_BULLETS; k++) {
-                           bullets[k].alive = 1;
-                           bullets[k].timer = 15; 
-                           bullets[k].x = asteroids[i].x + (3 * factor);  // halfway asteroid
-                           bullets[k].y = asteroids[i].y + (2 * factor);  // halfway asteroid
-                     }      
-                     bullets[0].xm = 0;
-                     bullets[0].ym = ( 40.74074 / 15) * factor; // slower and less far than normal bullet
-                     bullets[1].xm = ( 28.80805 / 15) * factor;
-                     bullets[1].ym = (-28.80805 / 15) * factor;  
-                     bullets[2].xm = (-28.80805 / 15) * factor;
-                     bullets[2].ym = (-28.80805 / 15) * factor;  
 
-              }
-              // disable shield
-              for (k = 0; k < SHIELD_BITS; k++)
-                  shield_bits[k].status = 0;
-
-           }  // if status = 1 or 2
-         }    // end loop active asteroids 
-
-
-
-         /* loop active ufos */
-         for (i = 0; i < MAX_UFOS; i++)
-         {
-           if (ufo[i].status == 1) {
-              a_xr = (ufo[i].x + 8 * factor);   // width  factor pixel
-              a_yb = (ufo[i].y + 2 * factor);   // height factor pixel
-              a_x  = ufo[i].x;
-              a_y  = ufo[i].y;
-
-              /* check overlap of bullet and ufo */
-              if (b_xr  > a_x   &&
-                  b_x   < a_xr  &&
-                  b_yb  > a_y   &&
-                  b_y   < a_yb) {
-
-                    // disable ufo: set status = 3 exploding
-                    play_sound(3, 3);
-
-                    /* increase score */
-                    score = score + 10;
-                    if (score > high_score) {
-                      high_score = score;
-                      high_score_broken = 1;
-                    }  
-
-                    ufo[i].status = 3;
-                    ufo[i].shape_timer = 1;   // explosion takes 5 images
-
-                    /* disable all bullets */
-                    for (k = 0; k < MAX_BULLETS; k++)
-                         bullets[k].alive = 0;
-
-                    /* create 3 new bullets (=explosion bits) */
-                    for (k = 0; k < MAX_BULLETS; k++) {
-                           bullets[k].alive = 1;
-                           bullets[k].timer = 15;  
-                           bullets[k].x = ufo[i].x + (4 * factor);  // halfway ufo
-                           bullets[k].y = ufo[i].y + (1 * factor);  // halfway ufo
-                     }      
-                     bullets[0].xm = 0;
-                     bullets[0].ym = ( 40.74074 / 15) * factor; // slower and less far than normal bullet
-                     bullets[1].xm = ( 28.80805 / 15) * factor;
-                     bullets[1].ym = (-28.80805 / 15) * factor;  
-                     bullets[2].xm = (-28.80805 / 15) * factor;
-                     bullets[2].ym = (-28.80805 / 15) * factor;  
+void kernel_population(int n)
+{
+  /* n asteroids (1 in 4 magnetic) all over the screen, 3 bullets, 1 ufo and
+     the ship with its shield up in the middle */
+  int i;
 
-              }
-              // disable shield
-              for (k = 0; k < SHIELD_BITS; k++)
-                  shield_bits[k].status = 0;
+  seed_random(n);
+  MAX_ASTEROIDS = n;
+  MAX_UFOS = 1;
+  MAX_LASERS = 1;
+  for (i = 0; i < n; i++) {
+     asteroids[i].status = random_nr(RNG_SPAWN, 4) == 0 ? 2 : 1;
+     asteroids[i].colour = random_nr(RNG_SPAWN, 7) + 1;
+     asteroids[i].shape_timer = random_nr(RNG_SPAWN, ASTEROID_SHAPE_TIMER) + 1;
+     asteroids[i].magnetic_timer = 0;
+     asteroids[i].x = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W - 20) + 10);
+     asteroids[i].y = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H - 20) + 10);
+     asteroids[i].xm = (random_nr(RNG_SPAWN, 5) - 2) * FIX_ONE / 5;
+     asteroids[i].ym = (random_nr(RNG_SPAWN, 5) - 2) * FIX_ONE / 5;
+  }
+  for (i = 0; i < MAX_BULLETS; i++) {
+     bullets[i].alive = 1;
+     bullets[i].timer = 10;
+     bullets[i].px = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_W));
+     bullets[i].py = FIX(random_nr(RNG_SPAWN, VIDEOPAC_RES_H));
+     bullets[i].x = bullets[i].px + gun_speed[i * 5][0];
+     bullets[i].y = bullets[i].py + gun_speed[i * 5][1];
+  }
+  bullets_alive = MAX_BULLETS;
+  ufo[0].status = 1;
+  ufo[0].x = FIX(VIDEOPAC_RES_W / 4);
+  ufo[0].y = FIX(VIDEOPAC_RES_H / 4);
+  laser[0].alive = 0;
+  laser[0].fired_by_ufo = -1;
+  ship_x = FIX(VIDEOPAC_RES_W / 2);
+  ship_y = FIX(VIDEOPAC_RES_H / 2);
+  ship_dying = 0;
+  shield_up = SHIELD_ALL;
+  shield_charging = 0;
+  col_order_ready = 0;
+}
 
-           }  // if status = 1 
-         }    // end loop active ufos
 
-       }      // end if bullet alive
+Uint64 time_kernel(const kernel_type * k, asteroid_type * saved, int n, int calls)
+{
+  /* ns for calls calls from the saved population, calls == 0: one call
+     with cold caches. The events of the checks are thrown away */
+  static char * flush;
+  Uint64 start, t;
+  int c;
+
+  memcpy(asteroids, saved, n * sizeof(asteroid_type));
+  if (k->world) build_collision_world();
+  if (calls == 0) {
+     if (flush == NULL) flush = malloc(FLUSH_BYTES);
+     if (flush == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+     }
+     memset(flush, n, FLUSH_BYTES);
+  }
 
-  } // end loop active bullets
+  start = clock_ns();
+  for (c = 0; c < (calls == 0 ? 1 : calls); c++) {
+     k->run();
+     event_head = event_tail;
+  }
+  t = clock_ns() - start;
+  return t;
 }
 
 
-void check_colliding_asteroids()
+int compare_uint64(const void * a, const void * b)
 {
-  int i, j;
-  int a_x, a_y, a_xr, a_yb;       // top-left and bottom-right coordinates of asteroid
-  int b_x, b_y, b_xr, b_yb;       // top-left and bottom-right coordinates of asteroid
+  Uint64 x = *(const Uint64 *) a, y = *(const Uint64 *) b;
 
-  /* handle colliding asteroid with other asteroid and
-     colliding asteroid with ufos (ufo alway loses) */
+  return (x > y) - (x < y);
+}
 
-  /* loop active astroids (magnetic and non-magnetic) */
-  for (i = 0; i < MAX_ASTEROIDS; i++)
-  {
-    if (asteroids[i].status == 1 || asteroids[i].status == 2) {
-       a_xr = (asteroids[i].x + 6 * factor);   // width  factor pixel
-       a_yb = (asteroids[i].y + 5 * factor);   // height factor pixel
-       a_x  = asteroids[i].x;
-       a_y  = asteroids[i].y;
-
-       /* loop active astroids (magnetic and non-magnetic) */
-       for (j = 0; j < MAX_ASTEROIDS; j++)  
-       {
-          if ((asteroids[j].status == 1 || asteroids[i].status == 2) && i != j) {   // not itself
-             b_xr = (asteroids[j].x + 6 * factor);    // width  factor pixel
-             b_yb = (asteroids[j].y + 5 * factor);    // height factor pixel
-             b_x  = asteroids[j].x;
-             b_y  = asteroids[j].y;
-
-           /* check overlap of asteroids */
-           if (b_xr  > a_x   &&
-               b_x   < a_xr  &&
-               b_yb  > a_y   &&
-               b_y   < a_yb) {
-                  //printf("-- asteroids overlap: %d and %d \n", asteroids[i].colour, asteroids[j].colour );
-                  /* create magnetic 1 out of 10 */
-                  if (rand() % 10 == 0) {
-
-                       /* determine which asteroid is non-magnetic */
-                       if (asteroids[i].status == 1) {
-                          asteroids[i].status = 2;   // make magnetic, keep colour //
-                          asteroids[i].magnetic_timer = 0;
-
-                          // kill the other one (only if this one is non-magnetic)
-                          if (asteroids[j].status == 1) {
-                            asteroids[j].status = 0;
-                            add_mini_explosion(asteroids[j].x , asteroids[j].y);                          
-                          }                            
-                       } else {
-                          // asteroids[i] is magnetic, check if asteroids[j] is normal 
-                          // if so, make kill j
-                          if (asteroids[j].status == 1) {
-                             //printf("Magnetic (j) created!\n");
-                             // kill the other one
-                             asteroids[j].status = 0;
-                             add_mini_explosion(asteroids[j].x , asteroids[j].y);                          
-                          } else {
-                               // both asteroids are magnetic
-                               //printf("collision of 2 magnetic asteroid!\n");
-                               // kill the second one
-                               asteroids[j].status = 0;
-                               add_mini_explosion(asteroids[j].x , asteroids[j].y);                          
-                          }
-                       }
 
-                  }
-            }
-           } // end if asteroids[j].status == 1
+void benchmark_kernels()
+{
+  /* ns per call of the hot functions, alone, for growing populations:
+     warm (median/min/max of KERNEL_REPS runs of many calls) and cold
+     (median of single calls after writing FLUSH_BYTES) */
+  const kernel_type kernels[] = {
+    {"handle_asteroids", handle_asteroids, 0, 0},
+    {"check_asteroid_positions", check_asteroid_positions, 1, 0},
+    {"check_colliding_asteroids", check_colliding_asteroids, 1, 0},
+    {"check_bullet_hit", check_bullet_hit, 1, 0},
+    {"check_ship_collision", check_ship_collision, 1, 0},
+    {"draw_asteroids", draw_asteroids, 0, 1},
+    {"draw_stars", draw_stars, 0, 1},
+    {"save_snapshot", kernel_save_snapshot, 0, 0},
+    {"restore_snapshot", kernel_restore_snapshot, 0, 0}
+  };
+  const int counts[] = {15, 35, 1000, 10000};
+  const int factors[] = {1, 5, 9};
+  asteroid_type * saved;
+  Uint64 warm[KERNEL_REPS], cold[KERNEL_REPS];
+  int c, k, f, r, calls, nf;
+
+  setup_ship_explosions();
+  printf("Kernel benchmark (ns per call; warm: median, min and max of %d runs, "
+         "cold: caches flushed)\n", KERNEL_REPS);
+  printf("%-26s %7s %6s %11s %11s %11s %11s\n",
+         "kernel", "objects", "factor", "median", "min", "max", "cold");
+
+  for (c = 0; c < 4; c++) {
+    if (counts[c] > ASTEROID_SLOTS) {
+       printf("%d asteroids skipped: compile with -DASTEROID_SLOTS=%d\n", counts[c], counts[c]);
+       continue;
+    }
+    kernel_population(counts[c]);
+    saved = malloc(counts[c] * sizeof(asteroid_type));
+    if (saved == NULL) {
+       fprintf(stderr, "Out of memory\n");
+       exit(1);
+    }
+    memcpy(saved, asteroids, counts[c] * sizeof(asteroid_type));
+
+    for (k = 0; k < (int) (sizeof(kernels) / sizeof(kernels[0])); k++) {
+      nf = kernels[k].draw ? 3 : 1;
+      for (f = 0; f < nf; f++) {
+        if (kernels[k].draw && factor != factors[f]) {
+           factor = factors[f];
+           handle_screen_resize();
+        }
+
+        /* warm up, and enough calls for about 1 ms per run (max 256: the
+           asteroids move) */
+        calls = 1;
+        while (calls < 256 && time_kernel(&kernels[k], saved, counts[c], calls) < 1000000)
+           calls = calls * 2;
+
+        for (r = 0; r < KERNEL_REPS; r++) {
+           warm[r] = time_kernel(&kernels[k], saved, counts[c], calls) / calls;
+           cold[r] = time_kernel(&kernels[k], saved, counts[c], 0);
+        }
+        qsort(warm, KERNEL_REPS, sizeof(Uint64), compare_uint64);
+        qsort(cold, KERNEL_REPS, sizeof(Uint64), compare_uint64);
+
+        if (kernels[k].draw) {
+           printf("%-26s %7d %6d", kernels[k].name, counts[c], factor);
+        } else {
+           printf("%-26s %7d %6s", kernels[k].name, counts[c], "-");
+        }
+        printf(" %11llu %11llu %11llu %11llu\n",
+               (unsigned long long) warm[KERNEL_REPS / 2], (unsigned long long) warm[0],
+               (unsigned long long) warm[KERNEL_REPS - 1], (unsigned long long) cold[KERNEL_REPS / 2]);
+      }
+    }
+    free(saved);
+  }
+  if (events_lost > 0)
+     printf("%llu events lost (event queue full), the checks still ran in full\n",
+            (unsigned long long) events_lost);
+}
 
-        }  // end j-loop asteroids
+
+void benchmark_sweep()
+{
+  /* the same seeded session at every window size: render cost per factor */
+  const int phases[] = {PROF_CLEAR, PROF_STARS, PROF_SHIP, PROF_BULLETS, PROF_LASERS,
+                        PROF_ASTEROIDS, PROF_UFO, PROF_EXPLOSIONS, PROF_SCORE, PROF_FLIP};
+  const int num_phases = sizeof(phases) / sizeof(phases[0]);
+  int start = factor, run, n, p;
+  double total;
+
+  printf("Resolution sweep: %d frames per factor, seed %u, difficulty %d "
+         "(mean us per frame; KB written per frame)\n", sweep_frames, rng_seed, batch_difficulty);
+  printf("%-6s %9s", "factor", "size");
+  for (p = 0; p < num_phases; p++)
+     printf(" %9s", prof_names[phases[p]]);
+  printf(" %9s %9s %9s\n", "frame", "KB blits", "KB flip");
+
+  for (run = 1; run <= 10; run++) {
+     if (run <= 9) {
+        full_screen = 0;
+        factor = run;
+     } else {                                   // like the 8 key
+        full_screen = 1;
+        factor = start;
+        if (monitor_height >= 1080) factor = 5;
+        if (monitor_height <= 768)  factor = 3;
+     }
+     handle_screen_resize();
+     if (screen == NULL) exit(1);
+
+     set_difficulty(batch_difficulty);
+     seed_random(rng_seed);
+     init_game();
+     for (p = 0; p < NUM_PROF_PHASES; p++)
+        prof_total[p] = 0;
+     prof_total_frames = 0;
+     touched_bytes = 0;
+     touch_on = 1;
+     prof_start();
+     for (n = 0; n < sweep_frames; n++) {
+        scripted_frame();
+        prof_end_frame();
+     }
+     touch_on = 0;
+
+     total = 0;
+     for (p = 0; p < NUM_PROF_PHASES; p++)
+        total += prof_total[p];
+     if (run <= 9) {
+        printf("%-6d %4dx%-4d", factor, screen->w, screen->h);
+     } else {
+        printf("full %d %4dx%-4d", factor, screen->w, screen->h);
+     }
+     for (p = 0; p < num_phases; p++)
+        printf(" %9.1f", prof_total[phases[p]] / 1000.0 / sweep_frames);
+     printf(" %9.1f", total / 1000.0 / sweep_frames);
+#ifdef COUNT_BLITS
+     printf(" %9.1f", touched_bytes / 1024.0 / sweep_frames);
+#else
+     printf(" %9s", "-");
+#endif
+     printf(" %9.1f\n", screen->pitch * screen->h / 1024.0);
+  }
+  full_screen = 0;
+}
 
 
-       /* loop active ufos */
-       for (j = 0; j < MAX_UFOS; j++) { 
-       if (ufo[j].status == 1) {  
-             b_xr = (ufo[j].x + 8 * factor);    // width  factor pixel
-             b_yb = (ufo[j].y + 2 * factor);    // height factor pixel
-             b_x  = ufo[j].x;
-             b_y  = ufo[j].y;
+#ifdef __linux__
+void drop_files(const char * path)
+{
+  /* drop the pages of this file, or of all files below this directory,
+     from the cache */
+  char name[1024];
+  struct dirent * e;
+  DIR * d;
+  int fd;
+
+  d = opendir(path);
+  if (d == NULL) {
+     fd = open(path, O_RDONLY);
+     if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+     }
+     return;
+  }
+  while ((e = readdir(d)) != NULL) {
+     if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+     snprintf(name, sizeof(name), "%s/%s", path, e->d_name);
+     drop_files(name);
+  }
+  closedir(d);
+}
+#endif
 
-           /* check overlap of asteroid[i] with ufo */
-           if (b_xr  > a_x   &&
-               b_x   < a_xr  &&
-               b_yb  > a_y   &&
-               b_y   < a_yb) {
-                  // kill ufo, keep asteroid (do not make magnetic, there will be too many)
-                  ufo[j].status = 0;
-                  if (Mix_Playing(6)) Mix_HaltChannel(6);    // stop audio for ufo               
-                  add_mini_explosion(ufo[j].x , ufo[j].y);                          
-            } // check overlap
 
-           } // end if ufo[j].status == 1
+void startup_begin()
+{
+  /* time 0 of the startup benchmark. --cold: empty the cache, all of it
+     when we may, else the files setup() reads */
+  startup_step_type first;
+#ifdef __linux__
+  FILE * f;
+
+  if (startup_cold) {
+     sync();
+     f = fopen("/proc/sys/vm/drop_caches", "w");
+     if (f != NULL && fputs("3\n", f) >= 0 && fclose(f) == 0) {
+        startup_cold_how = "drop_caches";
+     } else {
+        if (f != NULL) fclose(f);
+        drop_files(DATA_PREFIX);
+        drop_files("O2.ttf");
+        startup_cold_how = "fadvise";
+     }
+  }
+#else
+  if (startup_cold) fprintf(stderr, "Warning: --cold only works on Linux\n");
+#endif
+  startup_counters(&first);
+  startup_counters(&startup_last);
+  startup_own_syscalls = startup_last.rw_syscalls - first.rw_syscalls;
+  startup_counters(&startup_last);
+  startup_last.ns = clock_ns();
+}
 
-        }  // end j-loop ufos
 
+void startup_counters(startup_step_type * c)
+{
+  /* counters since the start of the process, -1 when not known */
+#ifndef _WIN32
+  struct rusage usage;
+#endif
+#ifdef __linux__
+  FILE * f;
+  char line[80];
+  long n;
+#endif
 
-      }    // if asteroids[i].status == 1
-   }       // end i-loop asteroids
-}   
+  c->files = -1;
+#ifdef COUNT_FILES
+  c->files = files_opened;
+#endif
+  c->rw_syscalls = -1;
+  c->major_faults = -1;
+  c->blocks_in = -1;
+#ifndef _WIN32
+  getrusage(RUSAGE_SELF, &usage);
+  c->major_faults = usage.ru_majflt;
+  c->blocks_in = usage.ru_inblock;
+#endif
+#ifdef __linux__
+  f = fopen("/proc/self/io", "r");
+  if (f != NULL) {
+     c->rw_syscalls = 0;
+     while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "syscr: %ld", &n) == 1 || sscanf(line, "syscw: %ld", &n) == 1)
+           c->rw_syscalls += n;
+     }
+     fclose(f);
+  }
+#endif
+}
 
 
-void check_asteroid_positions()
+void startup_mark(const char * step)
 {
-  /* check of asteroids are about to collide
-     if so, try to avoid that (but collisions may still happen) */
-  int i, j;
-  float a_mx, a_my, b_mx, b_my, distance; 
+  /* the time and counters since the previous mark go to this step */
+  startup_step_type now;
+  startup_step_type * s;
+
+  now.ns = clock_ns();
+  startup_counters(&now);
+  if (startup_num_steps < STARTUP_STEPS) {
+     s = &startup_steps[startup_num_steps++];
+     s->name = step;
+     s->ns = now.ns - startup_last.ns;
+     s->files = now.files < 0 ? -1 : now.files - startup_last.files;
+     s->rw_syscalls = now.rw_syscalls < 0 ? -1 :
+                      now.rw_syscalls - startup_last.rw_syscalls - startup_own_syscalls;
+     s->major_faults = now.major_faults < 0 ? -1 : now.major_faults - startup_last.major_faults;
+     s->blocks_in = now.blocks_in < 0 ? -1 : now.blocks_in - startup_last.blocks_in;
+  }
+  startup_counters(&startup_last);       // without the cost of this mark
+  startup_last.ns = clock_ns();
+}
 
-  /* loop alle active astroids */
-  for (i = 0; i < MAX_ASTEROIDS; i++)
-  {
-    if (asteroids[i].status == 1 || asteroids[i].status == 2) {
-       a_mx = (asteroids[i].x + 6/2 * factor);   // center x coordinate
-       a_my = (asteroids[i].y + 5/2 * factor);   // center y coordinate
-
-       /* loop active astroids */
-       for (j = 0; j < MAX_ASTEROIDS; j++)  
-       {
-          if ((asteroids[j].status == 1 || asteroids[j].status == 2) && i != j) {   // not itself
-             b_mx = (asteroids[j].x + 6/2 * factor);  // center x coordinate
-             b_my = (asteroids[j].y + 5/2 * factor);  // center y coordinate
-
-           /* check distance of asteroids: Pythagoras ! */
-           distance = (fabs(b_mx - a_mx)) * (fabs(b_mx - a_mx)); // x^2
-           distance = distance + ( (fabs(b_my - a_my)) * (fabs(b_my - a_my)) ); // + y^2
-           distance = sqrtf(distance);  // sqrt
-
-           if ( distance < factor * 10 ) {
-                  //printf("-- asteroids too near %d, %d \n", asteroids[i].colour, asteroids[j].colour);
-                  if (rand() % 10 == 1) {    // 1 out of 10, when larger increases chance
-                                             // of collision (= magnetic asteroid)
-                       //printf("avoiding started!\n");
-                       // change x-direction
-                       if ( fabs(b_mx - a_mx) < factor * 10) {
-                           asteroids[i].xm = -1 * asteroids[i].xm;
-                           asteroids[j].xm = -1 * asteroids[i].xm;
-                       }
-                       // change y-direction
-                       if ( fabs(b_my - a_my) < factor * 10) {
-                           asteroids[i].ym = -1 * asteroids[i].ym;
-                           asteroids[j].ym = -1 * asteroids[i].ym;
-                       }
 
-                  }
-            }
+double startup_before_main()
+{
+  /* ms from the start of the process till now (exec, loading the
+     libraries), -1 when not known. Resolution is one clock tick (10 ms) */
+#ifdef __linux__
+  struct timespec t;
+  unsigned long long start;
+  char buf[1024], * p;
+  FILE * f;
+  int n;
+
+  f = fopen("/proc/self/stat", "r");
+  if (f == NULL) return -1;
+  n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = 0;
+  p = strrchr(buf, ')');                 // the name may contain spaces
+  if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+                          "%*d %*d %*d %*d %*d %*d %llu", &start) != 1) return -1;
+  clock_gettime(CLOCK_BOOTTIME, &t);
+  return (t.tv_sec + t.tv_nsec / 1e9 - (double) start / sysconf(_SC_CLK_TCK)) * 1000;
+#else
+  return -1;
+#endif
+}
 
-           } // end if asteroids[j].status == 1 || 2
 
-        }  // end j-loop asteroids
+void startup_report()
+{
+  /* JSON to stdout or --json FILE */
+  FILE * f = results_out;
+  Uint64 total = 0;
+  int i;
 
-      }    // if asteroids[i].status == 1 || 2
-   }       // end i-loop asteroids
+  for (i = 0; i < startup_num_steps; i++)
+     total += startup_steps[i].ns;
+  if (bench_json != NULL) {
+     f = fopen(bench_json, "w");
+     if (f == NULL) {
+        fprintf(stderr, "Cannot create %s: %s\n", bench_json, strerror(errno));
+        exit(1);
+     }
+  }
+  fprintf(f, "{\"cold\": \"%s\", \"setup_ms\": %.3f, \"process_ms\": %.0f, \"factor\": %d,\n",
+          startup_cold_how, total / 1e6, startup_before_main(), factor);
+  fprintf(f, " \"steps\": [\n");
+  for (i = 0; i < startup_num_steps; i++) {
+     fprintf(f, "  {\"step\": \"%s\", \"ms\": %.3f, \"files\": %ld, \"rw_syscalls\": %ld, "
+             "\"major_faults\": %ld, \"blocks_in\": %ld}%s\n",
+             startup_steps[i].name, startup_steps[i].ns / 1e6, startup_steps[i].files,
+             startup_steps[i].rw_syscalls, startup_steps[i].major_faults, startup_steps[i].blocks_in,
+             i < startup_num_steps - 1 ? "," : "");
+  }
+  fprintf(f, "]}\n");
+  if (f != results_out) fclose(f);
+  else fflush(f);
 }
 
 
-void draw_mini_explosions()
+#ifdef COUNT_FILES
+SDL_RWops * count_open(const char * file, const char * mode)
 {
-  int i;
-  SDL_Rect src_rect;     // image source rectangle
-  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+  /* SDL_RWFromFile() (SDL_LoadBMP() and Mix_LoadWAV() use it) */
+  files_opened++;
+  return (SDL_RWFromFile)(file, mode);
+}
 
-  for (i = 0; i < MAX_MINI_EXPLOSIONS; i++)
-  {
-    if (mini_explosions[i].alive == 1) {
-      src_rect.x = 0;            // left
-      src_rect.y = 0;            // up
-      src_rect.w = factor * 8 ;  // 1 factor pixel x w
-      src_rect.h = factor * 8 ;  // 1 factor pixel x h
 
-      rect.x = mini_explosions[i].x;
-      rect.y = mini_explosions[i].y;
-      rect.w = 8;                // ignored!
-      rect.h = 8;                // ignored!
-      
-      mini_explosions[i].timer--;
-      if (mini_explosions[i].timer == 0) {
-          //printf("Mini explosion timed oud\n");
-          mini_explosions[i].alive = 0;
-      } else {
-          if (mini_explosions[i].timer > 5) {   
-            SDL_BlitSurface(images[37], &src_rect, screen, &rect);   // yello
-          }
-          else {
-            SDL_BlitSurface(images[38], &src_rect, screen, &rect);   // grey
-          } 
-      }
-    }   // alive == 1
-  }     // end for loop 
+TTF_Font * count_font(const char * file, int size)
+{
+  files_opened++;
+  return (TTF_OpenFont)(file, size);
 }
+#endif
 
 
-void add_mini_explosion(int x, int y)
+#ifdef COUNT_BLITS
+int count_blit(SDL_Surface * s, SDL_Rect * sr, SDL_Surface * d, SDL_Rect * dr)
 {
-  int i, found;
-  
-  /* Find a slot: */
-  found = -1;
-  for (i = 0; i < MAX_MINI_EXPLOSIONS && found == -1; i++) {
-     if (mini_explosions[i].alive == 0)
-        found = i;
+  /* SDL_BlitSurface(), SDL sets dr to the part that was written
+     (dr NULL: at 0, 0 and as large as sr or s, within d) */
+  int result, w, h;
+
+  result = SDL_UpperBlit(s, sr, d, dr);
+  if (touch_on) {
+     if (dr == NULL) {
+        w = sr != NULL ? sr->w : s->w;
+        h = sr != NULL ? sr->h : s->h;
+        touched_bytes += (w < d->w ? w : d->w) * (h < d->h ? h : d->h) * d->format->BytesPerPixel;
+     } else {
+        touched_bytes += dr->w * dr->h * d->format->BytesPerPixel;
+     }
   }
-  
-  /* Turn the explosion on: */
-  if (found != -1)
-    { 
-      mini_explosions[found].alive = 1;
-      mini_explosions[found].timer = 15;  // 15 frames; 
-                                          // 10 frames = 1/3 seconds = 333 ms
-      mini_explosions[found].x = x;
-      mini_explosions[found].y = y;
-      
-      //printf("Mini explosion added x,y: %d, %d \n", x, y); 
-      play_sound(4, 4);   
+  return result;
+}
 
-    }  // if (found != -1)
 
+int count_fill(SDL_Surface * d, SDL_Rect * r, Uint32 c)
+{
+  /* SDL_FillRect(), SDL clips r to the part that was written */
+  int result;
+
+  result = (SDL_FillRect)(d, r, c);
+  if (touch_on) {
+     if (r == NULL) {
+        touched_bytes += d->w * d->h * d->format->BytesPerPixel;
+     } else {
+        touched_bytes += r->w * r->h * d->format->BytesPerPixel;
+     }
+  }
+  return result;
 }
+#endif
 
 
-void draw_ufo()
+void run_batch()
 {
-  int i;
-  SDL_Rect src_rect;     // image source rectangle
-  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
+  /* play batch_games games headless, divided over the threads, and write
+     the result of every game (in game order) to the CSV file */
+  FILE * f;
+  int g;
+  Uint64 start, t, total_frames;
 
-  for (i = 0; i < MAX_UFOS; i++)
-  {
-    if (ufo[i].status == 1 || ufo[i].status == 3) {   // active or exploding
-      src_rect.x = 0;            // left
-      src_rect.y = 0;            // up
-      src_rect.w = 8 * factor;   // width  factor pixel
-      src_rect.h = 2 * factor;   // height factor pixel
+  setup_ship_explosions();
+  load_masks();
+  batch_results = malloc(batch_games * sizeof(batch_result_type));
+  if (batch_results == NULL) {
+     fprintf(stderr, "Out of memory\n");
+     exit(1);
+  }
 
-      rect.x = ufo[i].x;
-      rect.y = ufo[i].y;
-      rect.w = 8;                // ignored!
-      rect.h = 8;                // ignored!
+  start = clock_ns();
+  run_parallel(play_batch_games, NULL, batch_games, 1);
+  t = clock_ns() - start;
 
-      if (ufo[i].status == 1) {  // 
-              SDL_BlitSurface(images[62 + (ufo[i].colour) ], &src_rect, screen, &rect);  // colour 1-7
-      } else if (ufo[i].status == 3) {    // exploding 5 images
-                //printf("exploding ufo \n");
-                src_rect.x = 0;            // left
-                src_rect.y = 0;            // up
-                src_rect.w = 16 * factor;   // width factor pixel of explosion
-                src_rect.h = 13 * factor;   // heightfactor pixel of explosion
+  f = results_out;
+  if (batch_csv != NULL) {
+     f = fopen(batch_csv, "w");
+     if (f == NULL) {
+        fprintf(stderr, "Couldn't write %s: %s\n", batch_csv, strerror(errno));
+        exit(1);
+     }
+  }
+  fprintf(f, "game,seed,score,frames,death\n");
+  total_frames = 0;
+  for (g = 0; g < batch_games; g++) {
+     fprintf(f, "%d,%u,%d,%d,%s\n", g, batch_results[g].seed, batch_results[g].score,
+             batch_results[g].frames, death_names[batch_results[g].death_cause]);
+     total_frames += batch_results[g].frames;
+  }
+  if (f != results_out) fclose(f);
+  else fflush(f);
 
-                rect.x = ufo[i].x - 5 * factor;
-                rect.y = ufo[i].y - 4 * factor;
-                rect.w = 8;                // ignored!
-                rect.h = 8;                // ignored!
+  printf("%d games, %llu frames in %.3f s on %d threads: %.0f frames per second\n",
+         batch_games, (unsigned long long) total_frames, t / 1e9, num_threads,
+         t > 0 ? total_frames * 1e9 / t : 0.0);
+  free(batch_results);
+}
 
-                SDL_BlitSurface(images[ufo[i].shape_timer + 31], &src_rect, screen, &rect); 
-                
-                ufo[i].shape_timer++;
-                if (ufo[i].shape_timer == 6) {
-                  //  after explosion disable ufo completely
-                  ufo[i].status = 0;
-                  //printf("ufo completely disabled \n");
-                }
-           }  
-    }   // if ufo[i].status 
-  }     // end for loop
+
+void play_batch_games(void * data, int begin, int end)
+{
+  /* games begin..end-1 (runs on any thread, all game state is per thread) */
+  int g;
+
+  (void) data;
+  headless = 1;
+  for (g = begin; g < end; g++)
+     play_batch_game(g);
 }
 
 
-void add_ufo()
+void play_batch_game(int g)
 {
- int i, found, direction;
-  
-  /* Find a slot: */
-  found = -1;
-  for (i = 0; i < MAX_UFOS && found == -1; i++) {
-     if (ufo[i].status == 0)
-        found = i;
+  /* one game till the ship is hit (or batch_max_frames) */
+  start_headless_game(rng_seed + g);
+  while (ship_dying == 0 && frame < batch_max_frames) {
+     frame++;
+     if (batch_policy == POLICY_BOT) {
+        handle_ship_input(bot_input());
+     } else {
+        handle_ship_input(script_input());
+     }
+     game_frame(0);
   }
-  
-  /* Turn the ufo on: */
-  /* (size is 8 pixels wide and 2 pixels tall) */
-  if (found != -1) {
-      //printf("UFO created\n");  
-      ufo[found].status      = 1;                      // active
-      ufo[found].colour      = (rand() % 7) + 1;       // random 1-7
-      ufo[found].shape_timer = ASTEROID_SHAPE_TIMER;   // count_down timer for explosion
 
-      /* random 1 of 4 starting positions 
-         but always moving diagonal and speed 3 */
-      direction = rand() %4 + 1; 
-        switch (direction) {
-        case (1):
-          /* spawn from top */
-          //ufo[found].x  = ( (rand() % (screen_width - 20 * factor)) + 10 * factor );
-          ufo[found].x  = ( (rand() % (screen_width - 80 * factor)) + 40 * factor );
-          ufo[found].y  = -2 * factor;                    // height of ufo out of screen
-          ufo[found].xm = (-6 * (rand()%2))  + 3;         // values -3 or 3) 
-          ufo[found].ym = 2;    
-          break;
-        case (2):
-          /* spawn from bottom */
-          //ufo[found].x  = ( (rand() % (screen_width - 20 * factor)) + 10 * factor );
-          ufo[found].x  = ( (rand() % (screen_width - 80 * factor)) + 40 * factor );
-          ufo[found].y  = screen_height + (factor * 2);   // height of ufo out of screen
-          ufo[found].xm = (-6 * (rand()%2))  + 3;         // values -3 or 3) 
-          ufo[found].ym = -2;
-          break;
-        case (3):
-          /* spawn from left */
-          ufo[found].x  = -8 * factor;                     // width of ufo out of screen
-          //ufo[found].y  = ( (rand() % (screen_height - 20 * factor)) + 10 * factor );
-          ufo[found].y  = ( (rand() % (screen_height - 80 * factor)) + 20 * factor );
-          ufo[found].xm = 2;
-          ufo[found].ym = ( rand() % 5) - 2;               // values -2, -1, 0, 1 or 2) 
-          ufo[found].ym = (-6 * (rand()%2))  + 3;          // values -3 or 3) 
-          break;
-        case (4):
-          /* spawn from right */
-          ufo[found].x  = screen_width + (factor * 8);      // width of asteroid out of screen
-          //ufo[found].y  = ( (rand() % (screen_height - 20 * factor)) + 10 * factor );
-          ufo[found].y  = ( (rand() % (screen_height - 80 * factor)) + 20 * factor );
-          ufo[found].xm = -2;
-          ufo[found].ym = (-6 * (rand()%2))  + 3;          // values -3 or 3) 
-          break;
-        }
-      /*  adjust speed for current factor */
-      ufo[found].xm = ufo[found].xm * (factor / 5.0);
-      ufo[found].ym = ufo[found].ym * (factor / 5.0);
+  batch_results[g].seed = rng_seed + g;
+  batch_results[g].score = score;
+  batch_results[g].frames = frame;
+  batch_results[g].death_cause = death_cause;
+}
 
-      //printf("ufo i=%d added\n", found);
-      play_sound(9,6);
 
-  }  // if not found 
+void start_headless_game(Uint32 seed)
+{
+  /* new game with the batch options, nothing left of the game before */
+  set_difficulty(batch_difficulty);
+  if (batch_asteroids > 0) MAX_ASTEROIDS = batch_asteroids;
+  if (batch_ufo_randomness > 0) UFO_RANDOMNESS = batch_ufo_randomness;
+  if (batch_asteroid_randomness > 0) ASTEROID_RANDOMNESS = batch_asteroid_randomness;
+
+  seed_random(seed);
+  clear_objects();
+  high_score = 0;
+  bot_keys = 0;
+  bot_timer = 0;
+  init_game();
 }
 
 
-void handle_ufo()
+void clear_objects()
 {
-   int i, j, k, lx, ly, xm, ym;
-   int laser_for_ufo_added;
-   int laser_type;    // 1 = backward down     3 = forward down
-                      // 2 = backward up       4 = forward up
+  /* start_new_game() only switches the objects off; clear them completely so a
+     game does not depend on the game played before it (on this thread) */
+  col_order_ready = 0;
+  memset(asteroids, 0, sizeof(asteroids));
+  memset(ufo, 0, sizeof(ufo));
+  memset(laser, 0, sizeof(laser));
+  memset(bullets, 0, sizeof(bullets));
+  memset(mini_explosions, 0, sizeof(mini_explosions));
+}
 
-   for (i = 0; i < MAX_UFOS; i++)
-   {
 
-     if (ufo[i].status == 1)
-     {
-       /* Move: */
-        ufo[i].x = ufo[i].x + ufo[i].xm;
-        ufo[i].y = ufo[i].y + ufo[i].ym;
-        ufo[i].shape_timer--;;          
-        
-        // timer for ufo explosion
-        if (ufo[i].shape_timer == 0) {
-            ufo[i].shape_timer = ASTEROID_SHAPE_TIMER ;
-        }
+void run_fuzz()
+{
+  /* look for the slowest frame: every round each thread changes one of the
+     kept cases (seed or a run of keys) and plays it. A case slower than the
+     last kept one is played again on this thread and kept if it still is */
+  fuzz_case_type swap;
+  int round, k, i;
 
-        /* Is ufo off-screen? */
-        if (ufo[i].x < -8 * factor || ufo[i].x >= screen_width  + (8 * factor) ||
-            ufo[i].y < -2 * factor || ufo[i].y >= screen_height + (2 * factor)) {
-            ufo[i].status = 0;
-            if (Mix_Playing(6)) Mix_HaltChannel(6);
-            //printf("-- ufo off screen: removed...\n");
+  setup_ship_explosions();
+  load_masks();
+  headless = 1;
+  for (k = 0; k < FUZZ_KEEP; k++) fuzz_alloc(&fuzz_kept[k]);
+  for (k = 0; k < num_threads; k++) fuzz_alloc(&fuzz_tries[k]);
+
+  /* first case: the script of --bench */
+  fuzz_kept[0].seed = rng_seed;
+  for (frame = 1; frame <= batch_max_frames; frame++)
+     fuzz_kept[0].keys[frame - 1] = script_input();
+  in_job = 1;                            // no threads inside the game
+  play_fuzz_case(&fuzz_kept[0], FUZZ_RUNS);
+  in_job = 0;
+  fuzz_num_kept = 1;
+  printf("Fuzz: seed %u, %d frames, slowest frame %d: %u ns\n", fuzz_kept[0].seed,
+         fuzz_kept[0].frames, fuzz_kept[0].worst_frame, fuzz_kept[0].worst_ns);
+
+  for (round = 1; round <= fuzz_rounds; round++) {
+     for (k = 0; k < num_threads; k++)
+        fuzz_mutate(&fuzz_tries[k], &fuzz_kept[hash_random(round, k) % fuzz_num_kept],
+                    hash_random(round, k + 1000));
+     run_parallel(play_fuzz_tries, NULL, num_threads, 1);
+
+     for (k = 0; k < num_threads; k++) {
+        if (fuzz_num_kept == FUZZ_KEEP && fuzz_tries[k].worst_ns <= fuzz_kept[FUZZ_KEEP - 1].worst_ns)
+           continue;
+        in_job = 1;
+        play_fuzz_case(&fuzz_tries[k], FUZZ_RUNS);
+        in_job = 0;
+        if (fuzz_num_kept == FUZZ_KEEP && fuzz_tries[k].worst_ns <= fuzz_kept[FUZZ_KEEP - 1].worst_ns)
+           continue;
+
+        /* keep it in order, the last one goes back to the tries */
+        i = fuzz_num_kept < FUZZ_KEEP ? fuzz_num_kept++ : FUZZ_KEEP - 1;
+        swap = fuzz_kept[i];
+        fuzz_kept[i] = fuzz_tries[k];
+        fuzz_tries[k] = swap;
+        for (; i > 0 && fuzz_kept[i].worst_ns > fuzz_kept[i - 1].worst_ns; i--) {
+           swap = fuzz_kept[i];
+           fuzz_kept[i] = fuzz_kept[i - 1];
+           fuzz_kept[i - 1] = swap;
+        }
+        if (i == 0) {
+           printf("Round %d: seed %u, %d frames, slowest frame %d: %u ns\n", round,
+                  fuzz_kept[0].seed, fuzz_kept[0].frames, fuzz_kept[0].worst_frame,
+                  fuzz_kept[0].worst_ns);
         }
+     }
+  }
 
-        /* If possible fire a laser
-           First check if UFO already has an active laser, if so, don't fire 
-           a possible second laser for this ufo */
-        laser_for_ufo_added = -1;
-        for (k = 0; k < MAX_LASERS && laser_for_ufo_added == -1; k++) {
-          if (laser[k].fired_by_ufo == i) {
-            laser_for_ufo_added = j;
-          }
-        } // end loop j
+  for (k = 0; k < fuzz_num_kept; k++) {
+     char file[1024];
+     snprintf(file, sizeof(file), "%s.%d.case", fuzz_out, k + 1);
+     write_fuzz_case(file, &fuzz_kept[k]);
+     printf("%s: seed %u, slowest frame %d: %u ns\n", file, fuzz_kept[k].seed,
+            fuzz_kept[k].worst_frame, fuzz_kept[k].worst_ns);
+  }
+}
 
 
-        for (j = 0; j < MAX_LASERS && laser_for_ufo_added == -1; j++)  
-        {
-          if ( laser[j].alive == 1) {   // skip active lasers
-              ; 
-          } else {
-              /* fire laser if ship is in range */
-              lx = ufo[i].x + (2 * factor);    // possible laser x starting point
-              ly = ufo[i].y;                   // possible laser x starting point
+void fuzz_alloc(fuzz_case_type * c)
+{
+  c->keys = calloc(batch_max_frames, 1);
+  c->ns = malloc(batch_max_frames * sizeof(Uint32));
+  if (c->keys == NULL || c->ns == NULL) {
+     fprintf(stderr, "Out of memory\n");
+     exit(1);
+  }
+}
 
-              // check if backward or forward laser can hit ship 
-              laser_type = 0;
-                if ( abs( ((ship_x + 2*factor) - (lx-ly))  -  ((ship_y + 2*factor)) ) <= 2*factor ) {   // middle of ship +- 2        
-                 if (ship_y > ufo[i].y + 4 * factor) {
-                   laser_type = 1;
-                 } else {   
-                   laser_type = 2;
-                 }
-              }
-                if ( abs( (lx - (ship_x - 2*factor)) - ((ship_y + 2*factor) - ly) ) <= 2*factor ) {   // middle of ship +- 2
-                 if (ship_y > ufo[i].y + 4 * factor) {
-                   laser_type = 3;
-                 } else {   
-                   laser_type = 4;
-                 }
-              }
 
-              if (laser_type != 0) {
-                  switch (laser_type) {
-                    case 1:
-                      xm = 1;
-                      ym = 1;
-                      break;
-                    case 2:
-                      xm = -1;
-                      ym = -1;
-                      break;
-                    case 3:
-                      xm = -1;
-                      ym = 1;
-                      break;
-                    case 4:
-                      xm = 1;
-                      ym = -1;
-                      break;
-                  }    
-               add_laser(ufo[i].x + (2 * factor), ufo[i].y, xm, ym, i );
-               laser_for_ufo_added = i;
-              }    
-           }  // end laser[j].alive == 1 && laser[j].fired_by_ufo == i   
-        }     // end j-loop
+void fuzz_mutate(fuzz_case_type * c, const fuzz_case_type * parent, Uint32 r)
+{
+  /* c = parent with another seed, or a run of frames with other keys:
+     the same keys, random keys or the keys of an other run */
+  int i, start, len, from, keys;
+
+  c->seed = parent->seed;
+  memcpy(c->keys, parent->keys, batch_max_frames);
+
+  /* mostly in the frames that were played */
+  start = hash_random(r, 1) % (parent->frames < batch_max_frames ? parent->frames + 1 : batch_max_frames);
+  len = hash_random(r, 2) % FUZZ_SPAN + 1;
+  if (start + len > batch_max_frames) len = batch_max_frames - start;
+  keys = hash_random(r, 3) % 32;
+  from = hash_random(r, 4) % (batch_max_frames - len + 1);
+
+  switch (r % 4) {
+     case 0:
+        c->seed = hash_random(r, 5);
+        break;
+     case 1:
+        memset(c->keys + start, keys, len);
+        break;
+     case 2:
+        for (i = 0; i < len; i++)
+           c->keys[start + i] = hash_random(r, i + 6) % 32;
+        break;
+     default:
+        memmove(c->keys + start, parent->keys + from, len);
+        break;
+  }
+}
+
 
+void play_fuzz_case(fuzz_case_type * c, int runs)
+{
+  /* the same game runs times, fastest time of every frame, then the
+     slowest frame */
+  Uint64 start;
+  Uint32 ns;
+  int run;
+
+  for (run = 0; run < runs; run++) {
+     start_headless_game(c->seed);
+     while (ship_dying == 0 && frame < batch_max_frames) {
+        frame++;
+        start = clock_ns();
+        handle_ship_input(c->keys[frame - 1]);
+        game_frame(0);
+        ns = (Uint32) (clock_ns() - start);
+        if (run == 0 || ns < c->ns[frame - 1]) c->ns[frame - 1] = ns;
      }
-   }  // end for i-loop
-  
-   /* create new ufo if possible (and randomnes and new game at least 15 frame/30  sec active)  */
-   if (rand() % UFO_RANDOMNESS == 1 && ship_dying == 0 && (frame - ufo_start_delay > 10*30)) {
-      add_ufo(); 
-   }
+     c->frames = frame;
+  }
+
+  c->worst_frame = 1;
+  for (frame = 1; frame <= c->frames; frame++)
+     if (c->ns[frame - 1] > c->ns[c->worst_frame - 1]) c->worst_frame = frame;
+  c->worst_ns = c->ns[c->worst_frame - 1];
 }
 
 
-void draw_score_line() 
+void play_fuzz_tries(void * data, int begin, int end)
 {
-  SDL_Color fgColor_green  = {0,182,0};   
-  SDL_Color fgColor_red    = {182,0,0};   
-  SDL_Color fgColor_grey   = {182,182,182};   // grey/white
-  SDL_Rect text_position;  
-  char text_line[20]; 
+  int k;
 
-  // highscore in green
-  sprintf(text_line, "%04d", high_score);
-  text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
-  text_position.x = 24 * factor;
-  text_position.y = 145 * factor;
-  SDL_BlitSurface(text, NULL , screen, &text_position);
+  (void) data;
+  headless = 1;
+  for (k = begin; k < end; k++)
+     play_fuzz_case(&fuzz_tries[k], 1);
+}
 
-  // arrow sign in grey/white
-  sprintf(text_line, "%c", 124); // arrow-char in modified o2 font
-  text = TTF_RenderText_Solid(font_large, text_line, fgColor_grey);
-  text_position.x = (24 * factor) + (3 * 12 * factor); // skip 3 chars
-  text_position.y = 145 * factor;
-  SDL_BlitSurface(text, NULL , screen, &text_position);
 
-  // highscore name in green
-  if (ship_destroyed == 1) {
-    flash_high_score_name();
-  } else {  
-    sprintf(text_line, "%s ", high_score_name);
-    text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
-    text_position.x = (24 * factor) + (4 * 12 * factor); // skip 4 chars
-    text_position.y = 145 * factor;
-    SDL_BlitSurface(text, NULL , screen, &text_position);
+void write_fuzz_case(const char * file, fuzz_case_type * c)
+{
+  /* header line, then the keys of the played frames (hex, 32 per line) */
+  FILE * f;
+  int i;
+
+  f = fopen(file, "w");
+  if (f == NULL) {
+     fprintf(stderr, "Couldn't write %s: %s\n", file, strerror(errno));
+     exit(1);
   }
+  fprintf(f, "ufo-fuzz seed %u difficulty %d asteroids %d ufo-randomness %d "
+          "asteroid-randomness %d frames %d slowest %d ns %u\n",
+          c->seed, batch_difficulty, batch_asteroids, batch_ufo_randomness,
+          batch_asteroid_randomness, c->frames, c->worst_frame, c->worst_ns);
+  for (i = 0; i < c->frames; i++)
+     fprintf(f, "%02x%s", c->keys[i], i % 32 == 31 || i == c->frames - 1 ? "\n" : "");
+  fclose(f);
+}
 
-  // current score in red
-  sprintf(text_line, " %04d", score);
-  text = TTF_RenderText_Solid(font_large, text_line, fgColor_red);
-  text_position.x = (24 * factor) + (9 * 12 * factor); // skip 9 chars
-  text_position.y = 145 * factor;
-  SDL_BlitSurface(text, NULL , screen, &text_position);
 
+void replay_fuzz_case()
+{
+  /* play a case of --fuzz KERNEL_REPS times: time of the slowest frame
+     and of the whole game (fastest run of each frame) */
+  fuzz_case_type c;
+  unsigned int key;
+  Uint64 total = 0;
+  FILE * f;
+  int i, frames;
+
+  f = fopen(fuzz_replay, "r");
+  if (f == NULL) {
+     fprintf(stderr, "Cannot open %s: %s\n", fuzz_replay, strerror(errno));
+     exit(1);
+  }
+  if (fscanf(f, "ufo-fuzz seed %u difficulty %d asteroids %d ufo-randomness %d "
+             "asteroid-randomness %d frames %d slowest %*d ns %*u",
+             &c.seed, &batch_difficulty, &batch_asteroids, &batch_ufo_randomness,
+             &batch_asteroid_randomness, &frames) != 6 ||
+      frames < 1 || batch_asteroids < 0 || batch_asteroids > ASTEROID_SLOTS) {
+     fprintf(stderr, "%s is not a case of --fuzz\n", fuzz_replay);
+     exit(1);
+  }
+  batch_max_frames = frames;
+  fuzz_alloc(&c);
+  for (i = 0; i < frames; i++) {
+     if (fscanf(f, "%2x", &key) != 1) {
+        fprintf(stderr, "%s ends at frame %d\n", fuzz_replay, i);
+        exit(1);
+     }
+     c.keys[i] = key;
+  }
+  fclose(f);
+
+  setup_ship_explosions();
+  load_masks();
+  headless = 1;
+  in_job = 1;                            // like --fuzz: no threads inside the game
+  play_fuzz_case(&c, KERNEL_REPS);
+  in_job = 0;
+  for (i = 0; i < c.frames; i++)
+     total += c.ns[i];
+  printf("%s: seed %u, %d frames in %.3f ms, slowest frame %d: %u ns\n", fuzz_replay,
+         c.seed, c.frames, total / 1e6, c.worst_frame, c.worst_ns);
 }
 
 
-void flash_high_score_name()
+int bot_input()
 {
-  SDL_Color fgColor_green  = {0,182,0};   
-  SDL_Rect text_position;  
-  char text_line[6];
+  /* bot player: keeps a random direction for 10..40 frames and fires when
+     an asteroid is less than 40 pixels away */
+  int i, keys;
 
-  if (high_score_broken == 1) strcpy(high_score_name, "??????");
+  if (bot_timer == 0) {
+     bot_keys = random_nr(RNG_INPUT, 16);      // any of left, right, up, down
+     bot_timer = random_nr(RNG_INPUT, 31) + 10;
+  }
+  bot_timer--;
 
-  // highscore name in green
-  sprintf(text_line, "%s ", high_score_name);
-  
-  text_line[flash_high_score_timer%6] = ' ';
-  text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
-  text_position.x = (24 * factor) + (4 * 12 * factor); // skip 4 chars
-  text_position.y = 145 * factor;
-  
-  SDL_BlitSurface(text, NULL , screen, &text_position);
-  
-  if (frame%3 == 0) {
-    flash_high_score_timer--;
-  }  
-  if (flash_high_score_timer < 0) flash_high_score_timer = 150;
+  keys = bot_keys;
+  for (i = 0; i < MAX_ASTEROIDS; i++) {
+     if ((asteroids[i].status == 1 || asteroids[i].status == 2) &&
+         abs(asteroids[i].x - ship_x) < FIX(40) && abs(asteroids[i].y - ship_y) < FIX(40))
+        keys |= INPUT_FIRE;
+  }
+  return keys;
 }
 
 
-void print_high_score_char(int character)
+int script_input()
 {
-  SDL_Color fgColor_green = {0,182,0};   
-  SDL_Color fgColor_red    = {182,0,0};   
-  SDL_Rect text_position;  
-  char text_line[6];
-  
-  // highscore name in green
-  strcpy(text_line, high_score_name);
-  
-  if (character != 13) text_line[high_score_character_pos] = character;
-  strcpy(high_score_name, text_line);
+  /* keys of input_script[] for this frame */
+  int i, n, t;
+
+  n = sizeof(input_script) / sizeof(input_script[0]);
+  t = 0;
+  for (i = 0; i < n; i++) t += input_script[i][1];
+  t = frame % t;
+  for (i = 0; t >= input_script[i][1]; i++) t -= input_script[i][1];
+  return input_script[i][0];
+}
 
-  high_score_character_pos++;
-  if (high_score_character_pos > 5 || character == 13) {  // max length or return
-    high_score_registration = 0;
-    printf("stop registration\n");
+
+void start_threads(int n)
+{
+  /* start the workers 1..n-1 (worker 0 is the main thread) */
+  int i;
+
+  stop_threads();
+  if (n < 1) n = 1;
+  if (n > MAX_THREADS) n = MAX_THREADS;
+
+  if (pool_lock == NULL) {
+     pool_lock = SDL_CreateMutex();
+     pool_wake = SDL_CreateCond();
+     pool_done = SDL_CreateCond();
+     for (i = 0; i < MAX_THREADS; i++) {
+        workers[i].nr = i;
+        workers[i].lock = SDL_CreateMutex();
+     }
+     if (pool_lock == NULL || pool_wake == NULL || pool_done == NULL) {
+        fprintf(stderr, "Couldn't create thread pool: %s\n", SDL_GetError());
+        exit(1);
+     }
   }
-    
-  text = TTF_RenderText_Solid(font_large, text_line, fgColor_green);
-  text_position.x = (24 * factor) + (4 * 12 * factor); // skip 4 chars
-  text_position.y = 145 * factor;
-  SDL_BlitSurface(text, NULL , screen, &text_position);
 
-  // current score in red
-  sprintf(text_line, " %04d", score);
-  text = TTF_RenderText_Solid(font_large, text_line, fgColor_red);
-  text_position.x = (24 * factor) + (9 * 12 * factor); // skip 9 chars
-  text_position.y = 145 * factor;
-  SDL_BlitSurface(text, NULL , screen, &text_position);
+  num_threads = n;
+  for (i = 1; i < num_threads; i++) {
+     workers[i].thread = SDL_CreateThread(worker_main, &workers[i]);
+     if (workers[i].thread == NULL) {
+        fprintf(stderr, "Couldn't create thread: %s\n", SDL_GetError());
+        exit(1);
+     }
+  }
+}
 
-  play_sound(7, -1);
+
+void stop_threads()
+{
+  int i;
+
+  if (pool_lock == NULL) return;   // never started
+
+  SDL_LockMutex(pool_lock);
+  pool_quit = 1;
+  SDL_CondBroadcast(pool_wake);
+  SDL_UnlockMutex(pool_lock);
+  for (i = 1; i < num_threads; i++) {
+     SDL_WaitThread(workers[i].thread, NULL);
+     workers[i].thread = NULL;
+  }
+  pool_quit = 0;
+  num_threads = 1;
 }
 
 
-void draw_ship_explosions()
+int worker_main(void * data)
 {
-  SDL_Rect src_rect;     // image source rectangle
-  SDL_Rect rect;         // image desc rectangle (w and h are ignored)
-  int k;
+  /* worker thread: wait for jobs, do them (and steal), wait again */
+  worker_type * w = data;
+  int seen;
+
+  thread_nr = w->nr;
+  SDL_LockMutex(pool_lock);
+  seen = pool_generation;
+  while (pool_quit == 0) {
+     if (pool_generation == seen) {
+        SDL_CondWait(pool_wake, pool_lock);
+        continue;
+     }
+     seen = pool_generation;
+     SDL_UnlockMutex(pool_lock);
+     work_jobs(w->nr);
+     SDL_LockMutex(pool_lock);
+  }
+  SDL_UnlockMutex(pool_lock);
+  return 0;
+}
 
-  /* draw ship explosion */
-  src_rect.x = 0;  // left
-  src_rect.y = 0;  // up
-  src_rect.w = 16 * factor;   
-  src_rect.h = 13 * factor;   
 
-  rect.x = ship_x - 3*factor;    // x  
-  rect.y = ship_y - 4*factor;    // y 
-  rect.w = SHIP_W * factor;      // ignored!
-  rect.h = SHIP_H * factor;      // ignored!
+void run_parallel(void (*fn)(void * data, int begin, int end), void * data, int n, int grain)
+{
+  /* call fn for index ranges of 0..n-1 on all workers and wait till all
+     are done. fn may only write results for its own range, the caller
+     combines them (in index order) */
+  int k, jobs;
+  worker_type * w;
+
+  /* not worth the threads, or already in a job (batch runner) */
+  if (num_threads == 1 || n <= grain || in_job == 1) {
+     fn(data, 0, n);
+     return;
+  }
 
-  if (ship_explosions[ship_explosion_nr].img_nr != 0) {     // draw explosion
-     SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].img_nr], &src_rect, screen, &rect);
-  }  
+  jobs = (n + grain - 1) / grain;
+  if (jobs > num_threads * JOBS_PER_THREAD) jobs = num_threads * JOBS_PER_THREAD;
+
+  SDL_LockMutex(pool_lock);
+  pool_jobs = jobs;
+  SDL_UnlockMutex(pool_lock);
+
+  /* worker k gets the k-th part of the ranges (neighbours stay together) */
+  for (k = 0; k < jobs; k++) {
+     w = &workers[k * num_threads / jobs];
+     SDL_LockMutex(w->lock);
+     w->jobs[w->tail].fn = fn;
+     w->jobs[w->tail].data = data;
+     w->jobs[w->tail].begin = (int) ((Sint64) n * k / jobs);
+     w->jobs[w->tail].end   = (int) ((Sint64) n * (k + 1) / jobs);
+     w->tail++;
+     SDL_UnlockMutex(w->lock);
+  }
 
-  if (ship_explosions[ship_explosion_nr].ship_nr != 0) {     // draw ship */
-    src_rect.w = SHIP_W * factor;   
-    src_rect.h = SHIP_H * factor;   
-    rect.x = ship_x;   // x 
-    rect.y = ship_y;   // y 
-    SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].ship_nr], &src_rect, screen, &rect);  // ship green
+  SDL_LockMutex(pool_lock);
+  pool_generation++;
+  SDL_CondBroadcast(pool_wake);
+  SDL_UnlockMutex(pool_lock);
+
+  work_jobs(0);
+
+  SDL_LockMutex(pool_lock);
+  while (pool_jobs > 0)
+     SDL_CondWait(pool_done, pool_lock);
+  SDL_UnlockMutex(pool_lock);
+}
+
+
+void work_jobs(int nr)
+{
+  job_type job;
+
+  while (take_job(nr, &job)) {
+     TRACE_BEGIN(t);
+     in_job = 1;
+     job.fn(job.data, job.begin, job.end);
+     in_job = 0;
+     TRACE_END(t, "job", NULL);
+     SDL_LockMutex(pool_lock);
+     pool_jobs--;
+     if (pool_jobs == 0) SDL_CondSignal(pool_done);
+     SDL_UnlockMutex(pool_lock);
   }
+}
 
-  if (ship_explosions[ship_explosion_nr].img_nr != 0) {     // draw explosion
-     SDL_BlitSurface(images[ship_explosions[ship_explosion_nr].img_nr], &src_rect, screen, &rect);
-  }  
 
-  if (ship_explosion_nr%8 == 0 ) {     // add 3 bullets (=explosion bits) every 8 images*/
-                                       // these are displayed on screen in function
-                                       // draw_bullets()
-       for (k = 0; k < MAX_BULLETS; k++) {
-              bullets[k].alive = 1;
-              bullets[k].timer = 15;  
-              bullets[k].x = ship_x + (SHIP_W/2 * factor);  // halfway ship
-              bullets[k].y = ship_y + (SHIP_H/2 * factor);  // halfway ship
-        }      
-        bullets[0].xm = 0;
-        bullets[0].ym = ( 40.74074 / 15) * factor; // slower and less far than normal bullet
-        bullets[1].xm = ( 28.80805 / 15) * factor;
-        bullets[1].ym = (-28.80805 / 15) * factor;  
-        bullets[2].xm = (-28.80805 / 15) * factor;
-        bullets[2].ym = (-28.80805 / 15) * factor;  
-   }    
+int take_job(int nr, job_type * job)
+{
+  /* own job (last one pushed) or else steal one from another worker
+     (first one pushed). Returns 0 if there is no job left */
+  int i, found;
+  worker_type * w;
+
+  for (i = 0; i < num_threads; i++) {
+     w = &workers[(nr + i) % num_threads];
+     found = 0;
+     SDL_LockMutex(w->lock);
+     if (w->head < w->tail) {
+        if (i == 0) {
+           *job = w->jobs[--w->tail];
+        } else {
+           *job = w->jobs[w->head++];
+        }
+        found = 1;
+     }
+     if (w->head == w->tail) {      // empty, start at 0 next time
+        w->head = 0;
+        w->tail = 0;
+     }
+     SDL_UnlockMutex(w->lock);
+     if (found) return 1;
+  }
+  return 0;
+}
 
-  ship_explosion_nr++;    // every frame 
-  if (ship_explosion_nr + 1 == SHIP_EXPLOSIONS) { // end of explosion sequences, ship gone
-     printf("GAME OVER\n");
-     ship_destroyed = 1;
-     flash_high_score_timer = 55;  // +/- 5 seconds : 
-     play_sound(6, -1); 
-  } 
+
+Uint64 clock_ns()
+{
+  /* monotonic clock in nanoseconds (SDL_GetTicks is only milliseconds) */
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (Uint64) (count.QuadPart / freq.QuadPart) * 1000000000 +
+         (Uint64) (count.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (Uint64) t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
 }
 
 
-int getStarColor(int speed)
+void seed_random(Uint32 seed)
 {
-  SDL_Color color;
+  /* fill the state of every stream with splitmix32 output of the seed,
+     each stream starts at a different point */
+  int i, j;
+  Uint32 z;
   
-  switch (speed)
-  {
-    case 1:
-    case 2:
-    case 3:
-      color.r = 221;  /* red */
-      color.g =  44;
-      color.b =   0;
-      break;
-        
-    case 4:
-    case 5:
-    case 6:
-      color.r =  76; /* green */
-      color.g = 175;
-      color.b =  80;
-      break;
-        
-    case 7:
-    case 8:
-    case 9:
-      color.r = 255; /* yellow */
-      color.g = 234;
-      color.b =   0;
-      break;
-      
-    default:
-      color.r = 255;  /* default white */
-      color.g = 255;
-      color.b = 255;
-      break;
+  for (i = 0; i < NUM_RNG_STREAMS; i++) {
+    for (j = 0; j < 4; j++) {
+      seed = seed + 0x9E3779B9;
+      z = seed;
+      z = (z ^ (z >> 16)) * 0x85EBCA6B;
+      z = (z ^ (z >> 13)) * 0xC2B2AE35;
+      rng_state[i][j] = z ^ (z >> 16);
+    }
+    if ((rng_state[i][0] | rng_state[i][1] | rng_state[i][2] | rng_state[i][3]) == 0)
+       rng_state[i][0] = 1;      // all zero state is not allowed
   }
-  
-  return SDL_MapRGB(screen->format, color.r, color.g, color.b);
+}
+
+
+Uint32 next_random(int stream)
+{
+  /* xoshiro128** (Blackman/Vigna) */
+  Uint32 * s = rng_state[stream];
+  Uint32 result, t;
+
+  result = s[1] * 5;
+  result = ((result << 7) | (result >> 25)) * 9;
+  t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 11) | (s[3] >> 21);
+
+  return result;
+}
+
+
+int random_nr(int stream, int n)
+{
+  /* random number 0..n-1 (replaces rand() % n) */
+  return (int) (((Uint64) next_random(stream) * (Uint32) n) >> 32);
+}
+
+
+Uint32 hash_random(Uint32 x, Uint32 y)
+{
+  /* stateless random number for position x,y (used for star field),
+     does not change any random stream */
+  Uint32 h = x * 0x8DA6B343 ^ y * 0xD8163841;
+
+  h = (h ^ (h >> 16)) * 0x7FEB352D;
+  h = (h ^ (h >> 15)) * 0x846CA68B;
+  return h ^ (h >> 16);
 }
 
 
 void play_sound(int snd, int chan)
 {
+   if (headless == 1) return;   // batch runner
+
    /* sounds:
          0 : recharge  (always on channel 0)
          1 : gun bit   (on free channel (-1), multiple channels possible)
@@ -2906,6 +7450,22 @@ void play_sound(int snd, int chan)
          8 : laser fire (on free channel 
          9 : ufo  (always on channel 6 and loop) 
         10 : select game (only in intro on free channel)  */
+    int k;
+
+    // in resolve phase: queue sound, only once per channel (last one wins)
+    // and once per sound on a free channel
+    if (defer_sounds == 1) {
+       for (k = 0; k < num_queued_sounds; k++) {
+          if (chan != -1 && queued_sounds[k][1] == chan) break;
+          if (chan == -1 && queued_sounds[k][1] == -1 && queued_sounds[k][0] == snd) break;
+       }
+       queued_sounds[k][0] = snd;
+       queued_sounds[k][1] = chan;
+       if (k == num_queued_sounds) num_queued_sounds++;
+       return;
+    }
+
+    TRACE_BEGIN(t);
     //printf("channel: %d, %d channels are now playing\n", chan, Mix_Playing(-1));
 
     // Some tweaks to improve sounds (SDL_Mixer is not perfect)
@@ -2938,6 +7498,7 @@ void play_sound(int snd, int chan)
     } else {  
          chan = Mix_PlayChannel(chan, sounds[snd], 0);
     }     
+    TRACE_END(t, "play_sound", sound_names[snd]);
 }
 
 
@@ -2965,32 +7526,34 @@ void title_screen()
   asteroids[0].status      = 1;                      // normal, not magnetic
   asteroids[0].colour      = 2;
   asteroids[0].shape_timer = ASTEROID_SHAPE_TIMER;   // count_down timer for shape
-  asteroids[0].x  = 36 * factor;
-  asteroids[0].y  = 120 * factor;
+  asteroids[0].x  = FIX(36);
+  asteroids[0].y  = FIX(120);
   asteroids[0].xm = 0;
   asteroids[0].ym = 0;
 
   asteroids[1].status      = 2;                      // magnetic
   asteroids[1].colour      = 5;
   asteroids[1].shape_timer = ASTEROID_SHAPE_TIMER;   // count_down timer for shape
-  asteroids[1].x  = 90 * factor;
+  asteroids[1].x  = FIX(90);
   ship_x = asteroids[1].x;                           // to fixate magnetic asteroid
-  asteroids[1].y  = 120 * factor;
+  asteroids[1].y  = FIX(120);
   ship_y = asteroids[1].y;                           // to fixate magnetic asteroid
   asteroids[1].xm = 0;
   asteroids[1].ym = 0;
 
   ufo[0].status = 1;
   ufo[0].colour = 6;
-  ux = 148 * factor;
-  uy = 122 * factor;
+  ux = FIX(148);
+  uy = FIX(122);
   ufo[0].xm = 0;
   ufo[0].ym = 0;
   scroll_x = 0;
+  frame_stats[LOOP_TITLE].start = 0;   // no period from the game
     
   do
   {
     last_time = SDL_GetTicks();
+    frame_begin(LOOP_TITLE);
       
     /* Check for keypresses: */
     while (SDL_PollEvent(&event))
@@ -3002,8 +7565,8 @@ void title_screen()
         asteroids[0].status      = 0; 
         asteroids[1].status      = 0; 
         ufo[0].status = 0;
-        ship_x = screen_width / 2;
-        ship_y = screen_height / 2;
+        ship_x = FIX(VIDEOPAC_RES_W / 2);
+        ship_y = FIX(VIDEOPAC_RES_H / 2);
       }   
       
       if (event.type == SDL_KEYDOWN)
@@ -3016,31 +7579,19 @@ void title_screen()
              asteroids[0].status      = 0; 
              asteroids[1].status      = 0; 
              ufo[0].status = 0;
-             ship_x = screen_width / 2;
-             ship_y = screen_height / 2;
+             ship_x = FIX(VIDEOPAC_RES_W / 2);
+             ship_y = FIX(VIDEOPAC_RES_H / 2);
              
              switch (key)
              {
              case 49: 
-                 difficulty = 1;
-                 MAX_UFOS = 1;
-                 MAX_LASERS = 1;     
-                 MAX_ASTEROIDS = 15;
-                 UFO_RANDOMNESS = 250;    
+                 set_difficulty(1);
                  break;
              case 50: 
-                 difficulty = 2;
-                 MAX_UFOS = 2;
-                 MAX_LASERS = 2;     
-                 MAX_ASTEROIDS = 25;
-                 UFO_RANDOMNESS = 100;    
+                 set_difficulty(2);
                  break;
              case 51: 
-                 difficulty = 3;
-                 MAX_UFOS = 3;
-                 MAX_LASERS = 3;     
-                 MAX_ASTEROIDS = 35;
-                 UFO_RANDOMNESS = 50;    
+                 set_difficulty(3);
                  break;
               default:
                  break;   
@@ -3085,20 +7636,14 @@ void title_screen()
        
 
            if (window_size_changed == 1) {
-                handle_screen_resize(1);
-
-                /* recalculate object positions (points) */
-                asteroids[0].x  = 36 * factor;
-                asteroids[0].y  = 120 * factor;
-                asteroids[1].x  = 90 * factor;
-                ship_x = asteroids[1].x;                   // to fixate magnetic asteroid
-                asteroids[1].y  = 120 * factor;
-                ship_y = asteroids[1].y;                   // to fixate magnetic asteroid
-                ux = 148 * factor;
-                uy = 122 * factor;
-                scroll_x = 0;
+                handle_screen_resize();
            }    
           
+           if (key == SDLK_F5) print_frame_stats();
+#ifdef TRACK_ALLOCS
+           if (key == SDLK_F6) track_report();
+#endif
+
            if (key == SDLK_ESCAPE)
               exit(0);
         }
@@ -3124,27 +7669,59 @@ void title_screen()
           if (scroll_x == 269) scroll_x = 0;
           handle_asteroids();
           draw_asteroids();
-          ufo[0].x = ux + ( ( rand() % 6) - 3);
-          ufo[0].y = uy + ( ( rand() % 6) - 3);
+          handle_asteroid_shapes();
+          ufo[0].x = ux + ( random_nr(RNG_COSMETIC, 6) - 3) * FIX_ONE / 5;
+          ufo[0].y = uy + ( random_nr(RNG_COSMETIC, 6) - 3) * FIX_ONE / 5;
           draw_ufo();
+          handle_ufo_explosions();
        }   
 
     } else {
       // wobbly text!
-      x = ( (VIDEOPAC_RES_W / 2 * factor) - (12*4*factor) + (( rand() % 4) - 2));
-      y = ( (VIDEOPAC_RES_H / 2 * factor) - (5 * factor)  + (( rand() % 4) - 2));
+      x = ( (VIDEOPAC_RES_W / 2 * factor) - (12*4*factor) + (random_nr(RNG_COSMETIC, 4) - 2));
+      y = ( (VIDEOPAC_RES_H / 2 * factor) - (5 * factor)  + (random_nr(RNG_COSMETIC, 4) - 2));
     }
     display_select_game(x, y);
 
     SDL_Flip(screen);
 
+    frame_work_done(LOOP_TITLE);
     if (SDL_GetTicks() < last_time + 33)
         SDL_Delay(last_time + 33 - SDL_GetTicks());
+    frame_end(LOOP_TITLE);
+    TRACK_FRAME();
       
   } // end do
   while (done == 0);
 }
 
+void set_difficulty(int d)
+{
+  difficulty = d;
+  switch (d)
+  {
+  case 1:   // normal
+      MAX_UFOS = 1;
+      MAX_LASERS = 1;     
+      MAX_ASTEROIDS = 15;
+      UFO_RANDOMNESS = 250;    
+      break;
+  case 2:   // hard
+      MAX_UFOS = 2;
+      MAX_LASERS = 2;     
+      MAX_ASTEROIDS = 25;
+      UFO_RANDOMNESS = 100;    
+      break;
+  case 3:   // insane
+      MAX_UFOS = 3;
+      MAX_LASERS = 3;     
+      MAX_ASTEROIDS = 35;
+      UFO_RANDOMNESS = 50;    
+      break;
+  }
+}
+
+
 void display_select_game(int x, int y)
 {
   SDL_Color fgColor_green   = {0,182,0};   
@@ -3163,30 +7740,37 @@ void display_select_game(int x, int y)
   text_position.x = x;
   text_position.y = y;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", " E       M ");
   text = TTF_RenderText_Solid(font_large, text_line, fgColor_yellow);
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
     
   sprintf(text_line, "%s", "  L       E");
   text = TTF_RenderText_Solid(font_large, text_line, fgColor_blue);
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "   E       ");
   text = TTF_RenderText_Solid(font_large, text_line, fgColor_magenta);
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "    C      ");
   text = TTF_RenderText_Solid(font_large, text_line, fgColor_cyan);
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "     T     ");
   text = TTF_RenderText_Solid(font_large, text_line, fgColor_grey);
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "       G   ");
   text = TTF_RenderText_Solid(font_large, text_line, fgColor_red);
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 }
 
 
@@ -3210,6 +7794,7 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = scroll_x * factor;
   text_position.y = scroll_y * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", 
     "                1 FOR NORMAL                                              1 FOR NORMAL                         ");
@@ -3217,6 +7802,7 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = scroll_x * factor;
   text_position.y = scroll_y * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", 
     "                             2 FOR HARD                                                2 FOR HARD              ");
@@ -3224,6 +7810,7 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = scroll_x * factor;
   text_position.y = scroll_y * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", 
     "                                        3 FOR INSANE                                              3 FOR INSANE ");
@@ -3231,6 +7818,7 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = scroll_x * factor;
   text_position.y = scroll_y * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
 
 
@@ -3239,12 +7827,14 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = 30 * factor;
   text_position.y = 70 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "                8 FULL SCREEN");
   text = TTF_RenderText_Solid(font_small, text_line, fgColor_yellow);
   text_position.x = 30 * factor;
   text_position.y = 70 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
 
   sprintf(text_line, "%s", "JOYSTICK");
@@ -3252,12 +7842,14 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = 30 * factor;
   text_position.y = 80 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "                9 WINDOW SMALLER");
   text = TTF_RenderText_Solid(font_small, text_line, fgColor_cyan);
   text_position.x = 30 * factor;
   text_position.y = 80 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
 
   sprintf(text_line, "%s", "ARROW KEYS");
@@ -3265,29 +7857,34 @@ void display_instructions(int scroll_x, int scroll_y)
   text_position.x = 30 * factor;
   text_position.y = 90 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "                0 WINDOW LARGER");
   text = TTF_RenderText_Solid(font_small, text_line, fgColor_grey);
   text_position.x = 30 * factor;
   text_position.y = 90 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "CTRL = FIRE");
   text = TTF_RenderText_Solid(font_small, text_line, fgColor_red);
   text_position.x = 30 * factor;
   text_position.y = 100 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "                ESC = QUIT");
   text = TTF_RenderText_Solid(font_small, text_line, fgColor_blue);
   text_position.x = 30 * factor;
   text_position.y = 100 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
   sprintf(text_line, "%s", "1 pt       3 pts       10 pts");
   text = TTF_RenderText_Solid(font_small, text_line, fgColor_green);
   text_position.x = 30 * factor;
   text_position.y = 130 * factor;
   SDL_BlitSurface(text, NULL , screen, &text_position);
+  SDL_FreeSurface(text);
 
  }  // ufo.c